@@ -85,8 +85,10 @@ static void usage(const char *argv0)
         "  %s status [node]\n"
         "  %s dump\n"
         "  %s save\n"
+        "  %s stats\n"
+        "  %s plan\n"
         "  %s watch\n",
-        argv0, argv0, argv0, argv0);
+        argv0, argv0, argv0, argv0, argv0, argv0);
 }
 
 int main(int argc, char **argv)
@@ -127,6 +129,20 @@ int main(int argc, char **argv)
         }
         snprintf(cmd, sizeof(cmd), "SAVE");
 
+    } else if (strcmp(argv[1], "stats") == 0) {
+        if (argc != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        snprintf(cmd, sizeof(cmd), "STATS");
+
+    } else if (strcmp(argv[1], "plan") == 0) {
+        if (argc != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        snprintf(cmd, sizeof(cmd), "PLAN");
+
     } else if (strcmp(argv[1], "watch") == 0) {
         if (argc != 2) {
             usage(argv[0]);
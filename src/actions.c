@@ -1,64 +1,696 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+
 #include "graph.h"
 #include "actions.h"
+#include "plan.h"
 
 #include "kernel/kernel_link.h"
 #include "kernel/kernel_bridge.h"
+#include "kernel/kernel_virt.h"
+#include "kernel/kernel_cache.h"
+#include "kernel/kernel_nl.h"
+
+/*
+ * ---- in-flight waves ----
+ *
+ * Activations do not write to the kernel: they record what they need
+ * in the pass plan (plan.h). action_flush() optimizes the plan, lowers
+ * it into one batch (a wave) and submits it; the wave completes from
+ * the poll loop (kernel_nl_process) and its outcome is queued for the
+ * graph (action_next_completion). A wave of hundreds of links thus
+ * costs a few sendmsg() calls and one round of ACKs, and every message
+ * still completes the node that planned it. Each message remembers the
+ * activation generation it belongs to, so a late completion for an
+ * earlier lifecycle is recognised and ignored.
+ */
+
+/* owner of one message of a wave */
+struct action_ref {
+    struct node  *node;              /* NULL once forgotten */
+    unsigned int  gen;
+    int           sync;              /* last of a bridge port's run: the
+                                        port, whose VLANs follow */
+    size_t        wait;              /* last of a run: 1 + its first
+                                        wait, 0 if none */
+
+    plan_op_type_t type;             /* the op it was lowered from, */
+    int            ifindex, arg;     /* noted in the link cache once
+                                        acked */
+};
+
+/*
+ * An owner whose ops were dropped as repeats (plan_op.dup) waits for
+ * the messages of the ops kept in their place and fails with them.
+ * An owner's waits are consecutive; the first one says how many.
+ */
+struct action_wait {
+    struct node  *node;              /* NULL once forgotten */
+    unsigned int  gen;
+    int           sync;              /* as action_ref.sync */
+    size_t        n;                 /* first of an owner: its waits */
+    bool          merged;            /* first: the owner has a run too */
+    size_t        first, end;        /* messages of the kept op */
+};
+
+/* the messages an op of the lowered plan became */
+struct action_span {
+    size_t first, end;
+};
+
+struct action_wave {
+    struct kernel_nl_batch batch;
+    struct action_ref     *refs;     /* refs[i] owns batch.ops[i] */
+    size_t                 refs_cap;
+
+    struct action_wait    *waits;
+    size_t                 waits_n, waits_cap;
+
+    struct action_span    *spans;    /* per plan op, while lowering */
+    size_t                 spans_cap;
+
+    struct action_wave    *next;     /* in-flight or free list */
+};
+
+struct action_completion {
+    struct node     *node;
+    unsigned int     gen;
+    action_result_t  res;
+};
+
+static struct action_wave *waves_inflight;
+static struct action_wave *waves_free;
+
+static struct action_completion *done_q;
+static size_t done_head, done_n, done_cap;
+
+/*
+ * VLAN sync: once a port's enslave and admin up have landed (enslaving
+ * gives it the bridge's default VLANs), its VLAN membership is diffed
+ * against the kernel's table and submitted on its own. Every port
+ * queued by then shares one bridge port dump, so a wave of N ports
+ * costs one dump rather than N. The dump completes from the poll loop
+ * like a wave; ports queued meanwhile wait for the next one.
+ */
+struct port_sync {
+    struct node        *node;        /* NULL once forgotten */
+    unsigned int        gen;
+    int                 ifindex;
+    struct l2_vlan_set  vlans;       /* the port's table, from the dump */
+};
+
+static struct port_sync *syncs;
+static size_t syncs_n, syncs_cap;
+static size_t syncs_dumped;          /* syncs[0..syncs_dumped) await
+                                        port_dump */
+static struct kernel_nl_dump port_dump;
+
+/* the pass plan; a dry run records into its own */
+static struct plan pass_plan;
+static struct plan *plan = &pass_plan;
+
+static struct action_wave *wave_alloc(void)
+{
+    struct action_wave *w = waves_free;
+
+    if (w) {
+        waves_free = w->next;
+    } else {
+        w = calloc(1, sizeof(*w));
+        if (!w)
+            return NULL;
+        kernel_nl_batch_init(&w->batch);
+    }
+
+    kernel_nl_batch_reset(&w->batch);
+    w->waits_n = 0;
+    w->next = NULL;
+    return w;
+}
+
+static void wave_put(struct action_wave *w)
+{
+    w->next = waves_free;
+    waves_free = w;
+}
+
+static void wave_unlink(struct action_wave *w)
+{
+    for (struct action_wave **pp = &waves_inflight; *pp; pp = &(*pp)->next) {
+        if (*pp == w) {
+            *pp = w->next;
+            w->next = NULL;
+            return;
+        }
+    }
+}
+
+/* room for refs up to n messages */
+static bool wave_reserve(struct action_wave *w, size_t n)
+{
+    if (n <= w->refs_cap)
+        return true;
+
+    size_t cap = w->refs_cap ? w->refs_cap : 64;
+    while (cap < n)
+        cap *= 2;
+
+    struct action_ref *r = realloc(w->refs, cap * sizeof(*r));
+    if (!r)
+        return false;
+
+    w->refs = r;
+    w->refs_cap = cap;
+    return true;
+}
+
+/* room for a span per op of an n op plan */
+static bool wave_reserve_spans(struct action_wave *w, size_t n)
+{
+    if (n <= w->spans_cap)
+        return true;
+
+    size_t cap = w->spans_cap ? w->spans_cap : 64;
+    while (cap < n)
+        cap *= 2;
+
+    struct action_span *s = realloc(w->spans, cap * sizeof(*s));
+    if (!s)
+        return false;
+
+    w->spans = s;
+    w->spans_cap = cap;
+    return true;
+}
+
+static struct action_wait *wave_add_wait(struct action_wave *w)
+{
+    if (w->waits_n == w->waits_cap) {
+        size_t cap = w->waits_cap ? w->waits_cap * 2 : 16;
+        struct action_wait *q = realloc(w->waits, cap * sizeof(*q));
+        if (!q)
+            return NULL;
+        w->waits = q;
+        w->waits_cap = cap;
+    }
+
+    return &w->waits[w->waits_n++];
+}
+
+static void wave_forget(struct action_wave *w, const struct node *n)
+{
+    for (size_t i = 0; i < w->batch.n_ops; i++)
+        if (w->refs[i].node == n)
+            w->refs[i].node = NULL;
+
+    for (size_t i = 0; i < w->waits_n; i++)
+        if (w->waits[i].node == n)
+            w->waits[i].node = NULL;
+}
+
+static void complete(struct node *n, unsigned int gen, action_result_t res)
+{
+    if (done_head + done_n == done_cap) {
+        /* compact, then grow if still full */
+        memmove(done_q, done_q + done_head, done_n * sizeof(*done_q));
+        done_head = 0;
+
+        if (done_n == done_cap) {
+            size_t cap = done_cap ? done_cap * 2 : 16;
+            struct action_completion *q =
+                realloc(done_q, cap * sizeof(*q));
+            if (!q)
+                return;   /* node stays pending; disable recovers it */
+            done_q = q;
+            done_cap = cap;
+        }
+    }
+
+    done_q[done_head + done_n++] = (struct action_completion){
+        .node = n, .gen = gen, .res = res,
+    };
+}
+
+bool action_next_completion(struct node **n,
+                            unsigned int *gen,
+                            action_result_t *res)
+{
+    while (done_n) {
+        struct action_completion *c = &done_q[done_head++];
+        done_n--;
+
+        if (!c->node)
+            continue;   /* forgotten */
+
+        *n   = c->node;
+        *gen = c->gen;
+        *res = c->res;
+        return true;
+    }
+
+    done_head = 0;
+    return false;
+}
+
+void action_forget(struct node *n)
+{
+    for (struct action_wave *w = waves_inflight; w; w = w->next)
+        wave_forget(w, n);
+
+    /* unsent: nothing is created for a node that is gone */
+    for (size_t i = 0; i < pass_plan.n; i++)
+        if (pass_plan.ops[i].node == n)
+            pass_plan.ops[i].node = NULL;
+
+    for (size_t i = 0; i < done_n; i++)
+        if (done_q[done_head + i].node == n)
+            done_q[done_head + i].node = NULL;
+
+    for (size_t i = 0; i < syncs_n; i++)
+        if (syncs[i].node == n)
+            syncs[i].node = NULL;
+}
+
+void action_forget_all(void)
+{
+    /* nobody waits for them: their late ACKs are dropped as leftovers */
+    while (waves_inflight) {
+        struct action_wave *w = waves_inflight;
+
+        waves_inflight = w->next;
+        kernel_nl_batch_cancel(&w->batch);
+        wave_put(w);
+    }
+
+    /* nothing of an unsent plan is wanted any more */
+    plan_reset(&pass_plan);
+
+    done_head = done_n = 0;
+
+    /*
+     * A running dump still completes into syncs[0..syncs_dumped): the
+     * kernel only starts the next one once this one is read out.
+     */
+    for (size_t i = 0; i < syncs_dumped; i++)
+        syncs[i].node = NULL;
+    syncs_n = syncs_dumped;
+}
+
+void action_release(void)
+{
+    action_forget_all();
+
+    kernel_nl_dump_cancel(&port_dump);
+    free(syncs);
+    syncs = NULL;
+    syncs_n = syncs_cap = syncs_dumped = 0;
+
+    while (waves_free) {
+        struct action_wave *w = waves_free;
+
+        waves_free = w->next;
+        kernel_nl_batch_free(&w->batch);
+        free(w->refs);
+        free(w->waits);
+        free(w->spans);
+        free(w);
+    }
+
+    plan_free(&pass_plan);
+
+    free(done_q);
+    done_q = NULL;
+    done_head = done_n = done_cap = 0;
+}
+
+/* n owns what it planned since first */
+static action_result_t plan_done(struct node *n, size_t first)
+{
+    return plan_claim(plan, first, n, n->act_gen) ? ACTION_PENDING
+                                                  : ACTION_OK;
+}
+
+/* from the node's binding or the link cache, never a kernel query */
+static int link_ifindex(const char *name)
+{
+    const struct kernel_link_info *l = kernel_cache_find_name(name);
+    return l ? l->ifindex : -1;
+}
+
+static int node_ifindex(struct node *n)
+{
+    return n->ifindex > 0 ? n->ifindex : link_ifindex(n->id);
+}
+
+/*
+ * A link an activation builds on (master, VLAN parent), 0 if unknown.
+ * In a dry run one the same plan creates has no ifindex yet: it stands
+ * in as -(1 + position of its CREATE), which groups and compares like
+ * an ifindex and is never sent.
+ */
+static int lower_ifindex(struct node *n, const char *name)
+{
+    int ifindex = n ? node_ifindex(n) : link_ifindex(name);
+    if (ifindex > 0)
+        return ifindex;
+
+    if (n && plan != &pass_plan)
+        for (size_t i = 0; i < plan->n; i++)
+            if (plan->ops[i].type == PLAN_CREATE && plan->ops[i].node == n)
+                return -(int)(i + 1);
+
+    return 0;
+}
+
+/*
+ * Bring a known link up; nothing to do if it already is.
+ */
+static action_result_t link_up(struct node *n, int ifindex, bool up)
+{
+    if (up)
+        return ACTION_OK;
+
+    size_t first = plan->n;
+    if (!plan_add(plan, PLAN_UP, ifindex, n->id))
+        return ACTION_FAIL;
+
+    return plan_done(n, first);
+}
+
+/*
+ * Take a link down. Nothing waits for a deactivation, so the op
+ * belongs to no node; the optimizer drops it if the link is already
+ * down.
+ */
+static void link_down(struct node *n)
+{
+    const struct kernel_link_info *l = kernel_cache_find_name(n->id);
+
+    int ifindex = l ? l->ifindex : node_ifindex(n);
+    if (ifindex <= 0)
+        return;
+
+    plan_add(plan, PLAN_DOWN, ifindex, n->id);
+}
 
 /* ---- DEVICE ---- */
 
+/* runs once the link is present (needs_link), so it is cached */
 static action_result_t device_activate(struct node *n)
 {
-    if (kernel_link_set_updown(n->id, true) < 0)
+    const struct kernel_link_info *l = kernel_cache_find_name(n->id);
+    if (!l)
         return ACTION_FAIL;
 
-    return ACTION_OK;
+    return link_up(n, l->ifindex, l->flags & IFF_UP);
 }
 
 static void device_deactivate(struct node *n)
 {
-    kernel_link_set_updown(n->id, false);
+    link_down(n);
 }
 
 /* ---- BRIDGE ---- */
 
-static action_result_t bridge_activate(struct node *n)
+static void bridge_opts(struct node *n, struct kernel_bridge_opts *opts)
 {
     struct feat_bridge *fb = (struct feat_bridge *)
                         node_feature_find(n, FEAT_BRIDGE);
 
-    if (!kernel_link_exists(n->id))
-        kernel_bridge_create(n->id);
+    *opts = (struct kernel_bridge_opts){
+        .vlan_filtering = fb && fb->vlan_filtering,
+        .default_pvid   = fb ? fb->default_pvid : 0,
+    };
+}
+
+/*
+ * Creation, bridge options and admin up are one RTM_NEWLINK. A bridge
+ * the link cache already shows as wanted costs nothing.
+ */
+static action_result_t bridge_activate(struct node *n)
+{
+    struct kernel_bridge_opts opts;
+
+    if (!node_feature_find(n, FEAT_BRIDGE))
+        return ACTION_FAIL;
 
-    if (fb->vlan_filtering)
-        kernel_bridge_set_vlan_filtering(n->id, true);
+    bridge_opts(n, &opts);
+    if (kernel_bridge_matches(n->id, &opts))
+        return ACTION_OK;
 
-    kernel_link_set_up(n->id);
-    return ACTION_OK;
+    size_t first = plan->n;
+    if (!plan_add(plan, PLAN_CREATE, 0, n->id))
+        return ACTION_FAIL;
+
+    return plan_done(n, first);
 }
 
+static int bridge_create(struct kernel_nl_batch *b, const struct plan_op *op)
+{
+    struct kernel_bridge_opts opts;
+
+    bridge_opts(op->node, &opts);
+    return kernel_bridge_batch_ensure(b, op->name, &opts, NULL);
+}
 
 static void bridge_deactivate(struct node *n)
 {
-    (void)n;
+    link_down(n);
 }
 
-/* ---- BOND ---- */
+/* ---- VIRTUAL LINKS (vlan, veth, bond) ---- */
 
-static action_result_t bond_activate(struct node *n)
+/*
+ * Existence comes from the link cache alone: it is warm after the
+ * initial sync, and a query per link would cost the round trips the
+ * wave saves. A link that exists is brought up, never recreated.
+ */
+static action_result_t virt_activate(struct node *n, int lower)
 {
-    (void)n;
-    return ACTION_OK;
+    const struct kernel_link_info *l = kernel_cache_find_name(n->id);
+    if (l)
+        return link_up(n, l->ifindex, l->flags & IFF_UP);
+
+    size_t first = plan->n;
+    struct plan_op *op = plan_add(plan, PLAN_CREATE, 0, n->id);
+    if (!op)
+        return ACTION_FAIL;
+    op->arg = lower;
+
+    return plan_done(n, first);
+}
+
+static action_result_t vlan_activate(struct node *n)
+{
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)
+                        node_feature_find(n, FEAT_VLAN_DOMAIN);
+
+    if (!fv)
+        return ACTION_FAIL;
+
+    if (kernel_cache_find_name(n->id))
+        return virt_activate(n, 0);
+
+    int parent = lower_ifindex(fv->parent, fv->parent_id);
+    if (!parent)
+        return ACTION_FAIL;
+
+    return virt_activate(n, parent);
 }
 
-static void bond_deactivate(struct node *n)
+static int vlan_create(struct kernel_nl_batch *b, const struct plan_op *op)
 {
-    (void)n;
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)
+                        node_feature_find(op->node, FEAT_VLAN_DOMAIN);
+
+    if (!fv)
+        return -1;
+
+    return kernel_virt_batch_vlan(b, op->name, op->arg, fv->vid, NULL);
+}
+
+static int veth_create(struct kernel_nl_batch *b, const struct plan_op *op)
+{
+    struct feat_veth *fv = (struct feat_veth *)
+                        node_feature_find(op->node, FEAT_VETH);
+
+    if (!fv)
+        return -1;
+
+    return kernel_virt_batch_veth(b, op->name, fv->peer, NULL);
+}
+
+static int bond_create(struct kernel_nl_batch *b, const struct plan_op *op)
+{
+    struct feat_bond *fb = (struct feat_bond *)
+                        node_feature_find(op->node, FEAT_BOND);
+
+    struct kernel_bond_opts opts = {
+        .mode   = fb ? fb->mode : -1,
+        .miimon = fb ? fb->miimon : 0,
+    };
+
+    return kernel_virt_batch_bond(b, op->name, &opts, NULL);
+}
+
+/*
+ * Of two veth ends that are both nodes, the lower id creates the pair;
+ * the other one requires it (config), so by the time it activates the
+ * pair exists and it is only brought up.
+ */
+static action_result_t veth_activate(struct node *n)
+{
+    return virt_activate(n, 0);
+}
+
+static action_result_t bond_activate(struct node *n)
+{
+    return virt_activate(n, 0);
 }
 
 /* ---- BRIDGE PORT ---- */
 
+static struct l2_vlan_set vlan_add, vlan_del;
+
+static void port_sync_add(struct node *n, unsigned int gen, int ifindex)
+{
+    if (syncs_n == syncs_cap) {
+        size_t cap = syncs_cap ? syncs_cap * 2 : 16;
+        struct port_sync *ps = realloc(syncs, cap * sizeof(*ps));
+        if (!ps) {
+            complete(n, gen, ACTION_FAIL);
+            return;
+        }
+        syncs = ps;
+        syncs_cap = cap;
+    }
+
+    struct port_sync *ps = &syncs[syncs_n++];
+    ps->node    = n;
+    ps->gen     = gen;
+    ps->ifindex = ifindex;
+    l2_vlan_set_clear(&ps->vlans);
+}
+
+static int port_sync_cmp(const void *a, const void *b)
+{
+    const struct port_sync *x = a, *y = b;
+
+    return (x->ifindex > y->ifindex) - (x->ifindex < y->ifindex);
+}
+
+/* a dumped port: hand its table to every sync queued for it */
+static void port_sync_collect(const struct kernel_bridge_port_state *st,
+                              void *arg)
+{
+    size_t lo = 0, hi = syncs_dumped;
+
+    (void)arg;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (syncs[mid].ifindex < st->ifindex)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < syncs_dumped && syncs[lo].ifindex == st->ifindex; lo++)
+        syncs[lo].vlans = st->vlans;
+}
+
+/*
+ * VLAN membership: only what differs from the port's table, one op
+ * per range.
+ */
+static int bridge_port_plan_vlans(struct plan *p, struct node *n,
+                                  int port_ifindex,
+                                  const struct l2_vlan_set *current)
+{
+    l2_vlan_set_diff(n->topo.vlans, current, &vlan_add, &vlan_del);
+
+    if (plan_add_vlans(p, PLAN_VLAN_DEL, port_ifindex, n->id, &vlan_del) < 0 ||
+        plan_add_vlans(p, PLAN_VLAN_ADD, port_ifindex, n->id, &vlan_add) < 0)
+        return -1;
+
+    return 0;
+}
+
+static void plan_submit(struct plan *p);
+static void port_sync_run(void);
+
+/*
+ * Second stage for every dumped port: each port's diff, all submitted
+ * as one wave. Unknown state (a failed dump) falls back to programming
+ * everything.
+ */
+static void port_sync_finish(int err)
+{
+    if (err < 0)
+        for (size_t i = 0; i < syncs_dumped; i++)
+            l2_vlan_set_clear(&syncs[i].vlans);
+
+    for (size_t i = 0; i < syncs_dumped; i++) {
+        struct port_sync *ps = &syncs[i];
+        size_t first = pass_plan.n;
+
+        if (!ps->node)
+            continue;   /* forgotten */
+
+        if (bridge_port_plan_vlans(&pass_plan, ps->node, ps->ifindex,
+                                   &ps->vlans) < 0) {
+            pass_plan.n = first;
+            complete(ps->node, ps->gen, ACTION_FAIL);
+            continue;
+        }
+
+        if (!plan_claim(&pass_plan, first, ps->node, ps->gen))
+            complete(ps->node, ps->gen, ACTION_OK);
+    }
+
+    syncs_n -= syncs_dumped;
+    memmove(syncs, syncs + syncs_dumped, syncs_n * sizeof(*syncs));
+    syncs_dumped = 0;
+
+    plan_submit(&pass_plan);
+    port_sync_run();
+}
+
+static void port_sync_done(struct kernel_nl_dump *d, void *arg)
+{
+    (void)arg;
+    port_sync_finish(d->err);
+}
+
+/* start a dump for the ports queued so far, unless one is running */
+static void port_sync_run(void)
+{
+    if (syncs_dumped || !syncs_n)
+        return;
+
+    qsort(syncs, syncs_n, sizeof(*syncs), port_sync_cmp);
+    syncs_dumped = syncs_n;
+
+    int r = kernel_bridge_port_dump(&port_dump, port_sync_collect,
+                                    port_sync_done, NULL);
+    if (r < 0)
+        port_sync_finish(r);
+}
+
+/*
+ * Reconcile the port against its current bridge state: enslave and
+ * admin up are planned as a diff against the link cache, VLAN intent
+ * as a VLAN sync that runs once they have landed. A port that has not
+ * drifted plans nothing but the sync.
+ */
 static action_result_t bridge_port_activate(struct node *n)
 {
+    struct kernel_bridge_port_state st;
+
     struct feat_master *fm = (struct feat_master *)
                 node_feature_find(n, FEAT_MASTER);
 
@@ -71,38 +703,482 @@ static action_result_t bridge_port_activate(struct node *n)
     if (!br->topo.is_bridge)
         return ACTION_FAIL;
 
-    /* 1. Enslave port to bridge (idempotent) */
-    if (kernel_bridge_add_port(br->id, n->id) < 0)
+    int br_ifindex   = lower_ifindex(br, br->id);
+    int port_ifindex = node_ifindex(n);
+    if (!br_ifindex || port_ifindex <= 0)
         return ACTION_FAIL;
 
+    /* unknown state falls back to programming everything */
+    if (!kernel_bridge_port_cached(port_ifindex, &st))
+        memset(&st, 0, sizeof(st));
+
+    size_t first = plan->n;
+
+    /* 1. Enslave port to bridge */
+    if (st.master != br_ifindex) {
+        struct plan_op *op = plan_add(plan, PLAN_MASTER, port_ifindex, n->id);
+        if (!op)
+            goto fail;
+        op->arg    = br_ifindex;
+        op->master = br->id;
+    }
+
     /* 2. Ensure port admin UP */
-    if (!kernel_link_is_up(n->id)) {
-        if (kernel_link_set_up(n->id) < 0)
-            return ACTION_FAIL;
+    if (!st.up &&
+        !plan_add(plan, PLAN_UP, port_ifindex, n->id))
+        goto fail;
+
+    /* 3. VLANs, against the table the above leaves behind */
+    if (n->topo.vlans &&
+        !plan_add(plan, PLAN_VLAN_SYNC, port_ifindex, n->id))
+        goto fail;
+
+    return plan_done(n, first);
+
+fail:
+    plan->n = first;
+    return ACTION_FAIL;
+}
+
+/* ---- LOWERING ---- */
+
+static struct l2_vlan_set lower_vlans;
+
+static int link_create(struct kernel_nl_batch *b, const struct plan_op *op)
+{
+    switch (op->node->kind) {
+    case KIND_L2_BRIDGE:
+        return bridge_create(b, op);
+    case KIND_L2_VLAN_DOMAIN:
+        return vlan_create(b, op);
+    case KIND_LINK_VETH:
+        return veth_create(b, op);
+    case KIND_L2_BOND:
+        return bond_create(b, op);
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Lower the op at *i into b and step past it. A run of VLAN ops of the
+ * same kind on one port, up to end, becomes one set and is packed into
+ * as few messages as fit.
+ */
+static int lower_op(struct kernel_nl_batch *b, const struct plan *p,
+                    size_t *i, size_t end)
+{
+    const struct plan_op *op = &p->ops[(*i)++];
+
+    switch (op->type) {
+    case PLAN_NOP:
+    case PLAN_VLAN_SYNC:
+        return 0;
+
+    case PLAN_CREATE:
+        /* nobody wants a link for a node that is gone */
+        return op->node ? link_create(b, op) : 0;
+
+    case PLAN_MASTER:
+        return kernel_bridge_batch_add_port(b, op->arg, op->ifindex, NULL);
+
+    case PLAN_UP:
+    case PLAN_DOWN:
+        return kernel_link_batch_set_updown(b, op->ifindex,
+                                            op->type == PLAN_UP, NULL);
+
+    case PLAN_VLAN_DEL:
+    case PLAN_VLAN_ADD:
+        break;
+    }
+
+    l2_vlan_set_clear(&lower_vlans);
+    l2_vlan_set_add_range(&lower_vlans, op->first, op->last,
+                          op->tagged, op->pvid);
+
+    while (*i < end) {
+        const struct plan_op *next = &p->ops[*i];
+
+        if (next->type == PLAN_NOP) {
+            (*i)++;
+            continue;
+        }
+        if (next->type != op->type || next->ifindex != op->ifindex)
+            break;
+
+        l2_vlan_set_add_range(&lower_vlans, next->first, next->last,
+                              next->tagged, next->pvid);
+        (*i)++;
+    }
+
+    return op->type == PLAN_VLAN_ADD ?
+        kernel_bridge_batch_vlans(b, op->ifindex, &lower_vlans, NULL) :
+        kernel_bridge_batch_vlans_del(b, op->ifindex, &lower_vlans, NULL);
+}
+
+/*
+ * The dropped repeats among ops start..end of one owner's run become
+ * waits on what the kept ops were lowered to (lowered already: they
+ * come first in their group). false on allocation failure.
+ */
+static bool lower_waits(struct action_wave *w, const struct plan *p,
+                        size_t start, size_t end,
+                        int sync, bool merged)
+{
+    size_t head = w->waits_n;
+
+    for (size_t k = start; k < end; k++) {
+        const struct plan_op *op = &p->ops[k];
+
+        if (!op->dup)
+            continue;
+
+        struct action_wait *wt = wave_add_wait(w);
+        if (!wt) {
+            w->waits_n = head;
+            return false;
+        }
+
+        const struct action_span *s = &w->spans[op->dup - 1];
+        *wt = (struct action_wait){
+            .node = op->node, .gen = op->gen,
+            .first = s->first, .end = s->end,
+        };
+    }
+
+    if (w->waits_n > head) {
+        w->waits[head].n      = w->waits_n - head;
+        w->waits[head].sync   = sync;
+        w->waits[head].merged = merged;
+    }
+    return true;
+}
+
+/*
+ * Lower an optimized plan into w's batch, one owner's run at a time.
+ * With track, every message is attributed to its owner, dropped
+ * repeats wait for the op kept in their place, and owners whose run
+ * neither sends nor waits for anything (or cannot be built) complete
+ * right away.
+ */
+static void plan_lower(const struct plan *p, struct action_wave *w,
+                       bool track)
+{
+    struct kernel_nl_batch *b = &w->batch;
+    bool spans = track && wave_reserve_spans(w, p->n);
+
+    for (size_t i = 0; i < p->n; ) {
+        struct node *n   = p->ops[i].node;
+        unsigned int gen = p->ops[i].gen;
+        size_t start     = i;
+        size_t first     = b->n_ops;
+        size_t end       = i;
+        size_t wait      = w->waits_n;
+        int sync         = 0;
+        int r            = track && !spans ? -1 : 0;
+
+        while (end < p->n && p->ops[end].node == n && p->ops[end].gen == gen) {
+            if (p->ops[end].type == PLAN_VLAN_SYNC)
+                sync = p->ops[end].ifindex;
+            end++;
+        }
+
+        /* at most one message per op */
+        if (track && !wave_reserve(w, b->n_ops + (end - i)))
+            r = -1;
+
+        while (r >= 0 && i < end) {
+            size_t op = i, msgs = b->n_ops;
+
+            r = lower_op(b, p, &i, end);
+            for (size_t m = msgs; track && m < b->n_ops; m++)
+                w->refs[m] = (struct action_ref){
+                    .type    = p->ops[op].type,
+                    .ifindex = p->ops[op].ifindex,
+                    .arg     = p->ops[op].arg,
+                };
+            for (; spans && op < i; op++)
+                w->spans[op] = (struct action_span){ msgs, b->n_ops };
+        }
+        for (; spans && i < end; i++)
+            w->spans[i] = (struct action_span){ 0, 0 };
+        i = end;
+
+        if (!track)
+            continue;
+
+        if (n && r >= 0 &&
+            !lower_waits(w, p, start, end, sync, b->n_ops > first))
+            r = -1;
+
+        for (size_t k = first; k < b->n_ops; k++) {
+            w->refs[k].node = r < 0 ? NULL : n;
+            w->refs[k].gen  = gen;
+        }
+
+        if (!n)
+            continue;
+
+        if (r < 0) {
+            fprintf(stderr, "node '%s': cannot build kernel request\n",
+                    n->id);
+            complete(n, gen, ACTION_FAIL);
+        } else if (b->n_ops == first) {
+            if (w->waits_n > wait)
+                continue;   /* completes from its waits */
+            if (sync)
+                port_sync_add(n, gen, sync);
+            else
+                complete(n, gen, ACTION_OK);
+        } else {
+            w->refs[b->n_ops - 1].sync = sync;
+            if (w->waits_n > wait)
+                w->refs[b->n_ops - 1].wait = wait + 1;
+        }
+    }
+}
+
+/* ---- SUBMISSION ---- */
+
+/* an owner's waits, from the first: failed with the kept ops */
+static bool waits_failed(const struct action_wave *w, size_t head)
+{
+    for (size_t k = head; k < head + w->waits[head].n; k++) {
+        const struct action_wait *wt = &w->waits[k];
+
+        /* nothing was built for the kept op: its owner failed */
+        if (wt->first == wt->end)
+            return true;
+
+        for (size_t m = wt->first; m < wt->end; m++)
+            if (w->batch.ops[m].err)
+                return true;
+    }
+    return false;
+}
+
+static void finish(struct node *n, unsigned int gen, bool failed, int sync)
+{
+    if (failed)
+        complete(n, gen, ACTION_FAIL);
+    else if (sync)
+        port_sync_add(n, gen, sync);
+    else
+        complete(n, gen, ACTION_OK);
+}
+
+/*
+ * What an acked message changed is in the link cache before the
+ * kernel's event for it is read, so the optimizer of the next pass
+ * does not drop an op against stale admin state.
+ */
+static void note_acked(const struct action_ref *ref)
+{
+    switch (ref->type) {
+    case PLAN_UP:
+    case PLAN_DOWN:
+        kernel_cache_note_flags(ref->ifindex, IFF_UP,
+                                ref->type == PLAN_UP ? IFF_UP : 0);
+        break;
+    case PLAN_MASTER:
+        kernel_cache_note_master(ref->ifindex, ref->arg);
+        break;
+    default:
+        break;  /* a creation shows up with its event */
+    }
+}
+
+/*
+ * A wave's ACKs are in: complete each owner once, from its whole run
+ * and its waits.
+ */
+static void wave_done(struct action_wave *w)
+{
+    const struct kernel_nl_batch *b = &w->batch;
+
+    for (size_t i = 0; i < b->n_ops; ) {
+        const struct action_ref *ref = &w->refs[i];
+        size_t end = i + 1;
+        bool failed = false;
+
+        while (end < b->n_ops &&
+               w->refs[end].node == ref->node &&
+               w->refs[end].gen == ref->gen)
+            end++;
+
+        for (size_t k = i; k < end; k++) {
+            const struct kernel_nl_op *kop = &b->ops[k];
+
+            if (!kop->err) {
+                note_acked(&w->refs[k]);
+                continue;
+            }
+
+            failed = true;
+            if (ref->node)
+                fprintf(stderr, "node '%s': kernel: %s%s%s\n",
+                        ref->node->id,
+                        strerror(-kop->err),
+                        kop->msg[0] ? ": " : "",
+                        kop->msg);
+        }
+
+        const struct action_ref *last = &w->refs[end - 1];
+        if (last->wait && waits_failed(w, last->wait - 1))
+            failed = true;
+
+        if (ref->node)
+            finish(ref->node, ref->gen, failed, last->sync);
+
+        i = end;
+    }
+
+    /* owners that only waited */
+    for (size_t k = 0; k < w->waits_n; k += w->waits[k].n) {
+        const struct action_wait *wt = &w->waits[k];
+
+        if (!wt->merged && wt->node)
+            finish(wt->node, wt->gen, waits_failed(w, k), wt->sync);
     }
 
-    /* 3. Program VLANs (resolved intent) */
-    for (struct l2_vlan *v = n->topo.vlans; v; v = v->next) {
+    port_sync_run();
+}
 
-        /* Skip inherited-only entries if you ever add that flag */
-        /* if (v->inherited)
-            continue; */
+static void wave_ack(struct kernel_nl_batch *b, void *arg)
+{
+    struct action_wave *w = arg;
+
+    (void)b;
+    wave_unlink(w);
+    wave_done(w);
+    wave_put(w);
+}
+
+static void wave_fail(struct action_wave *w)
+{
+    for (size_t i = 0; i < w->batch.n_ops; i++) {
+        const struct action_ref *ref = &w->refs[i];
 
-        if (kernel_bridge_vlan_add(
-                br->id,
-                n->id,
-                v->vid,
-                v->tagged,
-                v->pvid) < 0)
-            return ACTION_FAIL;
+        if (ref->node && (i + 1 == w->batch.n_ops ||
+                          w->refs[i + 1].node != ref->node ||
+                          w->refs[i + 1].gen != ref->gen))
+            complete(ref->node, ref->gen, ACTION_FAIL);
     }
 
-    return ACTION_OK;
+    for (size_t k = 0; k < w->waits_n; k += w->waits[k].n) {
+        const struct action_wait *wt = &w->waits[k];
+
+        if (!wt->merged && wt->node)
+            complete(wt->node, wt->gen, ACTION_FAIL);
+    }
+}
+
+/* optimize and lower p into a new wave; p is emptied */
+static struct action_wave *plan_wave(struct plan *p)
+{
+    struct action_wave *w = wave_alloc();
+
+    if (!w) {
+        for (size_t i = 0; i < p->n; i++)
+            if (p->ops[i].node)
+                complete(p->ops[i].node, p->ops[i].gen, ACTION_FAIL);
+        plan_reset(p);
+        return NULL;
+    }
+
+    plan_optimize(p);
+    plan_lower(p, w, true);
+    plan_reset(p);
+
+    if (w->batch.n_ops == 0) {
+        /* waits on ops that were never built */
+        wave_fail(w);
+        wave_put(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+static void plan_submit(struct plan *p)
+{
+    struct action_wave *w = plan_wave(p);
+
+    if (!w)
+        return;
+
+    int r = kernel_nl_batch_submit(&w->batch, wave_ack, w);
+    if (r < 0) {
+        fprintf(stderr, "kernel: activation wave: %s\n", strerror(-r));
+        wave_fail(w);
+        wave_put(w);
+        return;
+    }
+
+    w->next = waves_inflight;
+    waves_inflight = w;
+}
+
+void action_flush(void)
+{
+    plan_submit(&pass_plan);
+
+    /* ports that only wait for their VLANs */
+    port_sync_run();
+}
+
+void action_flush_sync(void)
+{
+    struct action_wave *w = plan_wave(&pass_plan);
+
+    if (!w)
+        return;
+
+    int r = kernel_nl_batch_commit(&w->batch);
+    if (r < 0) {
+        fprintf(stderr, "kernel: teardown: %s\n", strerror(-r));
+        wave_fail(w);
+    } else {
+        if (r > 0)
+            fprintf(stderr, "kernel: teardown: %d of %zu requests failed\n",
+                    r, w->batch.n_ops);
+        wave_done(w);
+    }
+
+    wave_put(w);
+}
+
+/* ---- DRY RUN ---- */
+
+void action_plan_begin(struct plan *p)
+{
+    plan = p;
+}
+
+void action_plan_end(void)
+{
+    plan_optimize(plan);
+    plan = &pass_plan;
+}
+
+size_t action_plan_messages(const struct plan *p)
+{
+    struct action_wave *w = wave_alloc();
+
+    if (!w)
+        return 0;
+
+    plan_lower(p, w, false);
+
+    size_t n = w->batch.n_ops;
+    wave_put(w);
+    return n;
 }
 
 static const struct action_ops device_ops = {
     .activate = device_activate,
     .deactivate = device_deactivate,
+    .needs_link = true,
 };
 
 static const struct action_ops bridge_ops = {
@@ -112,12 +1188,23 @@ static const struct action_ops bridge_ops = {
 
 static const struct action_ops bond_ops = {
     .activate = bond_activate,
-    .deactivate = bond_deactivate,
+    .deactivate = device_deactivate,
+};
+
+static const struct action_ops vlan_ops = {
+    .activate = vlan_activate,
+    .deactivate = device_deactivate,
+};
+
+static const struct action_ops veth_ops = {
+    .activate = veth_activate,
+    .deactivate = device_deactivate,
 };
 
 static const struct action_ops bridge_port_ops = {
     .activate   = bridge_port_activate,
-    .deactivate = NULL,   /* kernel handles teardown */
+    .deactivate = device_deactivate,
+    .needs_link = true,
 };
 
 const struct action_ops *
@@ -138,6 +1225,12 @@ action_ops_for_kind(node_kind_t kind)
     case KIND_L2_BOND:
         return &bond_ops;
 
+    case KIND_L2_VLAN_DOMAIN:
+        return &vlan_ops;
+
+    case KIND_LINK_VETH:
+        return &veth_ops;
+
     default:
         return NULL;
     }
@@ -5,12 +5,56 @@
 typedef enum {
     ACTION_OK = 0,
     ACTION_FAIL,
+    ACTION_PENDING,     /* submitted; outcome via action_next_completion */
 } action_result_t;
 
 struct action_ops {
     action_result_t (*activate)(struct node *n);
     void (*deactivate)(struct node *n);
+    bool needs_link;    /* acts on an existing link: activation waits
+                           for its presence event */
 };
 
 /* Action dispatch */
-const struct action_ops *action_ops_for_kind(node_kind_t kind);
\ No newline at end of file
+const struct action_ops *action_ops_for_kind(node_kind_t kind);
+
+/*
+ * Pop the next finished asynchronous activation. gen is the node's
+ * act_gen at submission; the caller drops stale ones.
+ */
+bool action_next_completion(struct node **n,
+                            unsigned int *gen,
+                            action_result_t *res);
+
+/*
+ * Optimize the plan recorded by the last evaluation pass, lower it to
+ * one batch and submit it. graph_evaluate() calls this once the pass
+ * is over.
+ */
+void action_flush(void);
+
+/*
+ * Same, but wait for the kernel's answers before returning. Used for
+ * teardown, when nobody is left to collect completions.
+ */
+void action_flush_sync(void);
+
+/*
+ * Dry run: until action_plan_end(), activations record into p instead
+ * of the pass plan. action_plan_end() optimizes p; nothing is sent.
+ */
+struct plan;
+void action_plan_begin(struct plan *p);
+void action_plan_end(void);
+
+/* netlink messages an optimized plan lowers to */
+size_t action_plan_messages(const struct plan *p);
+
+/* Node is going away: drop its in-flight and queued completions */
+void action_forget(struct node *n);
+
+/* Same, for every node (graph flush / teardown) */
+void action_forget_all(void);
+
+/* Same, and free what the in-flight bookkeeping holds (graph destroy) */
+void action_release(void);
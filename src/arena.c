@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t              size;
+    size_t              used;
+    unsigned char       data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static struct arena_chunk *chunk_new(size_t size)
+{
+    struct arena_chunk *c = malloc(sizeof(*c) + size);
+    if (!c)
+        return NULL;
+
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void arena_init(struct arena *a, size_t chunk_size)
+{
+    a->head       = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_DEFAULT;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    struct arena_chunk *c = a->head;
+
+    size = align_up(size ? size : 1);
+
+    if (!c || c->size - c->used < size) {
+        if (size > a->chunk_size / 4) {
+            /*
+             * Large request: give it a chunk of its own and keep
+             * bumping from the current one.
+             */
+            struct arena_chunk *big = chunk_new(size);
+            if (!big)
+                return NULL;
+
+            if (c) {
+                big->next = c->next;
+                c->next = big;
+            } else {
+                a->head = big;
+            }
+            big->used = size;
+            memset(big->data, 0, size);
+            return big->data;
+        }
+
+        c = chunk_new(a->chunk_size);
+        if (!c)
+            return NULL;
+
+        c->next = a->head;
+        a->head = c;
+    }
+
+    void *p = c->data + c->used;
+    c->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *d = arena_alloc(a, len);
+
+    if (d)
+        memcpy(d, s, len);
+    return d;
+}
+
+void arena_reset(struct arena *a)
+{
+    struct arena_chunk *keep = NULL;
+    struct arena_chunk *c = a->head;
+
+    while (c) {
+        struct arena_chunk *next = c->next;
+
+        if (!keep && c->size == a->chunk_size) {
+            keep = c;
+            keep->used = 0;
+            keep->next = NULL;
+        } else {
+            free(c);
+        }
+        c = next;
+    }
+    a->head = keep;
+}
+
+void arena_release(struct arena *a)
+{
+    struct arena_chunk *c = a->head;
+
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = NULL;
+}
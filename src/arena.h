@@ -0,0 +1,37 @@
+#ifndef LNMGR_ARENA_H
+#define LNMGR_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump-pointer arena
+ *
+ * Objects that live as long as the loaded configuration (nodes, edges,
+ * ids, features, VLAN entries) are carved out of large chunks instead
+ * of being allocated one by one. Individual objects are never freed;
+ * the whole arena is rewound on reload and released on shutdown.
+ */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *head;   /* current chunk, bumped from */
+    size_t              chunk_size;
+};
+
+#define ARENA_CHUNK_DEFAULT  (64 * 1024)
+
+void arena_init(struct arena *a, size_t chunk_size);
+
+/* zeroed, suitably aligned; NULL on allocation failure */
+void *arena_alloc(struct arena *a, size_t size);
+
+char *arena_strdup(struct arena *a, const char *s);
+
+/* forget every object but keep one chunk for the next build */
+void arena_reset(struct arena *a);
+
+/* return all memory to the system */
+void arena_release(struct arena *a);
+
+#endif /* LNMGR_ARENA_H */
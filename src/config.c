@@ -16,10 +16,15 @@ static int jsoneq(const char *js, const jsmntok_t *t, const char *s)
             strncmp(js + t->start, s, n) == 0) ? 0 : -1;
 }
 
-static char *tok_strdup(const char *js, const jsmntok_t *t)
+/*
+ * Parse temporaries (strings, arrays, node_tmp) come from a scratch
+ * arena that lives for one config_load_file() call and is released
+ * in one go, whichever way the parse ends.
+ */
+static char *tok_strdup(struct arena *a, const char *js, const jsmntok_t *t)
 {
     size_t n = (size_t)(t->end - t->start);
-    char *s = calloc(1, n + 1);
+    char *s = arena_alloc(a, n + 1);
     if (!s)
         return NULL;
 
@@ -33,14 +38,17 @@ static int tok_int(const char *js, const jsmntok_t *t, int *out)
     if (t->type != JSMN_PRIMITIVE)
         return -1;
 
-    char *tmp = tok_strdup(js, t);
-    if (!tmp)
+    char tmp[32];
+    size_t n = (size_t)(t->end - t->start);
+    if (n == 0 || n >= sizeof(tmp))
         return -1;
 
+    memcpy(tmp, js + t->start, n);
+    tmp[n] = '\0';
+
     char *end = NULL;
     long v = strtol(tmp, &end, 10);
     int ok = (end && *end == '\0');
-    free(tmp);
     if (!ok)
         return -1;
     *out = (int)v;
@@ -108,23 +116,62 @@ static int parse_kind(const char *s,
     return 0;
 }
 
-static void node_tmp_free(struct node_tmp *n)
+/* IFLA_BOND_MODE values, indexed by mode */
+static const char *const bond_modes[] = {
+    "balance-rr", "active-backup", "balance-xor", "broadcast",
+    "802.3ad", "balance-tlb", "balance-alb",
+};
+
+static int parse_bond_object(const char *js, const jsmntok_t *toks, int *i,
+                             struct node_tmp *n)
 {
-    if (!n)
-        return;
-    free(n->id);
-    for (int i = 0; i < n->signals_n; i++)
-        free(n->signals[i]);
- 
-    free(n->signals);
-    for (int i = 0; i < n->requires_n; i++)
-        free(n->requires[i]);
+    const jsmntok_t *o = &toks[*i];
+    if (o->type != JSMN_OBJECT)
+        return -1;
+
+    int pairs = o->size;
+    int idx = *i + 1;
+
+    for (int p = 0; p < pairs; p++) {
+        const jsmntok_t *k = &toks[idx++];
+        const jsmntok_t *v = &toks[idx];
+
+        if (k->type != JSMN_STRING)
+            return -1;
+
+        if (jsoneq(js, k, "mode") == 0) {
+            if (v->type != JSMN_STRING)
+                return -1;
+
+            n->bond_mode = -1;
+            for (size_t m = 0; m < ARRAY_SIZE(bond_modes); m++)
+                if (jsoneq(js, v, bond_modes[m]) == 0)
+                    n->bond_mode = (int)m;
+            if (n->bond_mode < 0)
+                return -1;
+
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        if (jsoneq(js, k, "miimon") == 0) {
+            if (tok_int(js, v, &n->bond_miimon) < 0 || n->bond_miimon < 0)
+                return -1;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
 
-    free(n->requires);
-    memset(n, 0, sizeof(*n));
+        /* Unknown key: strict */
+        return -1;
+    }
+
+    n->have_bond = 1;
+    *i = idx;
+    return 0;
 }
 
-static int parse_string_array(const char *js, const jsmntok_t *toks, int *i,
+static int parse_string_array(struct arena *sa,
+                              const char *js, const jsmntok_t *toks, int *i,
                               char ***out, int *out_n)
 {
     const jsmntok_t *a = &toks[*i];
@@ -132,25 +179,19 @@ static int parse_string_array(const char *js, const jsmntok_t *toks, int *i,
         return -1;
 
     int n = a->size;
-    char **arr = calloc((size_t)n, sizeof(char *));
+    char **arr = arena_alloc(sa, (size_t)n * sizeof(char *));
     if (!arr)
         return -1;
 
     int idx = *i + 1;
     for (int k = 0; k < n; k++) {
-        if (toks[idx].type != JSMN_STRING) {
-            for (int x = 0; x < k; x++) free(arr[x]);
-                free(arr);
+        if (toks[idx].type != JSMN_STRING)
+            return -1;
 
+        arr[k] = tok_strdup(sa, js, &toks[idx]);
+        if (!arr[k])
             return -1;
-        }
-        arr[k] = tok_strdup(js, &toks[idx]);
-        if (!arr[k]) {
-            for (int x = 0; x < k; x++) free(arr[x]);
-                    free(arr);
- 
-                    return -1;
-        }
+
         idx = tok_skip(toks, idx);
     }
 
@@ -161,7 +202,192 @@ static int parse_string_array(const char *js, const jsmntok_t *toks, int *i,
     return 0;
 }
 
-static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
+/*
+ * VID spec: "100", "100-399" or a comma list of those ("1,10-20"),
+ * added to set as ranges. VIDs outside 1..4094 or already in set are
+ * rejected.
+ */
+static int parse_vid_spec(const char *spec, struct l2_vlan_set *set,
+                          bool tagged, bool pvid)
+{
+    const char *p = spec;
+
+    for (;;) {
+        char *end = NULL;
+        long first = strtol(p, &end, 10);
+        long last  = first;
+
+        if (end == p)
+            return -1;
+        p = end;
+
+        if (*p == '-') {
+            const char *q = p + 1;
+            last = strtol(q, &end, 10);
+            if (end == q)
+                return -1;
+            p = end;
+        }
+
+        if (first < L2_VID_MIN || last > L2_VID_MAX || first > last)
+            return -1;
+
+        for (long v = first; v <= last; v++)
+            if (l2_vlan_set_has(set, (uint16_t)v))
+                return -1;
+
+        if (l2_vlan_set_add_range(set, (uint16_t)first, (uint16_t)last,
+                                  tagged, pvid) < 0)
+            return -1;
+
+        if (*p == '\0')
+            return 0;
+        if (*p != ',')
+            return -1;
+        p++;
+    }
+}
+
+/* { "vid": N | "vids": "A-B", "tagged": bool, "pvid": bool } */
+static int parse_vlan_entry(struct arena *sa,
+                            const char *js, const jsmntok_t *toks, int *i,
+                            struct l2_vlan_set *set)
+{
+    const jsmntok_t *o = &toks[*i];
+    if (o->type != JSMN_OBJECT)
+        return -1;
+
+    char vidbuf[8];
+    char *spec = NULL;
+    int tagged = 0;
+    int pvid = 0;
+
+    int pairs = o->size;
+    int idx = *i + 1;
+
+    for (int p = 0; p < pairs; p++) {
+        const jsmntok_t *k = &toks[idx++];
+        const jsmntok_t *v = &toks[idx];
+
+        if (k->type != JSMN_STRING)
+            return -1;
+
+        if (jsoneq(js, k, "vid") == 0) {
+            int vid = 0;
+            if (spec)
+                return -1;
+            if (tok_int(js, v, &vid) < 0 || !l2_vid_valid((unsigned int)vid))
+                return -1;
+            snprintf(vidbuf, sizeof(vidbuf), "%d", vid);
+            spec = vidbuf;
+        } else if (jsoneq(js, k, "vids") == 0) {
+            if (spec || v->type != JSMN_STRING)
+                return -1;
+            spec = tok_strdup(sa, js, v);
+            if (!spec)
+                return -1;
+        } else if (jsoneq(js, k, "tagged") == 0) {
+            if (tok_bool(js, v, &tagged) < 0)
+                return -1;
+        } else if (jsoneq(js, k, "pvid") == 0) {
+            if (tok_bool(js, v, &pvid) < 0)
+                return -1;
+        } else {
+            return -1;
+        }
+
+        idx = tok_skip(toks, idx);
+    }
+
+    /* a pvid names one VLAN; add_range rejects it on a range */
+    if (!spec || parse_vid_spec(spec, set, tagged, pvid) < 0)
+        return -1;
+
+    *i = idx;
+    return 0;
+}
+
+static int parse_vlan_array(struct arena *sa,
+                            const char *js, const jsmntok_t *toks, int *i,
+                            struct l2_vlan_set **out)
+{
+    const jsmntok_t *a = &toks[*i];
+    if (a->type != JSMN_ARRAY || *out)
+        return -1;
+
+    struct l2_vlan_set *set = arena_alloc(sa, sizeof(*set));
+    if (!set)
+        return -1;
+
+    int n = a->size;
+    int idx = *i + 1;
+    for (int k = 0; k < n; k++) {
+        if (parse_vlan_entry(sa, js, toks, &idx, set) < 0)
+            return -1;
+    }
+
+    *out = set;
+    *i = idx;
+    return 0;
+}
+
+/* "bridge" and "bridge-port" sections; port == 1 for the latter */
+static int parse_bridge_object(struct arena *sa,
+                               const char *js, const jsmntok_t *toks, int *i,
+                               struct node_tmp *n, int port)
+{
+    const jsmntok_t *o = &toks[*i];
+    if (o->type != JSMN_OBJECT)
+        return -1;
+
+    int pairs = o->size;
+    int idx = *i + 1;
+
+    for (int p = 0; p < pairs; p++) {
+        const jsmntok_t *k = &toks[idx++];
+        const jsmntok_t *v = &toks[idx];
+
+        if (k->type != JSMN_STRING)
+            return -1;
+
+        if (jsoneq(js, k, "vlans") == 0) {
+            if (parse_vlan_array(sa, js, toks, &idx,
+                                 port ? &n->port_vlans
+                                      : &n->bridge_vlans) < 0)
+                return -1;
+            continue;
+        }
+
+        if (!port && jsoneq(js, k, "vlan_filtering") == 0) {
+            if (tok_bool(js, v, &n->vlan_filtering) < 0)
+                return -1;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        if (!port && jsoneq(js, k, "default_pvid") == 0) {
+            if (tok_int(js, v, &n->default_pvid) < 0 ||
+                !l2_vid_valid((unsigned int)n->default_pvid))
+                return -1;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        /* Unknown key: strict */
+        return -1;
+    }
+
+    if (port)
+        n->have_bridge_port = 1;
+    else
+        n->have_bridge = 1;
+
+    *i = idx;
+    return 0;
+}
+
+static int parse_node_object(struct arena *sa,
+                             const char *js, const jsmntok_t *toks, int *i,
                              struct node_tmp *out)
 {
     const jsmntok_t *o = &toks[*i];
@@ -171,6 +397,8 @@ static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
     struct node_tmp n = {0};
     n.enabled = 0;
     n.auto_up = 0;
+    n.vlan_filtering = -1;
+    n.bond_mode      = -1;
 
     int pairs = o->size;
     int idx = *i + 1;
@@ -179,44 +407,31 @@ static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
         const jsmntok_t *k = &toks[idx++];
         const jsmntok_t *v = &toks[idx];
 
-        if (k->type != JSMN_STRING) {
-                node_tmp_free(&n);
-                return -1;
-        }
+        if (k->type != JSMN_STRING)
+            return -1;
 
         if (jsoneq(js, k, "id") == 0) {
-            if (v->type != JSMN_STRING) {
-                node_tmp_free(&n);
+            if (v->type != JSMN_STRING)
                 return -1;
-            }
-            n.id = tok_strdup(js, v);
-            if (!n.id) {
-                node_tmp_free(&n);
+            n.id = tok_strdup(sa, js, v);
+            if (!n.id)
                 return -1;
-            }
             idx = tok_skip(toks, idx);
             continue;
         }
 
          if (jsoneq(js, k, "type") == 0) {
-            if (v->type != JSMN_STRING) {
-                node_tmp_free(&n);
+            if (v->type != JSMN_STRING)
                 return -1;
-            }
 
-            char *ts = tok_strdup(js, v);
-            if (!ts) {
-                node_tmp_free(&n);
+            char *ts = tok_strdup(sa, js, v);
+            if (!ts)
                 return -1;
-            }
 
             int rc = parse_kind(ts, &n.kind, &n.type);
-            free(ts);
 
-            if (rc < 0) {
-                node_tmp_free(&n);
+            if (rc < 0)
                 return -1;
-            }
 
             n.have_kind = 1;
 
@@ -226,10 +441,8 @@ static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
 
         if (jsoneq(js, k, "enabled") == 0) {
             int b = 0;
-            if (tok_bool(js, v, &b) < 0) {
-                node_tmp_free(&n);
+            if (tok_bool(js, v, &b) < 0)
                 return -1;
-            }
             n.enabled = b;
             idx = tok_skip(toks, idx);
             continue;
@@ -237,41 +450,82 @@ static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
 
         if (jsoneq(js, k, "auto") == 0) {
             int b = 0;
-            if (tok_bool(js, v, &b) < 0) {
-                node_tmp_free(&n);
+            if (tok_bool(js, v, &b) < 0)
                 return -1;
-            }
             n.auto_up = b;
             idx = tok_skip(toks, idx);
             continue;
         }
 
         if (jsoneq(js, k, "signals") == 0) {
-            if (parse_string_array(js, toks, &idx, &n.signals, &n.signals_n) < 0) {
-                node_tmp_free(&n);
+            if (parse_string_array(sa, js, toks, &idx, &n.signals, &n.signals_n) < 0)
                 return -1;
-            }
             continue;
         }
 
         if (jsoneq(js, k, "requires") == 0) {
-            if (parse_string_array(js, toks, &idx, &n.requires, &n.requires_n) < 0) {
-                node_tmp_free(&n);
+            if (parse_string_array(sa, js, toks, &idx, &n.requires, &n.requires_n) < 0)
+                return -1;
+            continue;
+        }
+
+        if (jsoneq(js, k, "master") == 0) {
+            if (v->type != JSMN_STRING)
+                return -1;
+            n.master_id = tok_strdup(sa, js, v);
+            if (!n.master_id)
+                return -1;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        if (jsoneq(js, k, "parent") == 0 || jsoneq(js, k, "peer") == 0) {
+            if (v->type != JSMN_STRING)
+                return -1;
+            char *s = tok_strdup(sa, js, v);
+            if (!s)
+                return -1;
+            if (jsoneq(js, k, "parent") == 0)
+                n.parent_id = s;
+            else
+                n.peer_id = s;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        if (jsoneq(js, k, "vid") == 0) {
+            if (tok_int(js, v, &n.vid) < 0 ||
+                !l2_vid_valid((unsigned int)n.vid))
+                return -1;
+            idx = tok_skip(toks, idx);
+            continue;
+        }
+
+        if (jsoneq(js, k, "bond") == 0) {
+            if (parse_bond_object(js, toks, &idx, &n) < 0)
+                return -1;
+            continue;
+        }
+
+        if (jsoneq(js, k, "bridge") == 0) {
+            if (parse_bridge_object(sa, js, toks, &idx, &n, 0) < 0)
+                return -1;
+            continue;
+        }
+
+        if (jsoneq(js, k, "bridge-port") == 0) {
+            if (parse_bridge_object(sa, js, toks, &idx, &n, 1) < 0)
                 return -1;
-            }
             continue;
         }
 
         /* Unknown key: strict */
-        node_tmp_free(&n);
         return -1;
     }
 
     /* required fields */
-    if (!n.id) {
-        node_tmp_free(&n);
+    if (!n.id)
         return -1;
-    }
     /* type must have been set by parse_type; default is 0 which equals NODE_DEVICE,
        so we must require explicit "type" to avoid silent surprises. */
     /* We detect it by requiring the "type" key to have been present; easiest is to
@@ -283,6 +537,131 @@ static int parse_node_object(const char *js, const jsmntok_t *toks, int *i,
     return 0;
 }
 
+/*
+ * Features are graph-owned: allocated from the graph arena and appended
+ * in a fixed order (master before bridge-port) so resolution sees the
+ * master pointer first.
+ */
+static void *attach_feature(struct graph *g, struct node *n,
+                            node_feature_type_t type, size_t size)
+{
+    struct node_feature *f = graph_alloc(g, size);
+    if (!f)
+        return NULL;
+
+    f->type = type;
+    f->data = f;
+
+    struct node_feature **pp = &n->features;
+    while (*pp)
+        pp = &(*pp)->next;
+    *pp = f;
+
+    return f;
+}
+
+static struct l2_vlan_set *vlan_set_copy(struct graph *g,
+                                         const struct l2_vlan_set *src)
+{
+    if (!src)
+        return NULL;
+
+    struct l2_vlan_set *set = graph_alloc(g, sizeof(*set));
+    if (set)
+        memcpy(set, src, sizeof(*set));
+    return set;
+}
+
+static int apply_features(struct graph *g, const struct node_tmp *t)
+{
+    struct node *n = t->gn;
+
+    if (t->master_id) {
+        struct feat_master *fm =
+            attach_feature(g, n, FEAT_MASTER, sizeof(*fm));
+        if (!fm)
+            return -1;
+        fm->master_id = graph_strdup(g, t->master_id);
+        if (!fm->master_id)
+            return -1;
+    }
+
+    /* bridge actions expect the feature even without a section */
+    if (t->have_bridge || t->kind == KIND_L2_BRIDGE) {
+        struct feat_bridge *fb =
+            attach_feature(g, n, FEAT_BRIDGE, sizeof(*fb));
+        if (!fb)
+            return -1;
+        fb->vlans = vlan_set_copy(g, t->bridge_vlans);
+        if (t->bridge_vlans && !fb->vlans)
+            return -1;
+        fb->vlan_filtering = t->vlan_filtering < 0 ? fb->vlans != NULL
+                                                   : t->vlan_filtering;
+        fb->default_pvid   = (uint16_t)t->default_pvid;
+    }
+
+    if (t->have_bridge_port) {
+        struct feat_bridge_port *bp =
+            attach_feature(g, n, FEAT_BRIDGE_PORT, sizeof(*bp));
+        if (!bp)
+            return -1;
+        bp->vlans = vlan_set_copy(g, t->port_vlans);
+        if (t->port_vlans && !bp->vlans)
+            return -1;
+    }
+
+    if (t->kind == KIND_L2_VLAN_DOMAIN) {
+        struct feat_vlan_domain *fv =
+            attach_feature(g, n, FEAT_VLAN_DOMAIN, sizeof(*fv));
+        if (!fv)
+            return -1;
+        fv->vid = (uint16_t)t->vid;   /* 0 is rejected by validation */
+        fv->parent_id = t->parent_id ? graph_strdup(g, t->parent_id) : NULL;
+        if (t->parent_id && !fv->parent_id)
+            return -1;
+    }
+
+    if (t->kind == KIND_LINK_VETH) {
+        struct feat_veth *fv = attach_feature(g, n, FEAT_VETH, sizeof(*fv));
+        if (!fv)
+            return -1;
+        fv->peer = t->peer_id ? graph_strdup(g, t->peer_id) : NULL;
+        if (t->peer_id && !fv->peer)
+            return -1;
+    }
+
+    if (t->have_bond || t->kind == KIND_L2_BOND) {
+        struct feat_bond *fb = attach_feature(g, n, FEAT_BOND, sizeof(*fb));
+        if (!fb)
+            return -1;
+        fb->mode   = t->bond_mode;
+        fb->miimon = (uint32_t)t->bond_miimon;
+    }
+
+    return 0;
+}
+
+/*
+ * Implicit ordering: a VLAN subinterface waits for its parent, and of
+ * two veth ends that are both nodes the higher id waits for the lower
+ * one, which creates the pair (see require_met in graph.c).
+ */
+static int apply_implicit_requires(struct graph *g, const struct node_tmp *t)
+{
+    if (t->kind == KIND_L2_VLAN_DOMAIN && t->parent_id &&
+        graph_find_node(g, t->parent_id))
+        return graph_add_require(g, t->id, t->parent_id);
+
+    if (t->kind == KIND_LINK_VETH && t->peer_id &&
+        strcmp(t->peer_id, t->id) < 0) {
+        struct node *peer = graph_find_node(g, t->peer_id);
+        if (peer && peer->kind == KIND_LINK_VETH)
+            return graph_add_require(g, t->id, t->peer_id);
+    }
+
+    return 0;
+}
+
 /* Read file into memory */
 static int read_whole_file(const char *path, char **out, size_t *out_len)
 {
@@ -332,18 +711,28 @@ int config_load_file(struct graph *g, const char *path)
     if (read_whole_file(path, &js, &len) < 0)
         return -1;
 
-    /* Token buffer: v1 keeps this fixed. Increase later if needed. */
-    enum { TOKMAX = 2048 };
-    jsmntok_t *toks = calloc(TOKMAX, sizeof(jsmntok_t));
+    /* size the token buffer with a counting pass: large configs are normal */
+    jsmn_parser p;
+    jsmn_init(&p);
+    int tokmax = jsmn_parse(&p, js, len, NULL, 0);
+    if (tokmax <= 0) {
+        free(js);
+        errno = EINVAL;
+        return -1;
+    }
+
+    jsmntok_t *toks = calloc((size_t)tokmax, sizeof(jsmntok_t));
     if (!toks) {
         free(js);
         errno = ENOMEM;
         return -1;
     }
 
-    jsmn_parser p;
+    struct arena scratch;
+    arena_init(&scratch, 16 * 1024);
+
     jsmn_init(&p);
-    int ntok = jsmn_parse(&p, js, len, toks, TOKMAX);
+    int ntok = jsmn_parse(&p, js, len, toks, (unsigned int)tokmax);
     if (ntok < 0) {
         free(toks); free(js);
         errno = EINVAL;
@@ -392,7 +781,7 @@ int config_load_file(struct graph *g, const char *path)
                 goto fail;
             int n = v->size;
 
-            nodes = calloc((size_t)n, sizeof(struct node_tmp));
+            nodes = arena_alloc(&scratch, (size_t)n * sizeof(struct node_tmp));
             if (!nodes)
                 goto fail;
 
@@ -400,7 +789,7 @@ int config_load_file(struct graph *g, const char *path)
             idx++; /* enter array */
 
             for (int i = 0; i < n; i++) {
-                if (parse_node_object(js, toks, &idx, &nodes[i]) < 0)
+                if (parse_node_object(&scratch, js, toks, &idx, &nodes[i]) < 0)
                     goto fail;
             }
             continue;
@@ -413,10 +802,8 @@ int config_load_file(struct graph *g, const char *path)
     if (version != 1)
         goto fail;
 
-    if (flush) {
-        /* You need to implement graph_flush(g) (Step 2 below) */
-        /* graph_flush(g); */
-    }
+    if (flush)
+        graph_flush(g);
 
     /* Apply in 3 phases so requires can refer to nodes defined later in file */
     for (int i = 0; i < nodes_n; i++) {
@@ -426,6 +813,9 @@ int config_load_file(struct graph *g, const char *path)
 
         /* stash pointer for later phases */
         nodes[i].gn = gn;
+
+        if (apply_features(g, &nodes[i]) < 0)
+            goto fail;
     }
  
     for (int i = 0; i < nodes_n; i++) {
@@ -440,6 +830,9 @@ int config_load_file(struct graph *g, const char *path)
             if (graph_add_require(g, nodes[i].id, nodes[i].requires[r]) < 0)
                 goto fail;
         }
+
+        if (apply_implicit_requires(g, &nodes[i]) < 0)
+            goto fail;
     }
 
     for (int i = 0; i < nodes_n; i++) {
@@ -452,22 +845,20 @@ int config_load_file(struct graph *g, const char *path)
                 goto fail;
         }
     }
- 
-    graph_evaluate(g);
 
-    for (int i = 0; i < nodes_n; i++)
-        node_tmp_free(&nodes[i]);
+    /*
+     * No evaluation here: the daemon evaluates once the topology is
+     * prepared and the kernel state is known, so boot does not write
+     * blind and then correct itself.
+     */
 
-    free(nodes);
+    arena_release(&scratch);
     free(toks);
     free(js);
     return 0;
 
 fail:
-    for (int i = 0; i < nodes_n; i++)
-        node_tmp_free(&nodes[i]);
-        
-    free(nodes);
+    arena_release(&scratch);
     free(toks);
     free(js);
     errno = EINVAL;
@@ -6,13 +6,6 @@
 
 #include "graph.h"
 
-struct l2_vlan_tmp {
-    uint16_t vid;
-    bool tagged;
-    bool pvid;
-    struct l2_vlan_tmp *next;
-};
-
 struct node_tmp {
     char *id;
     node_kind_t     kind;
@@ -27,11 +20,30 @@ struct node_tmp {
     char            **requires;
     int             requires_n;
 
-    /* NEW: topology */
-    char            *master_id; /* "bridge": "br-lan" */
+    /* topology */
+    char            *master_id; /* "master": "br-lan" */
+
+    /* "bridge": { "vlan_filtering": bool, "default_pvid": n, "vlans": [...] } */
+    int             have_bridge;
+    int             vlan_filtering;     /* -1: default */
+    int             default_pvid;       /* 0: kernel default */
+    struct l2_vlan_set *bridge_vlans;
+
+    /* "bridge-port": { "vlans": [...] } */
+    int             have_bridge_port;
+    struct l2_vlan_set *port_vlans;
+
+    /* type "vlan": "parent": "eth0", "vid": 100 */
+    char            *parent_id;
+    int             vid;
+
+    /* type "veth": "peer": "veth1" */
+    char            *peer_id;
 
-    /* NEW: VLAN intent */
-    struct l2_vlan_tmp *vlans;
+    /* "bond": { "mode": "802.3ad", "miimon": 100 } */
+    int             have_bond;
+    int             bond_mode;          /* -1: kernel default */
+    int             bond_miimon;
 
     struct node     *gn;
 };
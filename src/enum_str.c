@@ -36,7 +36,9 @@ const char *explain_type_to_str(explain_type_t e)
     case EXPLAIN_DISABLED: return "disabled";
     case EXPLAIN_BLOCKED:  return "blocked";
     case EXPLAIN_SIGNAL:   return "signal";
+    case EXPLAIN_PENDING:  return "pending";
     case EXPLAIN_FAILED:   return "failed";
+    case EXPLAIN_ABSENT:   return "absent";
     default:               return "unknown";
     }
 }
@@ -65,6 +67,8 @@ const char *lnmgr_code_to_str(lnmgr_code_t code)
     case LNMGR_CODE_BLOCKED:  return "blocked";
     case LNMGR_CODE_SIGNAL:   return "signal";
     case LNMGR_CODE_FAILED:   return "failed";
+    case LNMGR_CODE_PENDING:  return "pending";
+    case LNMGR_CODE_ABSENT:   return "absent";
     default:                  return NULL;
     }
 }
\ No newline at end of file
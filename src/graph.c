@@ -3,22 +3,16 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "graph.h"
 #include "actions.h"
 #include "enum_str.h"
 
 
-static struct signal *find_signal(struct node *n, const char *name)
-{
-    for (struct signal *s = n->signals; s; s = s->next) {
-        if (strcmp(s->name, name) == 0)
-            return s;
-    }
-    return NULL;
-}
-
-static struct node *node_create(const char *id, node_kind_t kind)
+static struct node *node_create(struct graph *g,
+                                const char *id,
+                                node_kind_t kind)
 {
     const struct node_kind_desc *kd;
     struct node *n;
@@ -27,11 +21,17 @@ static struct node *node_create(const char *id, node_kind_t kind)
     if (!kd)
         return NULL;
 
-    n = calloc(1, sizeof(*n));
-    if (!n)
-        return NULL;
+    if (g->free_nodes) {
+        n = g->free_nodes;
+        g->free_nodes = n->id_next;
+        memset(n, 0, sizeof(*n));
+    } else {
+        n = arena_alloc(&g->node_arena, sizeof(*n));
+        if (!n)
+            return NULL;
+    }
 
-    n->id        = strdup(id);
+    n->id        = arena_strdup(&g->arena, id);
     n->kind      = kind;
     n->type      = kd->type;
 
@@ -49,25 +49,33 @@ static struct node *node_create(const char *id, node_kind_t kind)
     return n;
 }
 
-static void node_destroy(struct node *n)
+static void edge_release(struct graph *g, struct require *e)
+{
+    e->next = g->free_edges;
+    g->free_edges = e;
+}
+
+static void edges_release(struct graph *g, struct require *r)
 {
-    struct require *r = n->requires;
     while (r) {
         struct require *tmp = r;
         r = r->next;
-        free(tmp);
+        edge_release(g, tmp);
     }
+}
 
-    struct signal *s = n->signals;
-    while (s) {
-        struct signal *tmp = s;
-        s = s->next;
-        free((char *)tmp->name);
-        free(tmp);
-    }
+/*
+ * Returns a node to the free list. Its id string stays in the arena
+ * until the next flush.
+ */
+static void node_destroy(struct graph *g, struct node *n)
+{
+    action_forget(n);
+    edges_release(g, n->requires);
+    edges_release(g, n->dependents);
 
-    free(n->id);
-    free(n);
+    n->id_next = g->free_nodes;
+    g->free_nodes = n;
 }
 
 /*
@@ -92,26 +100,420 @@ static void graph_error(struct graph *g,
 
 struct graph *graph_create(void)
 {
-    return calloc(1, sizeof(struct graph));
+    struct graph *g = calloc(1, sizeof(struct graph));
+    if (!g)
+        return NULL;
+
+    arena_init(&g->arena, ARENA_CHUNK_DEFAULT);
+    arena_init(&g->node_arena, ARENA_CHUNK_DEFAULT);
+    return g;
 }
 
 void graph_destroy(struct graph *g)
 {
-    struct node *n = g->nodes;
-    while (n) {
-        struct node *tmp = n;
-        n = n->next;
-        node_destroy(tmp);
-    }
+    action_release();
+    arena_release(&g->arena);
+    arena_release(&g->node_arena);
+    free(g->vec);
+    free(g->id_tab);
+    free(g->ifx_tab);
+    free(g->dirty);
+    free(g->order);
+    free(g->req_off);
+    free(g->req_idx);
+    free(g->dep_off);
+    free(g->dep_idx);
     free(g);
 }
 
+/*
+ * Node id index
+ *
+ * Every by-id lookup (signals, control socket, feature resolution)
+ * goes through this table, so it must stay O(1) for graphs with
+ * thousands of nodes.
+ */
+
+#define ID_TAB_MIN 64
+
+/* FNV-1a */
+static uint32_t id_hash(const char *id)
+{
+    uint32_t h = 2166136261u;
+
+    for (const unsigned char *p = (const unsigned char *)id; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct node **id_slot(struct graph *g, const char *id)
+{
+    return &g->id_tab[id_hash(id) & (g->id_size - 1)];
+}
+
+static int id_tab_grow(struct graph *g)
+{
+    size_t size = g->id_size ? g->id_size * 2 : ID_TAB_MIN;
+
+    struct node **tab = calloc(size, sizeof(*tab));
+    if (!tab)
+        return -1;
+
+    for (size_t i = 0; i < g->id_size; i++) {
+        struct node *n = g->id_tab[i];
+        while (n) {
+            struct node *next = n->id_next;
+            struct node **slot = &tab[id_hash(n->id) & (size - 1)];
+
+            n->id_next = *slot;
+            *slot = n;
+            n = next;
+        }
+    }
+
+    free(g->id_tab);
+    g->id_tab  = tab;
+    g->id_size = size;
+    return 0;
+}
+
+static int id_tab_insert(struct graph *g, struct node *n)
+{
+    /* keep load factor <= 1 */
+    if (g->count >= g->id_size && id_tab_grow(g) < 0)
+        return -1;
+
+    struct node **slot = id_slot(g, n->id);
+    n->id_next = *slot;
+    *slot = n;
+    return 0;
+}
+
+static void id_tab_remove(struct graph *g, struct node *n)
+{
+    for (struct node **pp = id_slot(g, n->id); *pp; pp = &(*pp)->id_next) {
+        if (*pp == n) {
+            *pp = n->id_next;
+            n->id_next = NULL;
+            return;
+        }
+    }
+}
+
+/*
+ * Kernel ifindex index
+ *
+ * Lets link producers resolve a node straight from ifi_index without
+ * parsing IFLA_IFNAME or asking the kernel. A node holds at most one
+ * binding; rebinding moves it (e.g. after a missed RTM_DELLINK).
+ */
+
+#define IFX_TAB_MIN 64
+
+static struct node **ifx_slot_in(struct node **tab, size_t size, int ifindex)
+{
+    /* Fibonacci hashing spreads sequential ifindexes */
+    return &tab[((uint32_t)ifindex * 2654435769u) & (size - 1)];
+}
+
+static int ifx_tab_grow(struct graph *g)
+{
+    size_t size = g->ifx_size ? g->ifx_size * 2 : IFX_TAB_MIN;
+
+    struct node **tab = calloc(size, sizeof(*tab));
+    if (!tab)
+        return -1;
+
+    for (size_t i = 0; i < g->ifx_size; i++) {
+        struct node *n = g->ifx_tab[i];
+        while (n) {
+            struct node *next = n->ifx_next;
+            struct node **slot = ifx_slot_in(tab, size, n->ifindex);
+
+            n->ifx_next = *slot;
+            *slot = n;
+            n = next;
+        }
+    }
+
+    free(g->ifx_tab);
+    g->ifx_tab  = tab;
+    g->ifx_size = size;
+    return 0;
+}
+
+struct node *graph_find_ifindex(struct graph *g, int ifindex)
+{
+    if (!g->ifx_size || ifindex <= 0)
+        return NULL;
+
+    for (struct node *n = *ifx_slot_in(g->ifx_tab, g->ifx_size, ifindex);
+         n; n = n->ifx_next) {
+        if (n->ifindex == ifindex)
+            return n;
+    }
+    return NULL;
+}
+
+void graph_unbind_ifindex(struct graph *g, struct node *n)
+{
+    if (n->ifindex <= 0)
+        return;
+
+    struct node **pp = ifx_slot_in(g->ifx_tab, g->ifx_size, n->ifindex);
+    for (; *pp; pp = &(*pp)->ifx_next) {
+        if (*pp == n) {
+            *pp = n->ifx_next;
+            g->ifx_count--;
+            g->links_gen++;
+            break;
+        }
+    }
+
+    n->ifx_next = NULL;
+    n->ifindex  = 0;
+}
+
+int graph_bind_ifindex(struct graph *g, struct node *n, int ifindex)
+{
+    if (ifindex <= 0)
+        return -1;
+
+    if (n->ifindex == ifindex)
+        return 0;
+
+    graph_unbind_ifindex(g, n);
+
+    /* ifindex now belongs to n, drop any stale owner */
+    struct node *old = graph_find_ifindex(g, ifindex);
+    if (old)
+        graph_unbind_ifindex(g, old);
+
+    if (g->ifx_count >= g->ifx_size && ifx_tab_grow(g) < 0)
+        return -1;
+
+    struct node **slot = ifx_slot_in(g->ifx_tab, g->ifx_size, ifindex);
+    n->ifindex  = ifindex;
+    n->ifx_next = *slot;
+    *slot = n;
+    g->ifx_count++;
+    g->links_gen++;
+    return 0;
+}
+
+/*
+ * Dirty set
+ *
+ * Evaluation only visits queued nodes. A node whose state moved since
+ * its last evaluation queues its dependents and slaves, so the work per
+ * event follows the affected cone of the graph, not its size.
+ *
+ * The set is a binary min-heap on topological rank: dependencies are
+ * always evaluated before their dependents, so one drain converges.
+ * Capacity tracks the node count (see graph_add_node), hence marking
+ * never allocates.
+ */
+static void dirty_place(struct graph *g, size_t i, struct node *n)
+{
+    g->dirty[i] = n;
+    n->dirty_pos = i;
+}
+
+static void dirty_up(struct graph *g, size_t i)
+{
+    struct node *n = g->dirty[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (g->dirty[parent]->rank <= n->rank)
+            break;
+        dirty_place(g, i, g->dirty[parent]);
+        i = parent;
+    }
+    dirty_place(g, i, n);
+}
+
+static void dirty_down(struct graph *g, size_t i)
+{
+    struct node *n = g->dirty[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= g->dirty_n)
+            break;
+        if (child + 1 < g->dirty_n &&
+            g->dirty[child + 1]->rank < g->dirty[child]->rank)
+            child++;
+        if (n->rank <= g->dirty[child]->rank)
+            break;
+        dirty_place(g, i, g->dirty[child]);
+        i = child;
+    }
+    dirty_place(g, i, n);
+}
+
+static int dirty_reserve(struct graph *g, size_t cap)
+{
+    if (cap <= g->dirty_cap)
+        return 0;
+
+    size_t ncap = g->dirty_cap ? g->dirty_cap * 2 : ID_TAB_MIN;
+    while (ncap < cap)
+        ncap *= 2;
+
+    struct node **d = realloc(g->dirty, ncap * sizeof(*d));
+    if (!d)
+        return -1;
+
+    g->dirty = d;
+    g->dirty_cap = ncap;
+    return 0;
+}
+
+void graph_mark_dirty(struct graph *g, struct node *n)
+{
+    if (n->dirty)
+        return;
+
+    n->dirty = true;
+    g->dirty[g->dirty_n] = n;
+    dirty_up(g, g->dirty_n++);
+}
+
+static struct node *dirty_pop(struct graph *g)
+{
+    if (!g->dirty_n)
+        return NULL;
+
+    struct node *n = g->dirty[0];
+
+    if (--g->dirty_n) {
+        dirty_place(g, 0, g->dirty[g->dirty_n]);
+        dirty_down(g, 0);
+    }
+
+    n->dirty = false;
+    return n;
+}
+
+static void dirty_remove(struct graph *g, struct node *n)
+{
+    if (!n->dirty)
+        return;
+
+    size_t i = n->dirty_pos;
+    n->dirty = false;
+
+    if (i == --g->dirty_n)
+        return;
+
+    struct node *moved = g->dirty[g->dirty_n];
+
+    dirty_place(g, i, moved);
+    dirty_up(g, i);
+    if (moved->dirty_pos == i)
+        dirty_down(g, i);
+}
+
+/* ranks changed: restore the heap invariant */
+static void dirty_reheap(struct graph *g)
+{
+    for (size_t i = g->dirty_n / 2; i-- > 0;)
+        dirty_down(g, i);
+}
+
+static void mark_dependents_dirty(struct graph *g, struct node *n)
+{
+    if (g->rank_valid) {
+        for (uint32_t e = g->dep_off[n->idx]; e < g->dep_off[n->idx + 1]; e++)
+            graph_mark_dirty(g, g->vec[g->dep_idx[e]]);
+        return;
+    }
+
+    for (struct require *d = n->dependents; d; d = d->next)
+        graph_mark_dirty(g, d->node);
+
+    for (struct node *s = n->topo.slaves; s; s = s->topo.slave_next)
+        graph_mark_dirty(g, s);
+}
+
+void *graph_alloc(struct graph *g, size_t size)
+{
+    return arena_alloc(&g->arena, size);
+}
+
+char *graph_strdup(struct graph *g, const char *s)
+{
+    return s ? arena_strdup(&g->arena, s) : NULL;
+}
+
+/*
+ * Edge lists (requires / dependents)
+ */
+static int edge_add(struct graph *g, struct require **list, struct node *to)
+{
+    struct require *e;
+
+    if (g->free_edges) {
+        e = g->free_edges;
+        g->free_edges = e->next;
+    } else {
+        e = arena_alloc(&g->arena, sizeof(*e));
+        if (!e)
+            return -1;
+    }
+
+    e->node = to;
+    e->next = *list;
+    *list = e;
+    return 0;
+}
+
+static void edge_del(struct graph *g, struct require **list, struct node *to)
+{
+    for (struct require **pp = list; *pp; pp = &(*pp)->next) {
+        if ((*pp)->node == to) {
+            struct require *victim = *pp;
+            *pp = victim->next;
+            edge_release(g, victim);
+            return;
+        }
+    }
+}
+
 /*
  * Node management
+ *
+ * graph->vec keeps every node at a dense index so whole-graph passes
+ * and the CSR adjacency can address nodes by number. Deletion moves
+ * the last node into the hole.
  */
+static int vec_reserve(struct graph *g, size_t cap)
+{
+    if (cap <= g->vec_cap)
+        return 0;
+
+    size_t ncap = g->vec_cap ? g->vec_cap * 2 : ID_TAB_MIN;
+    while (ncap < cap)
+        ncap *= 2;
+
+    struct node **v = realloc(g->vec, ncap * sizeof(*v));
+    if (!v)
+        return -1;
+
+    g->vec = v;
+    g->vec_cap = ncap;
+    return 0;
+}
+
 struct node *graph_find_node(struct graph *g, const char *id)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    if (!g->id_size || !id)
+        return NULL;
+
+    for (struct node *n = *id_slot(g, id); n; n = n->id_next) {
         if (strcmp(n->id, id) == 0)
             return n;
     }
@@ -129,28 +531,53 @@ struct node *graph_add_node(struct graph *g,
     if (!kd)
         return NULL;
 
-    struct node *n = node_create(id, kind);
+    struct node *n = node_create(g, id, kind);
     if (!n)
         return NULL;
 
-    n->next = g->nodes;
-    g->nodes = n;
+    if (!n->id || vec_reserve(g, g->count + 1) < 0 ||
+        dirty_reserve(g, g->count + 1) < 0 ||
+        id_tab_insert(g, n) < 0) {
+        node_destroy(g, n);
+        return NULL;
+    }
+
+    n->idx = (unsigned int)g->count;
+    g->vec[g->count++] = n;
+
+    g->links_gen++;
+    g->rank_valid = false;
+    graph_mark_dirty(g, n);
     return n;
 }
 
 int graph_del_node(struct graph *g, const char *id)
 {
-    struct node **pp = &g->nodes;
-    while (*pp) {
-        if (strcmp((*pp)->id, id) == 0) {
-            struct node *victim = *pp;
-            *pp = victim->next;
-            node_destroy(victim);
-            return 0;
-        }
-        pp = &(*pp)->next;
+    struct node *victim = graph_find_node(g, id);
+    if (!victim)
+        return -1;
+
+    struct node *last = g->vec[--g->count];
+    g->vec[victim->idx] = last;
+    last->idx = victim->idx;
+
+    id_tab_remove(g, victim);
+    graph_unbind_ifindex(g, victim);
+    dirty_remove(g, victim);
+    g->links_gen++;
+    g->rank_valid = false;
+
+    /* drop edges in both directions */
+    for (struct require *r = victim->requires; r; r = r->next)
+        edge_del(g, &r->node->dependents, victim);
+
+    for (struct require *d = victim->dependents; d; d = d->next) {
+        edge_del(g, &d->node->requires, victim);
+        graph_mark_dirty(g, d->node);
     }
-    return -1;
+
+    node_destroy(g, victim);
+    return 0;
 }
 
 int graph_add_signal(struct graph *g,
@@ -161,28 +588,71 @@ int graph_add_signal(struct graph *g,
     if (!n || !signal)
         return -1;
 
-    if (find_signal(n, signal))
-        return -1;  /* duplicate */
-
-    struct signal *s = calloc(1, sizeof(*s));
-    if (!s)
+    signal_atom_t a = signal_atom_intern(signal);
+    if (a == SIGNAL_ATOM_NONE)
         return -1;
 
-    s->name = strdup(signal);
-    s->value = false;
-    s->next = n->signals;
-    n->signals = s;
+    uint64_t bit = signal_atom_bit(a);
+    if (n->sig_mask & bit)
+        return -1;  /* duplicate */
 
+    n->sig_mask  |= bit;
+    n->sig_value &= ~bit;
+
+    graph_mark_dirty(g, n);
     return 0;
 }
 
 /*
- * Sets a signal value on a node.
+ * Sets a signal value on a node (pre-resolved form for producers).
+ * A signal the node did not carry yet becomes one of its signals.
  *
  * Returns:
  *   true  - signal value changed (new or updated)
  *   false - no change or error
  */
+bool graph_set_signal_atom(struct graph *g,
+                           struct node *n,
+                           signal_atom_t atom,
+                           bool value)
+{
+    if (!n || atom == SIGNAL_ATOM_NONE)
+        return false;
+
+    uint64_t bit = signal_atom_bit(atom);
+    uint64_t val = value ? bit : 0;
+
+    if ((n->sig_mask & bit) && (n->sig_value & bit) == val)
+        return false; /* no change */
+
+    n->sig_mask  |= bit;
+    n->sig_value  = (n->sig_value & ~bit) | val;
+
+    graph_mark_dirty(g, n);
+    return true;
+}
+
+bool graph_set_signal_atom_carried(struct graph *g,
+                                   struct node *n,
+                                   signal_atom_t atom,
+                                   bool value)
+{
+    if (!n || atom == SIGNAL_ATOM_NONE ||
+        !(n->sig_mask & signal_atom_bit(atom)))
+        return false;
+
+    return graph_set_signal_atom(g, n, atom, value);
+}
+
+bool graph_update_nodes(struct graph *g, graph_node_fn fn)
+{
+    bool changed = false;
+
+    for (size_t i = 0; i < g->count; i++)
+        changed |= fn(g, g->vec[i]);
+    return changed;
+}
+
 bool graph_set_signal(struct graph *g,
                       const char *node_id,
                       const char *signal,
@@ -192,46 +662,57 @@ bool graph_set_signal(struct graph *g,
     if (!n || !signal)
         return false;
 
-    struct signal *s = find_signal(n, signal);
-    if (!s) {
-        /* dynamic signal */
-        s = calloc(1, sizeof(*s));
-        if (!s)
-            return false;
+    return graph_set_signal_atom(g, n, signal_atom_intern(signal), value);
+}
 
-        s->name = strdup(signal);
-        if (!s->name) {
-            free(s);
-            return false;
-        }
+static int graph_rank(struct graph *g);
+static void node_disable(struct graph *g, struct node *n);
 
-        s->value = value;
-        s->next = n->signals;
-        n->signals = s;
-        return true; /* NEW signal => changed */
+/*
+ * Teardown runs in reverse rank order, so upper devices go down before
+ * the links they sit on, and every deactivation rides one batch that
+ * is committed before the nodes are released.
+ */
+int graph_flush(struct graph *g)
+{
+    if (!g->rank_valid)
+        graph_rank(g);
+
+    if (g->rank_valid) {
+        for (size_t i = g->order_n; i-- > 0; ) {
+            struct node *n = g->order[i];
+            if (n->enabled)
+                node_disable(g, n);
+        }
+    } else {
+        for (size_t i = 0; i < g->count; i++) {
+            struct node *n = g->vec[i];
+            if (n->enabled)
+                node_disable(g, n);
+        }
     }
 
-    if (s->value == value)
-        return false; /* no change */
+    action_flush_sync();
+    action_forget_all();
 
-    s->value = value;
-    return true;
-}
+    /* Nodes, edges, ids and features all live in the arenas */
+    g->free_nodes = NULL;
+    g->free_edges = NULL;
+    arena_reset(&g->arena);
+    arena_reset(&g->node_arena);
 
-int graph_flush(struct graph *g)
-{
-    /* Disable everything first (deactivate where appropriate) */
-    for (struct node *n = g->nodes; n; n = n->next) {
-        if (n->enabled)
-            graph_disable_node(g, n->id);
-    }
+    if (g->id_tab)
+        memset(g->id_tab, 0, g->id_size * sizeof(*g->id_tab));
 
-    /* Free all nodes (and attached requires/signals) */
-    while (g->nodes) {
-        struct node *n = g->nodes;
-        g->nodes = n->next;
-        node_destroy(n);
-    }
+    if (g->ifx_tab)
+        memset(g->ifx_tab, 0, g->ifx_size * sizeof(*g->ifx_tab));
+    g->ifx_count = 0;
+    g->links_gen++;
+
+    g->count      = 0;
+    g->dirty_n    = 0;
+    g->order_n    = 0;
+    g->rank_valid = false;
     return 0;
 }
 
@@ -249,13 +730,16 @@ int graph_add_require(struct graph *g,
     if (!n || !r)
         return -1;
 
-    struct require *req = calloc(1, sizeof(*req));
-    if (!req)
+    if (edge_add(g, &n->requires, r) < 0)
         return -1;
 
-    req->node = r;
-    req->next = n->requires;
-    n->requires = req;
+    if (edge_add(g, &r->dependents, n) < 0) {
+        edge_del(g, &n->requires, r);
+        return -1;
+    }
+
+    g->rank_valid = false;
+    graph_mark_dirty(g, n);
     return 0;
 }
 
@@ -272,7 +756,10 @@ int graph_del_require(struct graph *g,
         if (strcmp((*pp)->node->id, require_id) == 0) {
             struct require *victim = *pp;
             *pp = victim->next;
-            free(victim);
+            edge_del(g, &victim->node->dependents, n);
+            edge_release(g, victim);
+            g->rank_valid = false;
+            graph_mark_dirty(g, n);
             return 0;
         }
         pp = &(*pp)->next;
@@ -294,25 +781,39 @@ int graph_enable_node(struct graph *g, const char *id)
     if (n->state == NODE_INACTIVE)
         n->state = NODE_WAITING;
 
+    graph_mark_dirty(g, n);
     return 0;
 }
 
-int graph_disable_node(struct graph *g, const char *id)
+/*
+ * Whatever an activation of this lifecycle planned is torn down, also
+ * for a node that fell back to WAITING (a created link still waiting
+ * for carrier, or one whose signal dropped).
+ */
+static void node_disable(struct graph *g, struct node *n)
 {
-    struct node *n = graph_find_node(g, id);
-    if (!n)
-        return -1;
-
-    if (n->state == NODE_ACTIVE &&
+    if ((n->activated || n->activating) &&
         n->actions &&
         n->actions->deactivate) {
         n->actions->deactivate(n);
+        g->stats.deactivations++;
     }
 
     n->enabled = false;
     n->state = NODE_INACTIVE;
     n->activated = false;
+    n->activating = false;
+
+    graph_mark_dirty(g, n);
+}
 
+int graph_disable_node(struct graph *g, const char *id)
+{
+    struct node *n = graph_find_node(g, id);
+    if (!n)
+        return -1;
+
+    node_disable(g, n);
     return 0;
 }
 
@@ -325,7 +826,8 @@ static void node_topology_reset(struct node *n)
 
 static int graph_features_validate(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         for (struct node_feature *f = n->features; f; f = f->next) {
 
             const struct node_feature_ops *ops =
@@ -337,8 +839,9 @@ static int graph_features_validate(struct graph *g)
                 return -1;
             }
 
+            /* feature ops report a positive fail_reason_t */
             if (ops->validate) {
-                if (ops->validate(g, n, f) < 0)
+                if (ops->validate(g, n, f) != 0)
                     return -1;
             }
         }
@@ -348,7 +851,8 @@ static int graph_features_validate(struct graph *g)
 
 static int graph_features_resolve(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         for (struct node_feature *f = n->features; f; f = f->next) {
             const struct node_feature_ops *ops =
                 node_feature_ops_lookup(f->type);
@@ -356,7 +860,7 @@ static int graph_features_resolve(struct graph *g)
             if (!ops || !ops->resolve)
                 continue;
 
-            if (ops->resolve(g, n, f) < 0)
+            if (ops->resolve(g, n, f) != 0)
                 return -1;
         }
     }
@@ -365,7 +869,8 @@ static int graph_features_resolve(struct graph *g)
 
 static int graph_features_cap_check(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         for (struct node_feature *f = n->features; f; f = f->next) {
             const struct node_feature_ops *ops =
                 node_feature_ops_lookup(f->type);
@@ -380,90 +885,378 @@ static int graph_features_cap_check(struct graph *g)
     return 0;
 }
 
+/*
+ * Dependency ordering (Kahn)
+ *
+ * Edges are 'requires' plus slave → master. Nodes that cannot be
+ * ordered either sit on a cycle or only depend on one; the latter are
+ * peeled off from the sink side so that FAIL_CYCLE lands on cycle
+ * members alone. Every node gets a rank, cycle members last.
+ */
+
+#define RANK_NONE ((unsigned int)-1)
+
+static int csr_reserve(struct graph *g, size_t nodes, size_t edges)
+{
+    if (nodes + 1 > g->off_cap) {
+        size_t cap = nodes + 1;
+        uint32_t *ro = realloc(g->req_off, cap * sizeof(*ro));
+        if (!ro)
+            return -ENOMEM;
+        g->req_off = ro;
+
+        uint32_t *dof = realloc(g->dep_off, cap * sizeof(*dof));
+        if (!dof)
+            return -ENOMEM;
+        g->dep_off = dof;
+
+        g->off_cap = cap;
+    }
+
+    if (edges > g->idx_cap) {
+        uint32_t *ri = realloc(g->req_idx, edges * sizeof(*ri));
+        if (!ri)
+            return -ENOMEM;
+        g->req_idx = ri;
+
+        uint32_t *di = realloc(g->dep_idx, edges * sizeof(*di));
+        if (!di)
+            return -ENOMEM;
+        g->dep_idx = di;
+
+        g->idx_cap = edges;
+    }
+
+    return 0;
+}
+
+/*
+ * Flatten the edge lists into CSR arrays indexed by node->idx.
+ * Every require edge has a matching dependent and every slave has one
+ * master, so both sides need the same number of entries.
+ */
+static int graph_build_csr(struct graph *g)
+{
+    size_t edges = 0;
+
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+
+        for (struct require *q = n->requires; q; q = q->next)
+            edges++;
+        if (n->topo.master)
+            edges++;
+    }
+
+    int r = csr_reserve(g, g->count, edges);
+    if (r < 0)
+        return r;
+
+    uint32_t req = 0, dep = 0;
+
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+
+        g->req_off[i] = req;
+        for (struct require *q = n->requires; q; q = q->next)
+            g->req_idx[req++] = q->node->idx;
+
+        g->dep_off[i] = dep;
+        for (struct require *d = n->dependents; d; d = d->next)
+            g->dep_idx[dep++] = d->node->idx;
+        for (struct node *sl = n->topo.slaves; sl; sl = sl->topo.slave_next)
+            g->dep_idx[dep++] = sl->idx;
+    }
+    g->req_off[g->count] = req;
+    g->dep_off[g->count] = dep;
+
+    return 0;
+}
+
+static void rank_place(struct graph *g, struct node *n)
+{
+    n->rank = (unsigned int)g->order_n;
+    g->order[g->order_n++] = n;
+}
+
+static int graph_rank(struct graph *g)
+{
+    size_t head = 0;
+    int r = 0;
+
+    g->order_n = 0;
+    g->rank_valid = true;
+
+    if (!g->count)
+        return 0;
+
+    struct node **order = realloc(g->order, g->count * sizeof(*order));
+    if (!order || graph_build_csr(g) < 0) {
+        if (order)
+            g->order = order;
+        g->rank_valid = false;
+        return -ENOMEM;
+    }
+    g->order = order;
+
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        n->rank = RANK_NONE;
+        n->topo_deg = g->req_off[i + 1] - g->req_off[i] +
+                      (n->topo.master ? 1 : 0);
+    }
+
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        if (!n->topo_deg)
+            rank_place(g, n);
+    }
+
+    while (head < g->order_n) {
+        struct node *u = g->order[head++];
+
+        for (uint32_t e = g->dep_off[u->idx]; e < g->dep_off[u->idx + 1]; e++) {
+            struct node *d = g->vec[g->dep_idx[e]];
+            if (--d->topo_deg == 0)
+                rank_place(g, d);
+        }
+    }
+
+    if (g->order_n == g->count)
+        goto out;
+
+    /* ---------- leftovers: count edges towards other leftovers ---------- */
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        if (n->rank == RANK_NONE)
+            n->topo_deg = 0;
+    }
+
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        if (n->rank != RANK_NONE)
+            continue;
+        for (struct require *q = n->requires; q; q = q->next) {
+            if (q->node->rank == RANK_NONE)
+                q->node->topo_deg++;
+        }
+        if (n->topo.master && n->topo.master->rank == RANK_NONE)
+            n->topo.master->topo_deg++;
+    }
+
+    /* ---------- peel nodes downstream of a cycle ---------- */
+    head = g->order_n;
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        if (n->rank == RANK_NONE && !n->topo_deg)
+            rank_place(g, n);
+    }
+
+    while (head < g->order_n) {
+        struct node *u = g->order[head++];
+
+        for (struct require *q = u->requires; q; q = q->next) {
+            if (q->node->rank == RANK_NONE && --q->node->topo_deg == 0)
+                rank_place(g, q->node);
+        }
+        if (u->topo.master && u->topo.master->rank == RANK_NONE &&
+            --u->topo.master->topo_deg == 0)
+            rank_place(g, u->topo.master);
+    }
+
+    /* ---------- what is left is on a cycle ---------- */
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        if (n->rank != RANK_NONE)
+            continue;
+
+        graph_error(g, n, "dependency cycle");
+        n->fail_reason = FAIL_CYCLE;
+        n->state = NODE_FAILED;
+        rank_place(g, n);
+        graph_mark_dirty(g, n);
+        r = -ELOOP;
+    }
+
+out:
+    dirty_reheap(g);
+    return r;
+}
+
 /*
  * Evaluation logic
  *
  */
-static bool requirements_met(struct node *n)
+/*
+ * A requirement is met by an active node. The end of a veth pair that
+ * creates it is the exception: its carrier waits for the other end to
+ * come up, so the other end only needs it activated.
+ */
+static bool require_met(const struct node *n, const struct node *r)
 {
+    if (r->state == NODE_ACTIVE)
+        return true;
+
+    return r->activated &&
+           n->kind == KIND_LINK_VETH && r->kind == KIND_LINK_VETH;
+}
+
+static bool requirements_met(struct graph *g, struct node *n)
+{
+    /* a port cannot be enslaved before its master link exists */
+    if (n->topo.master && !n->topo.master->activated)
+        return false;
+
+    if (g->rank_valid) {
+        for (uint32_t e = g->req_off[n->idx]; e < g->req_off[n->idx + 1]; e++) {
+            if (!require_met(n, g->vec[g->req_idx[e]]))
+                return false;
+        }
+        return true;
+    }
+
     for (struct require *r = n->requires; r; r = r->next) {
-        if (r->node->state != NODE_ACTIVE)
+        if (!require_met(n, r->node))
             return false;
     }
     return true;
 }
 
-static bool signals_met(struct node *n)
+/* a node acting on an existing link waits for it to show up */
+static bool link_ready(const struct node *n)
 {
-    for (struct signal *s = n->signals; s; s = s->next) {
-        if (!s->value)
-            return false;
-    }
-    return true;
+    return n->present || !n->actions || !n->actions->needs_link;
 }
 
-static bool graph_activate_node(struct graph *g, struct node *n)
+static bool signals_met(struct node *n)
 {
-    (void)g;
+    return (n->sig_value & n->sig_mask) == n->sig_mask;
+}
 
+static action_result_t graph_activate_node(struct graph *g, struct node *n)
+{
     if (!n->actions || !n->actions->activate)
-        return true;
+        return ACTION_OK;
 
-    if (n->actions->activate(n) != ACTION_OK) {
-        n->state = NODE_FAILED;
-        n->fail_reason = FAIL_ACTION;
+    g->stats.activations++;
+    n->act_gen++;
+
+    action_result_t res = n->actions->activate(n);
+    if (res == ACTION_PENDING)
+        n->activating = true;
+
+    return res;
+}
+
+/*
+ * One node, to a local fixed point.
+ * Returns true if the node made progress (state or activation).
+ */
+static bool node_step(struct graph *g, struct node *n, bool *changed)
+{
+    if (!n->enabled)
         return false;
+
+    /* 1. Demotion on signal loss */
+    if (n->state == NODE_ACTIVE && !signals_met(n)) {
+        n->state = NODE_WAITING;
+        *changed = true;
+        return true;
     }
 
-    return true;
+    /* 2. Activation (side effects, ONCE per enable-cycle) */
+    if (n->state == NODE_WAITING &&
+        !n->activated &&
+        !n->activating &&
+        link_ready(n) &&
+        requirements_met(g, n)) {
+
+        switch (graph_activate_node(g, n)) {
+        case ACTION_OK:
+            n->activated = true;
+            mark_dependents_dirty(g, n);
+            return true;
+        case ACTION_PENDING:
+            return false;   /* resumed by graph_complete_actions() */
+        default:
+            n->state = NODE_FAILED;
+            n->fail_reason = FAIL_ACTION;
+            *changed = true;
+            return false;
+        }
+    }
+
+    /* 3. Readiness */
+    if (n->state == NODE_WAITING &&
+        n->activated &&
+        !n->activating &&
+        requirements_met(g, n) &&
+        signals_met(n)) {
+
+        n->state = NODE_ACTIVE;
+        *changed = true;
+        return true;
+    }
+
+    return false;
 }
 
+/*
+ * Drain the dirty set in rank order. A node whose state differs from
+ * the one seen by its last evaluation pulls its dependents and slaves
+ * into the set; they rank higher, so a single drain converges.
+ */
 bool graph_state_machine(struct graph *g)
 {
     bool changed = false;
-    bool progress;
+    struct node *n;
 
-    do {
-        progress = false;
+    if (!g->rank_valid)
+        graph_rank(g);
 
-        for (struct node *n = g->nodes; n; n = n->next) {
-            if (!n->enabled)
-                continue;
+    while ((n = dirty_pop(g))) {
+        while (node_step(g, n, &changed))
+            ;
 
-            /* 1. Demotion on signal loss */
-            if (n->state == NODE_ACTIVE && !signals_met(n)) {
-                n->state = NODE_WAITING;
-                changed = progress = true;
-                continue;
-            }
+        if (n->state != n->eval_state) {
+            n->eval_state = n->state;
+            mark_dependents_dirty(g, n);
+        }
+    }
 
-            /* 2. Activation (side effects, ONCE per enable-cycle) */
-            if (n->state == NODE_WAITING &&
-                requirements_met(n) &&
-                !n->activated) {
+    return changed;
+}
 
-                if (!graph_activate_node(g, n)) {
-                    n->state = NODE_FAILED;
-                    n->fail_reason = FAIL_ACTION;
-                    changed = true;
-                    continue;
-                }
+/*
+ * Completions are only trusted for the attempt that is still
+ * outstanding: a disable, presence edge or re-activation in between
+ * clears 'activating' or moves act_gen on, and the late result is
+ * dropped. Completed nodes are queued for the next evaluation.
+ */
+bool graph_complete_actions(struct graph *g)
+{
+    bool changed = false;
+    struct node *n;
+    unsigned int gen;
+    action_result_t res;
 
-                n->activated = true;
-                progress = true;
-            }
+    while (action_next_completion(&n, &gen, &res)) {
+        if (!n->activating || gen != n->act_gen)
+            continue;
 
-            /* 3. Readiness */
-            if (n->state == NODE_WAITING &&
-                requirements_met(n) &&
-                signals_met(n)) {
+        n->activating = false;
 
-                n->state = NODE_ACTIVE;
-                changed = progress = true;
-            }
+        if (res == ACTION_OK) {
+            n->activated = true;
+            mark_dependents_dirty(g, n);
+        } else {
+            n->state = NODE_FAILED;
+            n->fail_reason = FAIL_ACTION;
         }
 
-    } while (progress);
+        graph_mark_dirty(g, n);
+        changed = true;
+    }
 
     return changed;
 }
@@ -473,12 +1266,16 @@ bool graph_state_machine(struct graph *g)
  * - One-shot per kernel lifecycle
  * - No retries
  * - No admin override
+ *
+ * Every input of the auto-up condition marks the node dirty, so only
+ * queued nodes need to be looked at.
  */
 static bool graph_apply_auto_up(struct graph *g)
 {
     bool changed = false;
 
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->dirty_n; i++) {
+        struct node *n = g->dirty[i];
 
         if (!n->enabled)
             continue;
@@ -506,10 +1303,16 @@ static bool graph_apply_auto_up(struct graph *g)
     return changed;
 }
 
+/*
+ * 'activated' is deliberately left alone: it is memoized for the
+ * enable / presence lifecycle and only cleared on those edges
+ * (graph_disable_node, node_on_present, node_on_absent). Evaluation
+ * itself never re-runs kernel side effects.
+ */
 static void graph_runtime_reset(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
-        n->activated = false;
+    for (size_t i = 0; i < g->dirty_n; i++) {
+        struct node *n = g->dirty[i];
 
         if (!n->enabled)
             n->state = NODE_INACTIVE;
@@ -520,6 +1323,8 @@ bool graph_evaluate(struct graph *g)
 {
     bool changed = false;
 
+    g->stats.evaluations++;
+
     /* Phase A: reset transient runtime state */
     graph_runtime_reset(g);
 
@@ -529,9 +1334,42 @@ bool graph_evaluate(struct graph *g)
     /* Phase C: state machine + actions */
     changed |= graph_state_machine(g);
 
+    /* Phase D: one submission for everything planned in C */
+    action_flush();
+
+    /* owners whose plan optimized away are already complete */
+    while (graph_complete_actions(g)) {
+        changed |= graph_state_machine(g);
+        action_flush();
+    }
+
     return changed;
 }
 
+int graph_plan(struct graph *g, struct plan *p)
+{
+    if (!g->rank_valid)
+        graph_rank(g);
+    if (!g->rank_valid)
+        return -ENOMEM;
+
+    action_plan_begin(p);
+
+    for (size_t i = 0; i < g->order_n; i++) {
+        struct node *n = g->order[i];
+
+        if (!n->enabled || n->activated || n->activating ||
+            n->state == NODE_FAILED || !link_ready(n))
+            continue;
+
+        if (n->actions && n->actions->activate)
+            n->actions->activate(n);
+    }
+
+    action_plan_end();
+    return 0;
+}
+
 struct explain graph_explain_node(struct graph *g, const char *id)
 {
     struct explain e = { EXPLAIN_NONE, NULL };
@@ -552,22 +1390,33 @@ struct explain graph_explain_node(struct graph *g, const char *id)
 
     if (n->state == NODE_WAITING) {
 
+        /* 0. our own kernel writes are still in flight */
+        if (n->activating) {
+            e.type = EXPLAIN_PENDING;
+            return e;
+        }
+
         /* 1. dependencies first */
         for (struct require *r = n->requires; r; r = r->next) {
-            if (r->node->state != NODE_ACTIVE) {
+            if (!require_met(n, r->node)) {
                 e.type = EXPLAIN_BLOCKED;
                 e.detail = r->node->id;
                 return e;
             }
         }
 
-        /* 2. then signals */
-        for (struct signal *s = n->signals; s; s = s->next) {
-            if (!s->value) {
-                e.type = EXPLAIN_SIGNAL;
-                e.detail = s->name;
-                return e;
-            }
+        /* 2. then the link itself */
+        if (!link_ready(n)) {
+            e.type = EXPLAIN_ABSENT;
+            return e;
+        }
+
+        /* 3. then signals (lowest unmet atom) */
+        uint64_t unmet = n->sig_mask & ~n->sig_value;
+        if (unmet) {
+            e.type = EXPLAIN_SIGNAL;
+            e.detail = signal_atom_name(signal_atom_first(unmet));
+            return e;
         }
     }
 
@@ -583,17 +1432,14 @@ static int node_cmp_id(const void *a, const void *b)
 
 int graph_save_json(struct graph *g, int fd)
 {
-    size_t count = 0;
-    for (struct node *n = g->nodes; n; n = n->next)
-        count++;
+    size_t count = g->count;
+    size_t i;
 
-    struct node **arr = calloc(count, sizeof(*arr));
+    struct node **arr = calloc(count ? count : 1, sizeof(*arr));
     if (!arr)
         return -1;
 
-    size_t i = 0;
-    for (struct node *n = g->nodes; n; n = n->next)
-        arr[i++] = n;
+    memcpy(arr, g->vec, count * sizeof(*arr));
 
     qsort(arr, count, sizeof(*arr), node_cmp_id);
 
@@ -618,11 +1464,12 @@ int graph_save_json(struct graph *g, int fd)
         /* signals */
         dprintf(fd, ", \"signals\": [");
         bool sfirst = true;
-        for (struct signal *s = n->signals; s; s = s->next) {
+        for (uint64_t m = n->sig_mask; m; m &= m - 1) {
             if (!sfirst)
                 dprintf(fd, ",");
             sfirst = false;
-            dprintf(fd, "\"%s\"", s->name);
+            dprintf(fd, "\"%s\"",
+                    signal_atom_name(signal_atom_first(m)));
         }
         dprintf(fd, "]");
 
@@ -648,11 +1495,12 @@ int graph_save_json(struct graph *g, int fd)
 static int graph_build_topology(struct graph *g)
 {
     /* ---------- reset derived topology ---------- */
-    for (struct node *n = g->nodes; n; n = n->next)
-        node_topology_reset(n);
+    for (size_t i = 0; i < g->count; i++)
+        node_topology_reset(g->vec[i]);
 
     /* ---------- build master/slave relationships ---------- */
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
 
         struct feat_master *fm =
             (struct feat_master *)node_feature_find(n, FEAT_MASTER);
@@ -684,7 +1532,8 @@ static int graph_build_topology(struct graph *g)
 static int graph_validate_topology(struct graph *g)
 {
     /* ---------- basic topology sanity ---------- */
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
 
         /* A bridge must not have a master */
         if (n->topo.is_bridge && n->topo.master) {
@@ -712,7 +1561,8 @@ static int graph_validate_topology(struct graph *g)
     }
 
     /* ---------- detect master/slave cycles ---------- */
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         struct node *slow = n;
         struct node *fast = n;
 
@@ -732,95 +1582,60 @@ static int graph_validate_topology(struct graph *g)
     return 0;
 }
 
-static struct l2_vlan *
-vlan_find(struct l2_vlan *list, uint16_t vid)
-{
-    for (; list; list = list->next)
-        if (list->vid == vid)
-            return list;
-    return NULL;
-}
-
-static int
-vlan_inherit_from_bridge(struct node *port, struct node *bridge)
-{
-    for (struct l2_vlan *bv = bridge->topo.vlans; bv; bv = bv->next) {
-
-        if (vlan_find(port->topo.vlans, bv->vid))
-            continue;
-
-        struct l2_vlan *v = calloc(1, sizeof(*v));
-        if (!v)
-            return -ENOMEM;
-
-        *v = *bv;
-        v->pvid = false;
-        v->inherited = true;
-
-        v->next = port->topo.vlans;
-        port->topo.vlans = v;
-    }
-
-    return 0;
-}
-
+/*
+ * Port VLANs = bridge VLANs + port overrides.
+ *
+ * Inherited VLANs keep the bridge's tagging but never its pvid; VLANs
+ * named by the port override both. A port may not introduce a VLAN the
+ * bridge does not carry (a bridge without a VLAN set carries any).
+ */
 static int
-vlan_apply_port_overrides(struct node *port,
-                          struct feat_bridge_port *bp,
-                          struct node *bridge)
+vlan_merge_port(struct l2_vlan_set *res,
+                const struct l2_vlan_set *br,
+                const struct l2_vlan_set *pv)
 {
-    (void)bridge;
-    
-    for (struct l2_vlan *pv = bp->vlans; pv; pv = pv->next) {
+    if (br && pv && !l2_vlan_set_subset(pv, br))
+        return FAIL_TOPOLOGY;   /* port introduces unknown VLAN */
 
-        struct l2_vlan *v = vlan_find(port->topo.vlans, pv->vid);
-        if (!v)
-            return FAIL_TOPOLOGY;   /* port introduces unknown VLAN */
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++) {
+        uint64_t bm = br ? br->member[w] : 0;
+        uint64_t bt = br ? br->tagged[w] : 0;
+        uint64_t pm = pv ? pv->member[w] : 0;
 
-        v->tagged = pv->tagged;
-        v->pvid   = pv->pvid;
-        v->inherited = false;
+        res->member[w] = bm | pm;
+        res->tagged[w] = (bt & ~pm) | (pv ? pv->tagged[w] : 0);
+        res->pvid[w]   = pv ? pv->pvid[w] : 0;
     }
 
     return 0;
 }
 
 static int
-vlan_resolve_pvid(struct node *port)
+vlan_resolve_pvid(struct l2_vlan_set *res)
 {
-    struct l2_vlan *pvid = NULL;
-
-    for (struct l2_vlan *v = port->topo.vlans; v; v = v->next) {
-
-        if (v->tagged && v->pvid)
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++)
+        if (res->tagged[w] & res->pvid[w])
             return FAIL_TOPOLOGY;
 
-        if (v->pvid) {
-            if (pvid)
-                return FAIL_TOPOLOGY;
-            pvid = v;
-        }
-    }
-
-    if (!pvid) {
-        for (struct l2_vlan *v = port->topo.vlans; v; v = v->next) {
-            if (!v->tagged) {
-                v->pvid = true;
-                pvid = v;
-                break;
-            }
-        }
-    }
-
-    if (!pvid)
+    size_t npvid = l2_vlan_set_pvid_count(res);
+    if (npvid > 1)
         return FAIL_TOPOLOGY;
+    if (npvid == 1 || l2_vlan_set_count(res) == 0)
+        return 0;
+
+    /* default: lowest untagged VLAN; an all-tagged trunk has none */
+    uint16_t vid = l2_vlan_set_first_untagged(res);
+    if (!vid)
+        return 0;
 
+    res->pvid[vid / 64] |= (uint64_t)1 << (vid % 64);
     return 0;
 }
 
 static int graph_resolve_vlans(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
 
         if (!n->topo.is_bridge_port)
             continue;
@@ -829,18 +1644,30 @@ static int graph_resolve_vlans(struct graph *g)
         struct feat_bridge_port *bp =
             (struct feat_bridge_port *)node_feature_find(n, FEAT_BRIDGE_PORT);
 
-        int r;
+        if (!bp)
+            continue;
 
-        r = vlan_inherit_from_bridge(n, br);
-        if (r) return r;
+        /* no VLAN intent anywhere: membership is left to the kernel */
+        if (!br->topo.vlans && !bp->vlans) {
+            n->topo.vlans = NULL;
+            continue;
+        }
 
-        if (bp) {
-            r = vlan_apply_port_overrides(n, bp, br);
-            if (r) return r;
+        if (!bp->resolved) {
+            bp->resolved = graph_alloc(g, sizeof(*bp->resolved));
+            if (!bp->resolved)
+                return -ENOMEM;
         }
 
-        r = vlan_resolve_pvid(n);
+        int r;
+
+        r = vlan_merge_port(bp->resolved, br->topo.vlans, bp->vlans);
         if (r) return r;
+
+        r = vlan_resolve_pvid(bp->resolved);
+        if (r) return r;
+
+        n->topo.vlans = bp->resolved;
     }
 
     return 0;
@@ -853,10 +1680,13 @@ int graph_prepare(struct graph *g)
     /* --------------------------------------------------
      * Phase 0: reset derived / runtime state
      * -------------------------------------------------- */
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         n->fail_reason = FAIL_NONE;
         node_topology_reset(n);
+        graph_mark_dirty(g, n);
     }
+    g->rank_valid = false;
 
     /* --------------------------------------------------
      * Phase 1: feature-level validation (pure intent)
@@ -892,7 +1722,8 @@ int graph_prepare(struct graph *g)
      * -------------------------------------------------- */
     r = graph_validate_topology(g);
     if (r) {
-        for (struct node *n = g->nodes; n; n = n->next) {
+        for (size_t i = 0; i < g->count; i++) {
+            struct node *n = g->vec[i];
             if (n->fail_reason != FAIL_NONE)
                 n->state = NODE_FAILED;
         }
@@ -900,11 +1731,19 @@ int graph_prepare(struct graph *g)
     }
 
     /* --------------------------------------------------
-     * Phase 6: VLAN resolution (derived intent)
+     * Phase 6: dependency ordering (requires + master)
+     * -------------------------------------------------- */
+    r = graph_rank(g);
+    if (r)
+        return r;   /* cycle members are FAILED(CYCLE) */
+
+    /* --------------------------------------------------
+     * Phase 7: VLAN resolution (derived intent)
      * -------------------------------------------------- */
     r = graph_resolve_vlans(g);
     if (r) {
-        for (struct node *n = g->nodes; n; n = n->next) {
+        for (size_t i = 0; i < g->count; i++) {
+            struct node *n = g->vec[i];
             if (n->state != NODE_FAILED) {
                 n->state = NODE_FAILED;
                 n->fail_reason = FAIL_TOPOLOGY;
@@ -919,7 +1758,8 @@ int graph_prepare(struct graph *g)
 #ifdef LNMGR_DEBUG
 void graph_debug_dump(struct graph *g)
 {
-    for (struct node *n = g->nodes; n; n = n->next) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
         struct explain e = graph_explain_node(g, n->id);
 
         printf("graph: %s state=%d explain=%d",
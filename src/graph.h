@@ -3,9 +3,12 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "node.h"
 #include "actions.h"
+#include "signal_atom.h"
+#include "arena.h"
 
 #ifdef LNMGR_DEBUG
 #define DPRINTF(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
@@ -34,7 +37,9 @@ typedef enum {
     EXPLAIN_DISABLED,
     EXPLAIN_BLOCKED,
     EXPLAIN_SIGNAL,
-    EXPLAIN_FAILED
+    EXPLAIN_PENDING,    /* activation in flight */
+    EXPLAIN_FAILED,
+    EXPLAIN_ABSENT      /* waiting for the link it acts on */
 } explain_type_t;
 
 struct explain {
@@ -42,12 +47,6 @@ struct explain {
     const char *detail; /* blocking node id OR signal name */
 };
 
-struct signal {
-    const char *name;
-    bool value;
-    struct signal *next;
-};
-
 struct node;
 
 /*
@@ -62,42 +61,128 @@ struct require {
  * Graph node
  */ 
 struct node {
+    /*
+     * ---- hot: read or written on every evaluation ----
+     * Kept together at the front so the state machine, readiness
+     * checks and subscriber diffing stay within one cache line.
+     */
+    node_state_t        state;
+    node_state_t        eval_state;   /* state as of last evaluation */
+    fail_reason_t       fail_reason;
+    bool                enabled;
+    bool                auto_up;
+    bool                present;      /* kernel presence */
+    bool                auto_latched; /* auto-up already attempted this lifecycle */
+    bool                activated;
+    bool                activating;   /* activation submitted, not yet acked */
+    bool                dirty;        /* queued for evaluation */
+    unsigned int        idx;          /* slot in graph->vec */
+    unsigned int        rank;         /* topological rank (requires + master) */
+
+    /* signals, one bit per atom: carried / currently true */
+    uint64_t            sig_mask;
+    uint64_t            sig_value;
+
+    size_t              dirty_pos;    /* slot in the dirty heap */
+
+    /* ---- cold: identity, intent and topology ---- */
     char                *id;
     node_kind_t         kind;
     node_type_t         type;
     int                 have_kind;
-    bool                enabled;
- 
-    bool                auto_up;
-    bool present;        /* kernel presence */
-    bool auto_latched;   /* auto-up already attempted this lifecycle */
-    bool                activated;
+    int                 ifindex;      /* kernel ifindex, 0 = unbound */
+    unsigned int        act_gen;      /* bumped per activation attempt */
+    unsigned int        topo_deg;     /* scratch for graph ranking */
 
-    struct signal       *signals;
+    /* editable edge lists; evaluation walks the CSR copy in the graph */
     struct require      *requires;
+    struct require      *dependents;  /* reverse of requires */
     struct node_feature *features;
 
-    node_state_t        state;
     const struct action_ops *actions;
-    fail_reason_t       fail_reason;
 
     /* ---- derived topology (single source of truth) ---- */
     struct node_topology topo;
 
-    struct node         *next;
+    struct node         *id_next;   /* id hash chain, free list when dead */
+    struct node         *ifx_next;  /* ifindex hash chain */
+};
+
+/*
+ * Evaluation counters, reported by the STATS command
+ */
+struct graph_stats {
+    uint64_t evaluations;    /* graph_evaluate() passes */
+    uint64_t activations;    /* activate() side effects run */
+    uint64_t deactivations;  /* deactivate() side effects run */
 };
 
 /*
  * Graph container
  */
 struct graph {
-    struct node *nodes;
+    /* all nodes, densely indexed by node->idx (order is not meaningful) */
+    struct node **vec;
+    size_t       vec_cap;
+
+    /*
+     * Backing store for edges, ids, features and VLAN entries; nodes
+     * get an arena of their own so they pack tightly. Nodes and edges
+     * dropped at runtime are recycled through the free lists;
+     * everything else is reclaimed by graph_flush().
+     */
+    struct arena    arena;
+    struct arena    node_arena;
+    struct node    *free_nodes;
+    struct require *free_edges;
+
+    /* id → node index (power-of-two buckets, chained via id_next) */
+    struct node **id_tab;
+    size_t       id_size;
+    size_t       count;
+
+    /* ifindex → node index, filled by link producers */
+    struct node **ifx_tab;
+    size_t       ifx_size;
+    size_t       ifx_count;
+
+    /* bumped whenever the node ids or ifindex bindings change */
+    unsigned int links_gen;
+
+    /* nodes awaiting evaluation (min-heap on rank) */
+    struct node **dirty;
+    size_t       dirty_n;
+    size_t       dirty_cap;
+
+    /* topological order of all nodes, dependencies first */
+    struct node **order;
+    size_t       order_n;
+    bool         rank_valid;
+
+    /*
+     * Adjacency in CSR form, indexed by node->idx and rebuilt with the
+     * ranking. The edges of vec[i] are idx[off[i]] .. idx[off[i + 1] - 1].
+     * dep_* covers dependents and bridge/bond slaves, i.e. everything
+     * that has to be re-evaluated when vec[i] changes state.
+     */
+    uint32_t    *req_off;
+    uint32_t    *req_idx;
+    uint32_t    *dep_off;
+    uint32_t    *dep_idx;
+    size_t       off_cap;
+    size_t       idx_cap;
+
+    struct graph_stats stats;
 };
 
 /* graph lifecycle */
 struct graph *graph_create(void);
 void graph_destroy(struct graph *g);
 
+/* configuration-lifetime allocations, released by graph_flush() */
+void *graph_alloc(struct graph *g, size_t size);
+char *graph_strdup(struct graph *g, const char *s);
+
 /* node management */
 struct node *graph_add_node(struct graph *g,
                             const char *id,
@@ -107,6 +192,11 @@ int graph_del_node(struct graph *g, const char *id);
 
 struct node *graph_find_node(struct graph *g, const char *id);
 
+/* kernel ifindex binding (RTM_NEWLINK / RTM_DELLINK) */
+struct node *graph_find_ifindex(struct graph *g, int ifindex);
+int graph_bind_ifindex(struct graph *g, struct node *n, int ifindex);
+void graph_unbind_ifindex(struct graph *g, struct node *n);
+
 /* dependencies */
 int graph_add_require(struct graph *g,
                       const char *node_id,
@@ -122,10 +212,24 @@ int graph_disable_node(struct graph *g, const char *id);
 
 int graph_prepare(struct graph *g);
 
+/* queue a node for the next evaluation */
+void graph_mark_dirty(struct graph *g, struct node *n);
+
 bool graph_state_machine(struct graph *g);
 
 bool graph_evaluate(struct graph *g);
 
+/* fold finished asynchronous activations back into node state */
+bool graph_complete_actions(struct graph *g);
+
+/*
+ * Dry run: the optimized plan of kernel operations that activating
+ * every enabled node still waiting for its activation would send.
+ * Nothing is sent and no node state changes.
+ */
+struct plan;
+int graph_plan(struct graph *g, struct plan *p);
+
 struct explain graph_explain_node(struct graph *g, const char *id);
 
 int graph_add_signal(struct graph *g,
@@ -137,6 +241,25 @@ bool graph_set_signal(struct graph *g,
                      const char *signal,
                      bool value);
 
+/* producer hot path: no lookup, no string work */
+bool graph_set_signal_atom(struct graph *g,
+                           struct node *n,
+                           signal_atom_t atom,
+                           bool value);
+
+/*
+ * Same, but only on a node that already carries atom (config
+ * "signals"): for producers whose signals are opt-in per node.
+ */
+bool graph_set_signal_atom_carried(struct graph *g,
+                                   struct node *n,
+                                   signal_atom_t atom,
+                                   bool value);
+
+/* run fn on every node; true if any run changed something */
+typedef bool (*graph_node_fn)(struct graph *g, struct node *n);
+bool graph_update_nodes(struct graph *g, graph_node_fn fn);
+
 int graph_flush(struct graph *g);
 
 int graph_save_json(struct graph *g, int fd);
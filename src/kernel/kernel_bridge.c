@@ -1,370 +1,401 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <net/if.h>
 
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/if_bridge.h>   /* struct bridge_vlan_info + flags */
 #include <linux/if_link.h>     /* IFLA_* */
-#include <unistd.h>
 
 #include "kernel_bridge.h"
-#include "kernel_link.h"
-
-static int rtnl_simple_link_op(struct nlmsghdr *nh)
-{
-    struct sockaddr_nl sa = {
-        .nl_family = AF_NETLINK,
-    };
-
-    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-    if (fd < 0)
-        return -1;
-
-    if (sendto(fd, nh, nh->nlmsg_len, 0,
-               (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-        close(fd);
-        return -1;
-    }
+#include "kernel_nl.h"
+#include "kernel_cache.h"
+#include "l2.h"
 
-    char buf[4096];
-    if (recv(fd, buf, sizeof(buf), 0) < 0) {
-        close(fd);
-        return -1;
-    }
+/* ------------------------------------------------------------ */
+/* bridge lifecycle */
 
-    close(fd);
+/*
+ * RTM_NEWLINK for a bridge by name: IFLA_INFO_DATA carries opts and
+ * IFF_UP rides along in the same message. Kernels built without VLAN
+ * filtering reject IFLA_BR_VLAN_FILTERING even when it is 0, so it is
+ * only sent when filtering says so.
+ */
+static int build_bridge_link(struct kernel_nl_req *req,
+                             const char *br,
+                             uint16_t flags,
+                             const struct kernel_bridge_opts *opts,
+                             bool filtering)
+{
+    struct ifinfomsg *ifm =
+        kernel_nl_init(req, RTM_NEWLINK, flags, sizeof(*ifm));
+    ifm->ifi_family = AF_UNSPEC;
+    ifm->ifi_flags  = IFF_UP;
+    ifm->ifi_change = IFF_UP;
+
+    if (!kernel_nl_put_str(req, IFLA_IFNAME, br))
+        return -ENAMETOOLONG;
+
+    struct rtattr *li = kernel_nl_nest(req, IFLA_LINKINFO);
+    if (!li || !kernel_nl_put_str(req, IFLA_INFO_KIND, "bridge"))
+        return -ENOBUFS;
+
+    struct rtattr *data = kernel_nl_nest(req, IFLA_INFO_DATA);
+    if (!data)
+        return -ENOBUFS;
+
+    if (filtering &&
+        !kernel_nl_put_u8(req, IFLA_BR_VLAN_FILTERING,
+                          opts->vlan_filtering ? 1 : 0))
+        return -ENOBUFS;
+
+    if (opts->default_pvid &&
+        !kernel_nl_put_u16(req, IFLA_BR_VLAN_DEFAULT_PVID,
+                           opts->default_pvid))
+        return -ENOBUFS;
+
+    kernel_nl_nest_end(req, data);
+    kernel_nl_nest_end(req, li);
     return 0;
 }
 
-/* ------------------------------------------------------------ */
-/* bridge lifecycle */
+bool kernel_bridge_matches(const char *br,
+                           const struct kernel_bridge_opts *opts)
+{
+    const struct kernel_link_info *l = kernel_cache_find_name(br);
+
+    if (!l || strcmp(l->kind, "bridge") != 0 || !(l->flags & IFF_UP))
+        return false;
+
+    /* not reported: the kernel has no VLAN filtering, so it is off */
+    if ((l->br_vlan_filtering > 0) != opts->vlan_filtering)
+        return false;
+
+    return !opts->default_pvid || l->br_default_pvid == opts->default_pvid;
+}
 
-int kernel_bridge_create(const char *br)
+int kernel_bridge_batch_ensure(struct kernel_nl_batch *b,
+                               const char *br,
+                               const struct kernel_bridge_opts *opts,
+                               void *ctx)
 {
-    if (kernel_link_exists(br))
-        return 0;
+    struct kernel_nl_req req;
+    const struct kernel_link_info *l = kernel_cache_find_name(br);
+
+    /* filtering off is the default: only say so to a bridge that has it */
+    bool filtering = opts->vlan_filtering ||
+                     (l && l->br_vlan_filtering > 0);
 
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-        char buf[256];
-    } req = {0};
+    /* no NLM_F_EXCL: an existing bridge is updated in place */
+    int r = build_bridge_link(&req, br, NLM_F_CREATE, opts, filtering);
+    if (r < 0)
+        return r;
 
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-    req.nh.nlmsg_type  = RTM_NEWLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+    return kernel_nl_batch_add(b, &req, ctx);
+}
+
+/* ------------------------------------------------------------ */
+/* ports */
 
-    req.ifm.ifi_family = AF_UNSPEC;
+static int build_set_master(struct kernel_nl_req *req, int ifindex, int master)
+{
+    struct ifinfomsg *ifm =
+        kernel_nl_init(req, RTM_SETLINK, 0, sizeof(*ifm));
+    ifm->ifi_index = ifindex;
 
-    struct rtattr *rta;
+    if (!kernel_nl_put_u32(req, IFLA_MASTER, (uint32_t)master))
+        return -ENOBUFS;
 
-    rta = (struct rtattr *)req.buf;
-    rta->rta_type = IFLA_IFNAME;
-    rta->rta_len  = RTA_LENGTH(strlen(br) + 1);
-    strcpy(RTA_DATA(rta), br);
+    return 0;
+}
 
-    req.nh.nlmsg_len += rta->rta_len;
+ /* For bridge VLAN ops:
+ *  - add uses RTM_SETLINK
+ *  - del uses RTM_DELLINK
+ * Payload: IFLA_AF_SPEC { IFLA_BRIDGE_VLAN_INFO = struct bridge_vlan_info }
+ *
+ * One AF_SPEC may carry several VLAN_INFO entries; a run of VIDs is a
+ * RANGE_BEGIN/RANGE_END pair with identical flags.
+ */
+static struct rtattr *vlan_req_begin(struct kernel_nl_req *req,
+                                     int ifindex,
+                                     bool add)
+{
+    struct ifinfomsg *ifm = kernel_nl_init(req,
+                                           add ? RTM_SETLINK : RTM_DELLINK,
+                                           0, sizeof(*ifm));
+    ifm->ifi_family = AF_BRIDGE;   /* bridge VLAN ops, not a link op */
+    ifm->ifi_index  = ifindex;
 
-    rta = (struct rtattr *)((char *)rta + rta->rta_len);
-    rta->rta_type = IFLA_LINKINFO;
-    rta->rta_len  = RTA_LENGTH(0);
+    /* Outer: IFLA_AF_SPEC (nested) */
+    return kernel_nl_nest(req, IFLA_AF_SPEC);
+}
 
-    struct rtattr *kind =
-        (struct rtattr *)((char *)rta + RTA_LENGTH(0));
-    kind->rta_type = IFLA_INFO_KIND;
-    kind->rta_len  = RTA_LENGTH(strlen("bridge") + 1);
-    strcpy(RTA_DATA(kind), "bridge");
+/*
+ * Flags meaning:
+ *  - MASTER: also operate on the bridge device (when dev is a port)
+ *  - UNTAGGED: egress untagged
+ *  - PVID: ingress default VLAN (must not be set with tagged)
+ *
+ * For DEL, the kernel only needs vid (+ MASTER if you want br_vlan_delete too).
+ * Keeping UNTAGGED/PVID off for DEL is safest.
+ */
+static uint16_t vlan_flags(bool tagged, bool pvid, bool master_too, bool add)
+{
+    uint16_t flags = 0;
 
-    rta->rta_len += kind->rta_len;
-    req.nh.nlmsg_len += rta->rta_len;
+    if (master_too)
+        flags |= BRIDGE_VLAN_INFO_MASTER;
+    if (add && !tagged)
+        flags |= BRIDGE_VLAN_INFO_UNTAGGED;
+    if (add && pvid)
+        flags |= BRIDGE_VLAN_INFO_PVID;
 
-    return rtnl_simple_link_op(&req.nh);
+    return flags;
 }
 
-int kernel_bridge_delete(const char *br)
+/* Inner: IFLA_BRIDGE_VLAN_INFO (binary); all or nothing */
+static int vlan_info_put(struct kernel_nl_req *req,
+                         uint16_t first,
+                         uint16_t last,
+                         uint16_t flags)
 {
-    if (!kernel_link_exists(br))
-        return 0;
+    uint32_t mark = req->nh.nlmsg_len;
+    struct bridge_vlan_info vinfo;
 
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-        char buf[128];
-    } req = {0};
+    memset(&vinfo, 0, sizeof(vinfo));
+    vinfo.vid   = first;
+    vinfo.flags = flags;
 
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-    req.nh.nlmsg_type  = RTM_DELLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (first == last) {
+        if (!kernel_nl_put(req, IFLA_BRIDGE_VLAN_INFO,
+                           &vinfo, sizeof(vinfo)))
+            return -ENOBUFS;
+        return 0;
+    }
 
-    struct rtattr *rta = (struct rtattr *)req.buf;
-    rta->rta_type = IFLA_IFNAME;
-    rta->rta_len  = RTA_LENGTH(strlen(br) + 1);
-    strcpy(RTA_DATA(rta), br);
+    vinfo.flags = flags | BRIDGE_VLAN_INFO_RANGE_BEGIN;
+    if (!kernel_nl_put(req, IFLA_BRIDGE_VLAN_INFO, &vinfo, sizeof(vinfo)))
+        return -ENOBUFS;
 
-    req.nh.nlmsg_len += rta->rta_len;
+    vinfo.vid   = last;
+    vinfo.flags = flags | BRIDGE_VLAN_INFO_RANGE_END;
+    if (!kernel_nl_put(req, IFLA_BRIDGE_VLAN_INFO, &vinfo, sizeof(vinfo))) {
+        req->nh.nlmsg_len = mark;
+        return -ENOBUFS;
+    }
 
-    return rtnl_simple_link_op(&req.nh);
+    return 0;
 }
 
 /* ------------------------------------------------------------ */
-/* admin */
+/* port state dump */
 
-int kernel_bridge_set_up(const char *br)
+struct port_dump {
+    kernel_bridge_port_fn            fn;
+    kernel_nl_dump_done_fn           done;
+    void                            *arg;
+    struct kernel_bridge_port_state  st;
+};
+
+static void vlan_info_collect(struct l2_vlan_set *set,
+                              const struct rtattr *af)
 {
-    return kernel_link_set_updown(br, true);
-}
+    int alen = RTA_PAYLOAD(af);
+    uint16_t range_first = 0;
 
-/* ------------------------------------------------------------ */
-/* vlan filtering */
+    for (const struct rtattr *a = RTA_DATA(af);
+         RTA_OK(a, alen);
+         a = RTA_NEXT(a, alen)) {
 
+        if (a->rta_type != IFLA_BRIDGE_VLAN_INFO ||
+            RTA_PAYLOAD(a) < sizeof(struct bridge_vlan_info))
+            continue;
 
-int kernel_bridge_get_vlan_filtering(const char *br, bool *enabled)
-{
-    int br_ifindex = kernel_link_get_ifindex(br);
-    if (br_ifindex < 0)
-        return -ENOENT;
-
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-    } req = {0};
-
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-    req.nh.nlmsg_type  = RTM_GETLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST;
-    req.ifm.ifi_family = AF_UNSPEC;
-    req.ifm.ifi_index  = br_ifindex;
-
-    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
-    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-    if (fd < 0)
-        return -1;
-
-    if (sendto(fd, &req, req.nh.nlmsg_len, 0,
-               (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-        close(fd);
-        return -1;
+        const struct bridge_vlan_info *vi = RTA_DATA(a);
+        bool tagged = !(vi->flags & BRIDGE_VLAN_INFO_UNTAGGED);
+        bool pvid   = (vi->flags & BRIDGE_VLAN_INFO_PVID) != 0;
+
+        if (vi->flags & BRIDGE_VLAN_INFO_RANGE_BEGIN) {
+            range_first = vi->vid;
+            continue;
+        }
+
+        if ((vi->flags & BRIDGE_VLAN_INFO_RANGE_END) && range_first) {
+            l2_vlan_set_add_range(set, range_first, vi->vid, tagged, false);
+            range_first = 0;
+            continue;
+        }
+
+        l2_vlan_set_add(set, vi->vid, tagged, pvid);
     }
+}
 
-    char buf[4096];
-    ssize_t len = recv(fd, buf, sizeof(buf), 0);
-    close(fd);
+static int port_dump_cb(const struct nlmsghdr *nh, void *arg)
+{
+    struct port_dump *pd = arg;
 
-    if (len < 0)
-        return -1;
+    if (nh->nlmsg_type != RTM_NEWLINK ||
+        nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+        return 0;
+
+    const struct ifinfomsg *ifi = NLMSG_DATA(nh);
 
-    struct nlmsghdr *nh = (struct nlmsghdr *)buf;
-    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    struct kernel_bridge_port_state *st = &pd->st;
+    memset(st, 0, sizeof(*st));
+    st->ifindex = ifi->ifi_index;
+    st->found   = true;
+    st->up      = (ifi->ifi_flags & IFF_UP) != 0;
 
     int attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
-    for (struct rtattr *rta = IFLA_RTA(ifi);
+    for (const struct rtattr *rta = IFLA_RTA(ifi);
          RTA_OK(rta, attrlen);
          rta = RTA_NEXT(rta, attrlen)) {
 
-        if (rta->rta_type == IFLA_AF_SPEC) {
-            int alen = RTA_PAYLOAD(rta);
-            for (struct rtattr *a = RTA_DATA(rta);
-                 RTA_OK(a, alen);
-                 a = RTA_NEXT(a, alen)) {
-
-                if (a->rta_type == IFLA_BR_VLAN_FILTERING) {
-                    *enabled = !!*(uint8_t *)RTA_DATA(a);
-                    return 0;
-                }
-            }
-        }
+        if (rta->rta_type == IFLA_MASTER &&
+            RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+            st->master = (int)*(const uint32_t *)RTA_DATA(rta);
+        else if (rta->rta_type == IFLA_AF_SPEC)
+            vlan_info_collect(&st->vlans, rta);
     }
 
-    return -ENOENT;
+    pd->fn(st, pd->arg);
+    return 0;
 }
 
-int kernel_bridge_set_vlan_filtering(const char *br, bool enable)
+static void port_dump_done(struct kernel_nl_dump *d, void *arg)
 {
-    int br_ifindex = kernel_link_get_ifindex(br);
-    if (br_ifindex < 0)
-        return -ENOENT;
-
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-        char buf[256];
-    } req = {0};
-
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
-    req.nh.nlmsg_type  = RTM_SETLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-    req.ifm.ifi_family = AF_UNSPEC;
-    req.ifm.ifi_index  = br_ifindex;
-
-    struct rtattr *af =
-        (struct rtattr *)req.buf;
-    af->rta_type = IFLA_AF_SPEC;
-    af->rta_len  = RTA_LENGTH(0);
-
-    struct rtattr *vf =
-        (struct rtattr *)((char *)af + RTA_LENGTH(0));
-    vf->rta_type = IFLA_BR_VLAN_FILTERING;
-    vf->rta_len  = RTA_LENGTH(sizeof(uint8_t));
-    *(uint8_t *)RTA_DATA(vf) = enable ? 1 : 0;
-
-    af->rta_len += vf->rta_len;
-    req.nh.nlmsg_len += af->rta_len;
-
-    return rtnl_simple_link_op(&req.nh);
+    struct port_dump *pd = arg;
+    pd->done(d, pd->arg);
 }
 
-/* ------------------------------------------------------------ */
-/* ports */
-
-static int rtnl_set_master(int ifindex, int master)
+int kernel_bridge_port_dump(struct kernel_nl_dump *d,
+                            kernel_bridge_port_fn fn,
+                            kernel_nl_dump_done_fn done,
+                            void *arg)
 {
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-        char buf[64];
-    } req = {0};
-
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifm));
-    req.nh.nlmsg_type  = RTM_SETLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    /* one dump at a time; a VLAN set is 1.5 KiB, keep it off the stack */
+    static struct port_dump pd;
+    struct kernel_nl_req req;
 
-    req.ifm.ifi_index = ifindex;
+    struct ifinfomsg *ifm =
+        kernel_nl_init(&req, RTM_GETLINK, 0, sizeof(*ifm));
+    ifm->ifi_family = AF_BRIDGE;
 
-    struct rtattr *rta = (struct rtattr *)req.buf;
-    rta->rta_type = IFLA_MASTER;
-    rta->rta_len  = RTA_LENGTH(sizeof(uint32_t));
-    *(uint32_t *)RTA_DATA(rta) = master;
+    if (!kernel_nl_put_u32(&req, IFLA_EXT_MASK,
+                           RTEXT_FILTER_BRVLAN_COMPRESSED))
+        return -ENOBUFS;
 
-    req.nh.nlmsg_len += rta->rta_len;
+    pd.fn   = fn;
+    pd.done = done;
+    pd.arg  = arg;
 
-    return rtnl_simple_link_op(&req.nh);
+    return kernel_nl_dump_submit(d, &req, port_dump_cb, port_dump_done, &pd);
 }
 
-int kernel_bridge_add_port(const char *bridge, const char *port)
+bool kernel_bridge_port_cached(int port_ifindex,
+                               struct kernel_bridge_port_state *st)
 {
-    int br_ifindex   = kernel_link_get_ifindex(bridge);
-    int port_ifindex = kernel_link_get_ifindex(port);
-
-    if (br_ifindex <= 0 || port_ifindex <= 0)
-        return -ENOENT;
-
-    return rtnl_set_master(port_ifindex, br_ifindex);
+    const struct kernel_link_info *l = kernel_cache_find(port_ifindex);
+    if (!l)
+        return false;
+
+    memset(st, 0, sizeof(*st));
+    st->ifindex = port_ifindex;
+    st->found   = l->master > 0;
+    st->master  = l->master;
+    st->up      = (l->flags & IFF_UP) != 0;
+    return true;
 }
 
-int kernel_bridge_del_port(const char *bridge, const char *port)
+/* ------------------------------------------------------------ */
+/* batched variants (ifindex based, see kernel_nl_batch_*) */
+
+int kernel_bridge_batch_add_port(struct kernel_nl_batch *b,
+                                 int br_ifindex,
+                                 int port_ifindex,
+                                 void *ctx)
 {
-    (void)bridge; /* not needed */
+    struct kernel_nl_req req;
 
-    int port_ifindex = kernel_link_get_ifindex(port);
-    if (port_ifindex <= 0)
-        return -ENOENT;
+    int r = build_set_master(&req, port_ifindex, br_ifindex);
+    if (r < 0)
+        return r;
 
-    return rtnl_set_master(port_ifindex, 0);
+    return kernel_nl_batch_add(b, &req, ctx);
 }
 
- /* For bridge VLAN ops:
- *  - add uses RTM_SETLINK
- *  - del uses RTM_DELLINK
- * Payload: IFLA_AF_SPEC { IFLA_BRIDGE_VLAN_INFO = struct bridge_vlan_info }
- */
-static int rtnl_bridge_vlan_modify(int ifindex,
-                                   uint16_t vid,
-                                   bool tagged,
-                                   bool pvid,
-                                   bool master_too,
-                                   bool add)
+static int batch_vlans(struct kernel_nl_batch *b,
+                       int port_ifindex,
+                       const struct l2_vlan_set *set,
+                       bool add,
+                       void *ctx)
 {
-    struct {
-        struct nlmsghdr nh;
-        struct ifinfomsg ifm;
-        char buf[256];
-    } req;
-
-    memset(&req, 0, sizeof(req));
+    struct kernel_nl_req req;
+    struct rtattr *af = NULL;
+    struct l2_vlan_range vr;
+    unsigned int from = 0;
+    int entries = 0;
+    int queued  = 0;
+    int r;
+
+    while (l2_vlan_set_next_range(set, &from, &vr)) {
+        uint16_t flags = vlan_flags(vr.tagged, vr.pvid, true, add);
+
+        for (;;) {
+            if (!af) {
+                af = vlan_req_begin(&req, port_ifindex, add);
+                if (!af)
+                    return -ENOBUFS;
+                entries = 0;
+            }
 
-    req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifm));
-    req.nh.nlmsg_type  = add ? RTM_SETLINK : RTM_DELLINK;
-    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+            if (vlan_info_put(&req, vr.first, vr.last, flags) == 0)
+                break;
 
-    req.ifm.ifi_family = AF_UNSPEC;
-    req.ifm.ifi_index  = ifindex;
+            /* message full: flush it and retry on a fresh one */
+            if (entries == 0)
+                return -ENOBUFS;
 
-    /* Outer: IFLA_AF_SPEC (nested) */
-    struct rtattr *af = (struct rtattr *)req.buf;
-    af->rta_type = IFLA_AF_SPEC;
-    af->rta_len  = RTA_LENGTH(0);
+            kernel_nl_nest_end(&req, af);
+            r = kernel_nl_batch_add(b, &req, ctx);
+            if (r < 0)
+                return r;
+            queued++;
+            af = NULL;
+        }
 
-    /* Inner: IFLA_BRIDGE_VLAN_INFO (binary) */
-    struct bridge_vlan_info vinfo;
-    memset(&vinfo, 0, sizeof(vinfo));
-    vinfo.vid = vid;
-
-    /*
-     * Flags meaning:
-     *  - MASTER: also operate on the bridge device (when dev is a port)
-     *  - UNTAGGED: egress untagged
-     *  - PVID: ingress default VLAN (must not be set with tagged)
-     *
-     * For DEL, the kernel only needs vid (+ MASTER if you want br_vlan_delete too).
-     * Keeping UNTAGGED/PVID off for DEL is safest.
-     */
-    if (add) {
-        if (master_too)
-            vinfo.flags |= BRIDGE_VLAN_INFO_MASTER;
-        if (!tagged)
-            vinfo.flags |= BRIDGE_VLAN_INFO_UNTAGGED;
-        if (pvid)
-            vinfo.flags |= BRIDGE_VLAN_INFO_PVID;
-    } else {
-        if (master_too)
-            vinfo.flags |= BRIDGE_VLAN_INFO_MASTER;
+        entries++;
     }
 
-    struct rtattr *v = (struct rtattr *)(req.buf + RTA_ALIGN(af->rta_len));
-    v->rta_type = IFLA_BRIDGE_VLAN_INFO;
-    v->rta_len  = RTA_LENGTH(sizeof(vinfo));
-    memcpy(RTA_DATA(v), &vinfo, sizeof(vinfo));
-
-    af->rta_len += RTA_ALIGN(v->rta_len);
-    req.nh.nlmsg_len += RTA_ALIGN(af->rta_len);
+    if (af && entries) {
+        kernel_nl_nest_end(&req, af);
+        r = kernel_nl_batch_add(b, &req, ctx);
+        if (r < 0)
+            return r;
+        queued++;
+    }
 
-    return rtnl_simple_link_op(&req.nh);
+    return queued;
 }
 
-int kernel_bridge_vlan_add(const char *bridge,
-                           const char *port,
-                           uint16_t vid,
-                           bool tagged,
-                           bool pvid)
+int kernel_bridge_batch_vlans(struct kernel_nl_batch *b,
+                              int port_ifindex,
+                              const struct l2_vlan_set *set,
+                              void *ctx)
 {
-    int port_ifindex = kernel_link_get_ifindex(port);
-    if (port_ifindex <= 0)
-        return -ENOENT;
-
-    /*
-     * If you want “port add also ensures bridge has VLAN” behavior,
-     * set master_too=true. If you manage bridge VLANs separately, set false.
-     */
-    bool master_too = true;
-    (void)bridge;
-
-    return rtnl_bridge_vlan_modify(port_ifindex, vid, tagged, pvid, master_too, true);
+    return batch_vlans(b, port_ifindex, set, true, ctx);
 }
 
-int kernel_bridge_vlan_del(const char *bridge,
-                           const char *port,
-                           uint16_t vid)
+int kernel_bridge_batch_vlans_del(struct kernel_nl_batch *b,
+                                  int port_ifindex,
+                                  const struct l2_vlan_set *set,
+                                  void *ctx)
 {
-    int port_ifindex = kernel_link_get_ifindex(port);
-    if (port_ifindex <= 0)
-        return -ENOENT;
-
-    bool master_too = true;
-    (void)bridge;
-
-    /* tagged/pvid are irrelevant for DEL */
-    return rtnl_bridge_vlan_modify(port_ifindex, vid, false, false, master_too, false);
-}
\ No newline at end of file
+    return batch_vlans(b, port_ifindex, set, false, ctx);
+}
@@ -2,28 +2,84 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
-/* lifecycle */
-int kernel_bridge_create(const char *br);
-int kernel_bridge_delete(const char *br);
+#include "l2.h"
+#include "kernel_nl.h"
 
-/* admin state */
-int kernel_bridge_set_up(const char *br);
+struct kernel_nl_batch;
 
-/* vlan filtering */
-int kernel_bridge_get_vlan_filtering(const char *br, bool *enabled);
-int kernel_bridge_set_vlan_filtering(const char *br, bool enable);
+/* bridge-wide options, IFLA_INFO_DATA */
+struct kernel_bridge_opts {
+    bool     vlan_filtering;
+    uint16_t default_pvid;     /* 0: leave the kernel's */
+};
 
-/* ports */
-int kernel_bridge_add_port(const char *br, const char *port);
-int kernel_bridge_del_port(const char *br, const char *port);
+/* the link cache already shows br as an up bridge with these options */
+bool kernel_bridge_matches(const char *br,
+                           const struct kernel_bridge_opts *opts);
 
-int kernel_bridge_vlan_add(const char *bridge,
-                           const char *port,
-                           uint16_t vid,
-                           bool tagged,
-                           bool pvid);
+/*
+ * Create br, or bring an existing bridge to opts, and set it up: one
+ * RTM_NEWLINK either way.
+ */
+int kernel_bridge_batch_ensure(struct kernel_nl_batch *b,
+                               const char *br,
+                               const struct kernel_bridge_opts *opts,
+                               void *ctx);
 
-int kernel_bridge_vlan_del(const char *bridge,
-                           const char *port,
-                           uint16_t vid);
\ No newline at end of file
+/* batched variants: queue on b, committed by the caller */
+int kernel_bridge_batch_add_port(struct kernel_nl_batch *b,
+                                 int br_ifindex,
+                                 int port_ifindex,
+                                 void *ctx);
+
+/*
+ * Current kernel view of one bridge port, from an AF_BRIDGE link dump
+ * with RTEXT_FILTER_BRVLAN_COMPRESSED. found is false when the link is
+ * not enslaved to any bridge.
+ */
+struct kernel_bridge_port_state {
+    int                ifindex;
+    bool               found;
+    int                master;     /* bridge ifindex */
+    bool               up;         /* IFF_UP */
+    struct l2_vlan_set vlans;
+};
+
+/* one port of a dump; st is only valid during the call */
+typedef void (*kernel_bridge_port_fn)(const struct kernel_bridge_port_state *st,
+                                      void *arg);
+
+/*
+ * AF_BRIDGE links cannot be fetched one at a time: this submits one
+ * bridge-port dump (see kernel_nl_dump_submit) that hands every port
+ * to fn as it arrives, then calls done, so callers with many ports to
+ * look at pay for a single dump and never wait on it.
+ */
+int kernel_bridge_port_dump(struct kernel_nl_dump *d,
+                            kernel_bridge_port_fn fn,
+                            kernel_nl_dump_done_fn done,
+                            void *arg);
+
+/*
+ * Master and admin state only, from the link cache (no syscalls);
+ * vlans is left empty. Returns false if the link is not cached.
+ */
+bool kernel_bridge_port_cached(int port_ifindex,
+                               struct kernel_bridge_port_state *st);
+
+/*
+ * Program every VLAN in set on a port, packing ranges into as few
+ * messages as fit. Returns the number of messages queued or -errno.
+ */
+int kernel_bridge_batch_vlans(struct kernel_nl_batch *b,
+                              int port_ifindex,
+                              const struct l2_vlan_set *set,
+                              void *ctx);
+
+/* remove every VLAN in set from a port (flags are ignored) */
+int kernel_bridge_batch_vlans_del(struct kernel_nl_batch *b,
+                                  int port_ifindex,
+                                  const struct l2_vlan_set *set,
+                                  void *ctx);
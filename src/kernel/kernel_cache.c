@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "kernel_cache.h"
+
+#define CACHE_BUCKETS 256   /* power of two */
+
+static struct kernel_link_info *by_index[CACHE_BUCKETS];
+static struct kernel_link_info *by_name[CACHE_BUCKETS];
+
+static unsigned int idx_slot(int ifindex)
+{
+    return (unsigned int)ifindex & (CACHE_BUCKETS - 1);
+}
+
+/* FNV-1a */
+static unsigned int name_slot(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    return h & (CACHE_BUCKETS - 1);
+}
+
+const struct kernel_link_info *kernel_cache_find(int ifindex)
+{
+    for (struct kernel_link_info *l = by_index[idx_slot(ifindex)];
+         l; l = l->idx_next)
+        if (l->ifindex == ifindex)
+            return l;
+    return NULL;
+}
+
+const struct kernel_link_info *kernel_cache_find_name(const char *name)
+{
+    if (!name)
+        return NULL;
+
+    for (struct kernel_link_info *l = by_name[name_slot(name)];
+         l; l = l->name_next)
+        if (strcmp(l->name, name) == 0)
+            return l;
+    return NULL;
+}
+
+static void name_unlink(struct kernel_link_info *l)
+{
+    struct kernel_link_info **pp = &by_name[name_slot(l->name)];
+    for (; *pp; pp = &(*pp)->name_next) {
+        if (*pp == l) {
+            *pp = l->name_next;
+            break;
+        }
+    }
+    l->name_next = NULL;
+}
+
+static void name_link(struct kernel_link_info *l)
+{
+    unsigned int s = name_slot(l->name);
+    l->name_next = by_name[s];
+    by_name[s] = l;
+}
+
+static void link_remove(int ifindex)
+{
+    struct kernel_link_info **pp = &by_index[idx_slot(ifindex)];
+    for (; *pp; pp = &(*pp)->idx_next) {
+        struct kernel_link_info *l = *pp;
+        if (l->ifindex != ifindex)
+            continue;
+
+        *pp = l->idx_next;
+        name_unlink(l);
+        free(l);
+        return;
+    }
+}
+
+static void set_name(struct kernel_link_info *l, const char *name, size_t len)
+{
+    char tmp[KERNEL_CACHE_NAMESZ];
+
+    if (len >= sizeof(tmp))
+        len = sizeof(tmp) - 1;
+    memcpy(tmp, name, len);
+    tmp[len] = '\0';
+
+    if (strcmp(tmp, l->name) == 0)
+        return;
+
+    /* a rename: another stale entry may still hold the new name */
+    const struct kernel_link_info *other = kernel_cache_find_name(tmp);
+    if (other && other != l)
+        link_remove(other->ifindex);
+
+    if (l->name[0])
+        name_unlink(l);
+    memcpy(l->name, tmp, sizeof(tmp));
+    name_link(l);
+}
+
+static void parse_bridge_data(struct kernel_link_info *l,
+                              const struct rtattr *data)
+{
+    int len = RTA_PAYLOAD(data);
+
+    for (const struct rtattr *a = RTA_DATA(data); RTA_OK(a, len);
+         a = RTA_NEXT(a, len)) {
+        switch (a->rta_type) {
+        case IFLA_BR_VLAN_FILTERING:
+            if (RTA_PAYLOAD(a) >= sizeof(uint8_t))
+                l->br_vlan_filtering = !!*(const uint8_t *)RTA_DATA(a);
+            break;
+        case IFLA_BR_VLAN_DEFAULT_PVID:
+            if (RTA_PAYLOAD(a) >= sizeof(uint16_t))
+                l->br_default_pvid = *(const uint16_t *)RTA_DATA(a);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void parse_linkinfo(struct kernel_link_info *l, const struct rtattr *li)
+{
+    const struct rtattr *data = NULL;
+    int len = RTA_PAYLOAD(li);
+
+    for (const struct rtattr *a = RTA_DATA(li); RTA_OK(a, len);
+         a = RTA_NEXT(a, len)) {
+        if (a->rta_type == IFLA_INFO_DATA) {
+            data = a;
+            continue;
+        }
+        if (a->rta_type != IFLA_INFO_KIND)
+            continue;
+
+        size_t n = RTA_PAYLOAD(a);
+        if (n >= sizeof(l->kind))
+            n = sizeof(l->kind) - 1;
+        memcpy(l->kind, RTA_DATA(a), n);
+        l->kind[n] = '\0';
+    }
+
+    /* INFO_DATA is only meaningful once the kind is known */
+    if (data && strcmp(l->kind, "bridge") == 0)
+        parse_bridge_data(l, data);
+}
+
+void kernel_cache_update(const struct nlmsghdr *nh)
+{
+    if (nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK)
+        return;
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+        return;
+
+    const struct ifinfomsg *ifi = NLMSG_DATA(nh);
+
+    /* AF_BRIDGE messages describe bridge ports, not links */
+    if (ifi->ifi_family != AF_UNSPEC || ifi->ifi_index <= 0)
+        return;
+
+    if (nh->nlmsg_type == RTM_DELLINK) {
+        link_remove(ifi->ifi_index);
+        return;
+    }
+
+    struct kernel_link_info *l =
+        (struct kernel_link_info *)kernel_cache_find(ifi->ifi_index);
+
+    if (!l) {
+        l = calloc(1, sizeof(*l));
+        if (!l)
+            return;
+
+        l->ifindex  = ifi->ifi_index;
+        l->idx_next = by_index[idx_slot(l->ifindex)];
+        by_index[idx_slot(l->ifindex)] = l;
+    }
+
+    l->flags  = ifi->ifi_flags;
+    l->master = 0;   /* IFLA_MASTER is omitted when there is none */
+    l->br_vlan_filtering = -1;
+
+    int attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    for (const struct rtattr *rta = IFLA_RTA(ifi);
+         RTA_OK(rta, attrlen);
+         rta = RTA_NEXT(rta, attrlen)) {
+
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            set_name(l, RTA_DATA(rta), RTA_PAYLOAD(rta));
+            break;
+        case IFLA_MASTER:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+                l->master = (int)*(const uint32_t *)RTA_DATA(rta);
+            break;
+        case IFLA_MTU:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+                l->mtu = *(const uint32_t *)RTA_DATA(rta);
+            break;
+        case IFLA_OPERSTATE:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint8_t))
+                l->operstate = *(const uint8_t *)RTA_DATA(rta);
+            break;
+        case IFLA_LINKINFO:
+            parse_linkinfo(l, rta);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void kernel_cache_note_flags(int ifindex, unsigned int mask,
+                             unsigned int flags)
+{
+    struct kernel_link_info *l =
+        (struct kernel_link_info *)kernel_cache_find(ifindex);
+    if (l)
+        l->flags = (l->flags & ~mask) | (flags & mask);
+}
+
+void kernel_cache_note_master(int ifindex, int master)
+{
+    struct kernel_link_info *l =
+        (struct kernel_link_info *)kernel_cache_find(ifindex);
+    if (l)
+        l->master = master;
+}
+
+void kernel_cache_flush(void)
+{
+    for (unsigned int s = 0; s < CACHE_BUCKETS; s++) {
+        struct kernel_link_info *l = by_index[s];
+        while (l) {
+            struct kernel_link_info *next = l->idx_next;
+            free(l);
+            l = next;
+        }
+        by_index[s] = NULL;
+        by_name[s]  = NULL;
+    }
+}
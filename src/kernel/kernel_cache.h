@@ -0,0 +1,57 @@
+// src/kernel/kernel_cache.h
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Link state mirror
+ *
+ * A per-ifindex copy of what the kernel last told us about each link,
+ * fed by every RTM_NEWLINK/RTM_DELLINK the daemon already receives
+ * (the initial dump and the RTMGRP_LINK stream) and by the ACKs of its
+ * own writes. Activations consult it instead of the kernel, so
+ * existence checks, ifindex lookups and no-op writes cost no syscalls.
+ *
+ * A hit is trusted, and a miss is never followed by a query: the link
+ * event of a request is queued before its ACK and handled first, so a
+ * miss means the link is absent until its presence event.
+ */
+
+#define KERNEL_CACHE_NAMESZ 16   /* IFNAMSIZ */
+
+struct nlmsghdr;
+
+struct kernel_link_info {
+    int          ifindex;
+    char         name[KERNEL_CACHE_NAMESZ];
+    unsigned int flags;                       /* IFF_* */
+    int          master;                      /* 0 if none */
+    char         kind[KERNEL_CACHE_NAMESZ];   /* IFLA_INFO_KIND, "" if none */
+    uint8_t      operstate;                   /* IF_OPER_* */
+    uint32_t     mtu;
+
+    /* IFLA_INFO_DATA of bridges; br_vlan_filtering < 0: not reported */
+    int8_t       br_vlan_filtering;
+    uint16_t     br_default_pvid;
+
+    struct kernel_link_info *idx_next;
+    struct kernel_link_info *name_next;
+};
+
+/* apply an RTM_NEWLINK / RTM_DELLINK (other messages are ignored) */
+void kernel_cache_update(const struct nlmsghdr *nh);
+
+const struct kernel_link_info *kernel_cache_find(int ifindex);
+const struct kernel_link_info *kernel_cache_find_name(const char *name);
+
+/*
+ * Record the effect of a write we just made, so the mirror stays
+ * correct until the kernel's own notification arrives.
+ */
+void kernel_cache_note_flags(int ifindex, unsigned int mask,
+                             unsigned int flags);
+void kernel_cache_note_master(int ifindex, int master);
+
+/* drop everything (before a full resync) */
+void kernel_cache_flush(void);
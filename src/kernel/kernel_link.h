@@ -3,19 +3,10 @@
 
 #include <stdbool.h>
 
-int kernel_link_set_updown(const char *ifname, bool up);
+struct kernel_nl_batch;
 
-static inline int kernel_link_set_up(const char *ifname)
-{
-    return kernel_link_set_updown(ifname, true);
-}
-
-static inline int kernel_link_set_down(const char *ifname)
-{
-    return kernel_link_set_updown(ifname, false);
-}
-
-bool kernel_link_is_up(const char *ifname);
-bool kernel_link_exists(const char *ifname);
-
-int kernel_link_get_ifindex(const char *ifname);
\ No newline at end of file
+/* queue an admin up/down for ifindex on a batch */
+int kernel_link_batch_set_updown(struct kernel_nl_batch *b,
+                                 int ifindex,
+                                 bool up,
+                                 void *ctx);
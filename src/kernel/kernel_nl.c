@@ -0,0 +1,646 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "kernel_nl.h"
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
+/* pipelining limits: bytes per sendmsg, requests awaiting an ACK */
+#define BATCH_SEND_MAX  32768
+#define BATCH_WINDOW    128
+
+/* the request socket, opened on first use */
+static int      req_fd = -1;
+static uint32_t req_seq;
+
+/* replies are read here; large enough for a full RTM_NEWLINK */
+static char rx_buf[KERNEL_NL_LINK_MSGSZ] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+/* submitted batches still waiting for ACKs, oldest first */
+static struct kernel_nl_batch *inflight;
+
+/* the submitted dump, if any: the kernel runs one per socket */
+static struct kernel_nl_dump *dump_inflight;
+
+static bool inflight_ack(const struct nlmsghdr *nh);
+
+static int nl_open(void)
+{
+    if (req_fd >= 0)
+        return req_fd;
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+        return -errno;
+
+    struct timeval tv = { .tv_sec = 1 };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    /* room for a full window of ACKs */
+    int rcvbuf = 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    /* small ACKs with error text; older kernels just ignore these */
+    int one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+    setsockopt(fd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    req_fd = fd;
+    return fd;
+}
+
+void kernel_nl_close(void)
+{
+    if (req_fd >= 0)
+        close(req_fd);
+    req_fd = -1;
+
+    /* nothing answers on a closed socket */
+    inflight      = NULL;
+    dump_inflight = NULL;
+}
+
+/* ------------------------------------------------------------ */
+/* message building */
+
+void *kernel_nl_init(struct kernel_nl_req *req,
+                     uint16_t type,
+                     uint16_t flags,
+                     size_t hdrlen)
+{
+    memset(&req->nh, 0, sizeof(req->nh));
+    memset(req->buf, 0, NLMSG_ALIGN(hdrlen));
+
+    req->nh.nlmsg_len   = NLMSG_LENGTH(hdrlen);
+    req->nh.nlmsg_type  = type;
+    req->nh.nlmsg_flags = NLM_F_REQUEST | flags;
+
+    return NLMSG_DATA(&req->nh);
+}
+
+struct rtattr *kernel_nl_put(struct kernel_nl_req *req,
+                             uint16_t type,
+                             const void *data,
+                             size_t len)
+{
+    size_t off = NLMSG_ALIGN(req->nh.nlmsg_len);
+
+    if (off + RTA_SPACE(len) > sizeof(*req))
+        return NULL;
+
+    struct rtattr *rta = (struct rtattr *)((char *)&req->nh + off);
+    rta->rta_type = type;
+    rta->rta_len  = RTA_LENGTH(len);
+    if (len)
+        memcpy(RTA_DATA(rta), data, len);
+
+    req->nh.nlmsg_len = off + RTA_ALIGN(rta->rta_len);
+    return rta;
+}
+
+struct rtattr *kernel_nl_nest(struct kernel_nl_req *req, uint16_t type)
+{
+    return kernel_nl_put(req, type, NULL, 0);
+}
+
+void kernel_nl_nest_end(struct kernel_nl_req *req, struct rtattr *nest)
+{
+    nest->rta_len = (unsigned short)
+        ((char *)&req->nh + req->nh.nlmsg_len - (char *)nest);
+}
+
+/* ------------------------------------------------------------ */
+/* transactions */
+
+static int nl_send(struct nlmsghdr *nh)
+{
+    int fd = nl_open();
+    if (fd < 0)
+        return fd;
+
+    nh->nlmsg_seq = ++req_seq;
+    nh->nlmsg_pid = 0;
+
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+
+    for (;;) {
+        if (sendto(fd, nh, nh->nlmsg_len, 0,
+                   (struct sockaddr *)&sa, sizeof(sa)) >= 0)
+            return 0;
+        if (errno != EINTR)
+            return -errno;
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* batches */
+
+/* copy NLMSGERR_ATTR_MSG out of an extended ACK, if there is one */
+static void nl_ext_ack_msg(const struct nlmsghdr *nh, char *out, size_t len)
+{
+    out[0] = '\0';
+
+    if (!(nh->nlmsg_flags & NLM_F_ACK_TLVS))
+        return;
+
+    const struct nlmsgerr *err = NLMSG_DATA(nh);
+    size_t off = sizeof(*err);
+
+    /* without CAP_ACK the request payload is echoed before the TLVs */
+    if (!(nh->nlmsg_flags & NLM_F_CAPPED))
+        off += err->msg.nlmsg_len - NLMSG_HDRLEN;
+
+    if (NLMSG_HDRLEN + off > nh->nlmsg_len)
+        return;
+
+    const char *p   = (const char *)err + off;
+    size_t      rem = nh->nlmsg_len - NLMSG_HDRLEN - off;
+
+    while (rem >= NLA_HDRLEN) {
+        const struct nlattr *a = (const struct nlattr *)p;
+        if (a->nla_len < NLA_HDRLEN || a->nla_len > rem)
+            return;
+
+        if ((a->nla_type & NLA_TYPE_MASK) == NLMSGERR_ATTR_MSG) {
+            size_t n = a->nla_len - NLA_HDRLEN;
+            if (n >= len)
+                n = len - 1;
+            memcpy(out, p + NLA_HDRLEN, n);
+            out[n] = '\0';
+            return;
+        }
+
+        size_t step = NLA_ALIGN((size_t)a->nla_len);
+        if (step >= rem)
+            return;
+        p   += step;
+        rem -= step;
+    }
+}
+
+void kernel_nl_batch_init(struct kernel_nl_batch *b)
+{
+    memset(b, 0, sizeof(*b));
+}
+
+void kernel_nl_batch_reset(struct kernel_nl_batch *b)
+{
+    b->len   = 0;
+    b->n_ops = 0;
+}
+
+void kernel_nl_batch_free(struct kernel_nl_batch *b)
+{
+    free(b->buf);
+    free(b->ops);
+    kernel_nl_batch_init(b);
+}
+
+int kernel_nl_batch_add(struct kernel_nl_batch *b,
+                        struct kernel_nl_req *req,
+                        void *ctx)
+{
+    size_t need = NLMSG_ALIGN(req->nh.nlmsg_len);
+
+    if (b->len + need > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + need)
+            cap *= 2;
+
+        char *nb = realloc(b->buf, cap);
+        if (!nb)
+            return -ENOMEM;
+        b->buf = nb;
+        b->cap = cap;
+    }
+
+    if (b->n_ops == b->cap_ops) {
+        size_t cap = b->cap_ops ? b->cap_ops * 2 : 16;
+
+        struct kernel_nl_op *ops = realloc(b->ops, cap * sizeof(*ops));
+        if (!ops)
+            return -ENOMEM;
+        b->ops = ops;
+        b->cap_ops = cap;
+    }
+
+    req->nh.nlmsg_flags |= NLM_F_ACK;
+
+    memcpy(b->buf + b->len, &req->nh, req->nh.nlmsg_len);
+    memset(b->buf + b->len + req->nh.nlmsg_len, 0,
+           need - req->nh.nlmsg_len);
+    b->len += need;
+
+    struct kernel_nl_op *op = &b->ops[b->n_ops++];
+    op->seq    = 0;
+    op->ctx    = ctx;
+    op->err    = 0;
+    op->msg[0] = '\0';
+    return 0;
+}
+
+/* match one ACK to its op among the first `sent`; true if newly acked */
+static bool batch_ack(struct kernel_nl_batch *b,
+                      const struct nlmsghdr *nh,
+                      size_t sent)
+{
+    if (nh->nlmsg_type != NLMSG_ERROR || !b->n_ops)
+        return false;
+
+    uint32_t idx = nh->nlmsg_seq - b->ops[0].seq;
+    if (idx >= sent || b->ops[idx].acked)
+        return false;
+
+    const struct nlmsgerr *err = NLMSG_DATA(nh);
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+        return false;
+
+    struct kernel_nl_op *op = &b->ops[idx];
+    op->err   = err->error;
+    op->acked = true;
+    if (op->err)
+        nl_ext_ack_msg(nh, op->msg, sizeof(op->msg));
+
+    return true;
+}
+
+/* contiguous sequence numbers: op index = seq - first seq */
+static void batch_number(struct kernel_nl_batch *b)
+{
+    size_t off = 0;
+    for (size_t i = 0; i < b->n_ops; i++) {
+        struct nlmsghdr *nh = (struct nlmsghdr *)(b->buf + off);
+        nh->nlmsg_seq = ++req_seq;
+        nh->nlmsg_pid = 0;
+        b->ops[i].seq   = nh->nlmsg_seq;
+        b->ops[i].acked = false;
+        off += NLMSG_ALIGN(nh->nlmsg_len);
+    }
+}
+
+/* length of the next send: up to max_ops requests, BATCH_SEND_MAX bytes */
+static size_t batch_chunk(const struct kernel_nl_batch *b,
+                          size_t send_off,
+                          size_t first,
+                          size_t max_ops,
+                          size_t *n_out)
+{
+    size_t len = 0, n = 0;
+
+    while (first + n < b->n_ops && n < max_ops) {
+        const struct nlmsghdr *nh =
+            (const struct nlmsghdr *)(b->buf + send_off + len);
+        size_t mlen = NLMSG_ALIGN(nh->nlmsg_len);
+
+        if (n && len + mlen > BATCH_SEND_MAX)
+            break;
+        len += mlen;
+        n++;
+    }
+
+    *n_out = n;
+    return len;
+}
+
+int kernel_nl_batch_commit(struct kernel_nl_batch *b)
+{
+    if (!b->n_ops)
+        return 0;
+
+    int fd = nl_open();
+    if (fd < 0)
+        return fd;
+
+    batch_number(b);
+
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    size_t sent = 0, acked = 0, send_off = 0;
+    int r = 0;
+
+    while (acked < b->n_ops) {
+
+        /* keep the pipe full */
+        if (sent < b->n_ops && sent - acked < BATCH_WINDOW) {
+            size_t n;
+            size_t len = batch_chunk(b, send_off, sent,
+                                     BATCH_WINDOW - (sent - acked), &n);
+
+            if (sendto(fd, b->buf + send_off, len, 0,
+                       (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                r = -errno;
+                break;
+            }
+
+            sent     += n;
+            send_off += len;
+            continue;
+        }
+
+        ssize_t n = recv(fd, rx_buf, sizeof(rx_buf), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            r = (errno == EAGAIN || errno == EWOULDBLOCK) ?
+                -ETIMEDOUT : -errno;
+            break;
+        }
+
+        int rem = (int)n;
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)rx_buf;
+             NLMSG_OK(nh, rem);
+             nh = NLMSG_NEXT(nh, rem)) {
+            if (batch_ack(b, nh, sent))
+                acked++;
+            else
+                inflight_ack(nh);
+        }
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < b->n_ops; i++) {
+        if (!b->ops[i].acked)
+            b->ops[i].err = r ? r : -ETIMEDOUT;
+        if (b->ops[i].err)
+            failed++;
+    }
+
+    /* nothing went out at all: report the channel error */
+    if (!sent && r)
+        return r;
+
+    return failed;
+}
+
+/* ------------------------------------------------------------ */
+/* asynchronous batches */
+
+/* ACK deadline for a submitted batch, as for a committed one */
+#define BATCH_TIMEOUT_MS 1000
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* a part of the in-flight dump: pass it on, or note the end */
+static bool dump_part(const struct nlmsghdr *nh)
+{
+    struct kernel_nl_dump *d = dump_inflight;
+
+    if (!d || d->finished || nh->nlmsg_seq != d->seq)
+        return false;
+
+    if (nh->nlmsg_type == NLMSG_DONE) {
+        d->finished = true;
+    } else if (nh->nlmsg_type == NLMSG_ERROR) {
+        const struct nlmsgerr *err = NLMSG_DATA(nh);
+        d->err = nh->nlmsg_len < NLMSG_LENGTH(sizeof(*err)) ? -EPROTO
+                                                            : err->error;
+        d->finished = true;
+    } else if (d->err == 0) {
+        d->err = d->cb(nh, d->arg);
+    }
+    return true;
+}
+
+static bool inflight_ack(const struct nlmsghdr *nh)
+{
+    if (dump_part(nh))
+        return true;
+
+    for (struct kernel_nl_batch *b = inflight; b; b = b->next) {
+        if (batch_ack(b, nh, b->n_ops)) {
+            b->n_acked++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* read whatever is queued without blocking; false once drained */
+static bool inflight_read(int fd)
+{
+    ssize_t n = recv(fd, rx_buf, sizeof(rx_buf), MSG_DONTWAIT);
+    if (n < 0)
+        return errno == EINTR;
+
+    int rem = (int)n;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)rx_buf;
+         NLMSG_OK(nh, rem);
+         nh = NLMSG_NEXT(nh, rem))
+        inflight_ack(nh);
+
+    return true;
+}
+
+static void inflight_unlink(struct kernel_nl_batch *b)
+{
+    for (struct kernel_nl_batch **pp = &inflight; *pp; pp = &(*pp)->next) {
+        if (*pp == b) {
+            *pp = b->next;
+            b->next = NULL;
+            return;
+        }
+    }
+}
+
+int kernel_nl_batch_submit(struct kernel_nl_batch *b,
+                           kernel_nl_done_fn done,
+                           void *arg)
+{
+    int fd = nl_open();
+    if (fd < 0)
+        return fd;
+
+    batch_number(b);
+
+    b->n_acked  = 0;
+    b->done     = done;
+    b->done_arg = arg;
+    b->deadline = now_ms() + BATCH_TIMEOUT_MS;
+
+    /* append: completions then run oldest first */
+    b->next = NULL;
+    struct kernel_nl_batch **pp = &inflight;
+    while (*pp)
+        pp = &(*pp)->next;
+    *pp = b;
+
+    /*
+     * rtnetlink handles each request inside sendmsg(), so the ACKs of a
+     * window are queued by the time it returns; draining between
+     * windows keeps a long batch from overrunning the receive buffer.
+     */
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    size_t sent = 0, send_off = 0;
+
+    while (sent < b->n_ops) {
+        size_t n;
+        size_t len = batch_chunk(b, send_off, sent, BATCH_WINDOW, &n);
+
+        if (sendto(fd, b->buf + send_off, len, 0,
+                   (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            int err = -errno;
+
+            /* nothing sent: the caller still owns the batch */
+            if (sent == 0) {
+                inflight_unlink(b);
+                return err;
+            }
+
+            for (size_t i = sent; i < b->n_ops; i++) {
+                b->ops[i].err   = err;
+                b->ops[i].acked = true;
+                b->n_acked++;
+            }
+            return 0;
+        }
+
+        sent     += n;
+        send_off += len;
+
+        if (sent < b->n_ops)
+            while (inflight_read(fd))
+                ;
+    }
+
+    return 0;
+}
+
+void kernel_nl_batch_cancel(struct kernel_nl_batch *b)
+{
+    inflight_unlink(b);
+}
+
+/* ------------------------------------------------------------ */
+/* asynchronous dumps */
+
+int kernel_nl_dump_submit(struct kernel_nl_dump *d,
+                          struct kernel_nl_req *req,
+                          kernel_nl_dump_cb cb,
+                          kernel_nl_dump_done_fn done,
+                          void *arg)
+{
+    if (dump_inflight)
+        return -EBUSY;
+
+    req->nh.nlmsg_flags &= ~NLM_F_ACK;
+    req->nh.nlmsg_flags |= NLM_F_DUMP;
+
+    int r = nl_send(&req->nh);
+    if (r < 0)
+        return r;
+
+    *d = (struct kernel_nl_dump){
+        .seq      = req->nh.nlmsg_seq,
+        .deadline = now_ms() + BATCH_TIMEOUT_MS,
+        .cb       = cb,
+        .done     = done,
+        .arg      = arg,
+    };
+    dump_inflight = d;
+    return 0;
+}
+
+void kernel_nl_dump_cancel(struct kernel_nl_dump *d)
+{
+    if (dump_inflight == d)
+        dump_inflight = NULL;
+}
+
+int kernel_nl_fd(void)
+{
+    return nl_open();
+}
+
+void kernel_nl_process(void)
+{
+    if (req_fd >= 0)
+        while (inflight_read(req_fd))
+            ;
+
+    int64_t now = now_ms();
+
+    struct kernel_nl_dump *d = dump_inflight;
+    if (d && (d->finished || d->deadline <= now)) {
+        if (!d->finished)
+            d->err = -ETIMEDOUT;
+        dump_inflight = NULL;
+        d->done(d, d->arg);
+    }
+
+    /* callbacks may submit again: restart from the head after each */
+    for (;;) {
+        struct kernel_nl_batch *b = inflight;
+
+        while (b && b->n_acked < b->n_ops && b->deadline > now)
+            b = b->next;
+        if (!b)
+            return;
+
+        for (size_t i = 0; i < b->n_ops; i++) {
+            if (!b->ops[i].acked) {
+                b->ops[i].err   = -ETIMEDOUT;
+                b->ops[i].acked = true;
+            }
+        }
+        b->n_acked = b->n_ops;
+
+        inflight_unlink(b);
+        b->done(b, b->done_arg);
+    }
+}
+
+int kernel_nl_timeout(void)
+{
+    if (!inflight && !dump_inflight)
+        return -1;
+
+    int64_t now = now_ms();
+    int64_t next = INT64_MAX;
+
+    if (dump_inflight) {
+        if (dump_inflight->finished)
+            return 0;
+        next = dump_inflight->deadline;
+    }
+
+    for (struct kernel_nl_batch *b = inflight; b; b = b->next) {
+        if (b->n_acked == b->n_ops)
+            return 0;
+        if (b->deadline < next)
+            next = b->deadline;
+    }
+
+    return next <= now ? 0 : (int)(next - now);
+}
@@ -0,0 +1,203 @@
+// src/kernel/kernel_nl.h
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * Shared rtnetlink request channel
+ *
+ * Every kernel operation in src/kernel/ goes through one long-lived
+ * NETLINK_ROUTE socket. Requests carry a sequence number and the reply
+ * (data or nlmsgerr ACK) is matched on it; late replies to earlier,
+ * abandoned requests are discarded.
+ *
+ * The socket is opened on first use and is blocking with a short
+ * receive timeout, so a kernel that never answers cannot wedge the
+ * daemon.
+ */
+
+/* request buffer: header + family message + attributes */
+#define KERNEL_NL_BUFSZ 1024
+
+/* reply buffer for one RTM_NEWLINK (VF info, AF_SPEC; stats skipped) */
+#define KERNEL_NL_LINK_MSGSZ 32768
+
+struct kernel_nl_req {
+    struct nlmsghdr nh;
+    char            buf[KERNEL_NL_BUFSZ];
+};
+
+/* initialise a request with a zeroed family header of hdrlen bytes */
+void *kernel_nl_init(struct kernel_nl_req *req,
+                     uint16_t type,
+                     uint16_t flags,
+                     size_t hdrlen);
+
+/* append an attribute; NULL if the buffer is full */
+struct rtattr *kernel_nl_put(struct kernel_nl_req *req,
+                             uint16_t type,
+                             const void *data,
+                             size_t len);
+
+static inline struct rtattr *
+kernel_nl_put_str(struct kernel_nl_req *req, uint16_t type, const char *s)
+{
+    return kernel_nl_put(req, type, s, strlen(s) + 1);
+}
+
+static inline struct rtattr *
+kernel_nl_put_u32(struct kernel_nl_req *req, uint16_t type, uint32_t v)
+{
+    return kernel_nl_put(req, type, &v, sizeof(v));
+}
+
+static inline struct rtattr *
+kernel_nl_put_u16(struct kernel_nl_req *req, uint16_t type, uint16_t v)
+{
+    return kernel_nl_put(req, type, &v, sizeof(v));
+}
+
+static inline struct rtattr *
+kernel_nl_put_u8(struct kernel_nl_req *req, uint16_t type, uint8_t v)
+{
+    return kernel_nl_put(req, type, &v, sizeof(v));
+}
+
+/* nested attributes: begin returns the container, end fixes its length */
+struct rtattr *kernel_nl_nest(struct kernel_nl_req *req, uint16_t type);
+void kernel_nl_nest_end(struct kernel_nl_req *req, struct rtattr *nest);
+
+/*
+ * Batched transactions
+ *
+ * Requests are packed back to back and sent with as few sendmsg()
+ * calls as possible; ACKs are collected afterwards and matched to
+ * their request by sequence number, whatever order they arrive in.
+ * The channel runs with NETLINK_CAP_ACK (ACKs do not echo the
+ * request) and NETLINK_EXT_ACK, so a failing op reports the kernel's
+ * own message alongside its errno.
+ *
+ * Each op carries an opaque ctx (typically the node it acts for) so
+ * failures can be attributed after the commit.
+ */
+
+#define KERNEL_NL_ERRMSG 96
+
+struct kernel_nl_op {
+    uint32_t seq;
+    void     *ctx;
+    int      err;                      /* 0, or negative errno */
+    bool     acked;                    /* answer received */
+    char     msg[KERNEL_NL_ERRMSG];    /* extended ACK text, may be "" */
+};
+
+struct kernel_nl_batch;
+
+typedef void (*kernel_nl_done_fn)(struct kernel_nl_batch *b, void *arg);
+
+struct kernel_nl_batch {
+    char                *buf;          /* packed requests */
+    size_t              len;
+    size_t              cap;
+
+    struct kernel_nl_op *ops;
+    size_t              n_ops;
+    size_t              cap_ops;
+
+    /* in flight (kernel_nl_batch_submit) */
+    size_t              n_acked;
+    int64_t             deadline;      /* CLOCK_MONOTONIC, ms */
+    kernel_nl_done_fn   done;
+    void                *done_arg;
+    struct kernel_nl_batch *next;
+};
+
+void kernel_nl_batch_init(struct kernel_nl_batch *b);
+
+/* queue a copy of req (NLM_F_ACK is forced); -ENOMEM on failure */
+int kernel_nl_batch_add(struct kernel_nl_batch *b,
+                        struct kernel_nl_req *req,
+                        void *ctx);
+
+/*
+ * Send everything queued and wait for all ACKs.
+ * Returns the number of failed ops (see b->ops[i].err), or a negative
+ * errno if nothing could be sent. Ops left unanswered when the channel
+ * times out fail with -ETIMEDOUT.
+ */
+int kernel_nl_batch_commit(struct kernel_nl_batch *b);
+
+/* drop queued requests and results, keep the buffers */
+void kernel_nl_batch_reset(struct kernel_nl_batch *b);
+
+void kernel_nl_batch_free(struct kernel_nl_batch *b);
+
+/*
+ * Asynchronous batches
+ *
+ * kernel_nl_batch_submit() sends a batch and returns without waiting.
+ * ACKs are collected by kernel_nl_process() when kernel_nl_fd() polls
+ * readable; once every op is answered (or the batch times out) done()
+ * runs from kernel_nl_process(), never from inside another kernel_nl
+ * call. The batch must stay alive until then, or be cancelled.
+ *
+ * A batch committed meanwhile hands ACKs that belong to in-flight
+ * batches over instead of dropping them.
+ */
+int kernel_nl_batch_submit(struct kernel_nl_batch *b,
+                           kernel_nl_done_fn done,
+                           void *arg);
+
+/* forget an in-flight batch; done() will not run */
+void kernel_nl_batch_cancel(struct kernel_nl_batch *b);
+
+/*
+ * Asynchronous dumps
+ *
+ * kernel_nl_dump_submit() sends a dump request and returns. Its parts
+ * are read like batch ACKs and passed to cb as they arrive (a negative
+ * return is kept in d->err, later parts are drained); done() runs from
+ * kernel_nl_process() once NLMSG_DONE, an error or the deadline is
+ * reached. The kernel runs one dump per socket at a time, so a second
+ * one is -EBUSY while this one is in flight.
+ */
+struct kernel_nl_dump;
+
+typedef int (*kernel_nl_dump_cb)(const struct nlmsghdr *nh, void *arg);
+typedef void (*kernel_nl_dump_done_fn)(struct kernel_nl_dump *d, void *arg);
+
+struct kernel_nl_dump {
+    uint32_t               seq;
+    int                    err;        /* 0, cb's error or negative errno */
+    bool                   finished;
+    int64_t                deadline;   /* CLOCK_MONOTONIC, ms */
+    kernel_nl_dump_cb      cb;
+    kernel_nl_dump_done_fn done;
+    void                   *arg;
+};
+
+int kernel_nl_dump_submit(struct kernel_nl_dump *d,
+                          struct kernel_nl_req *req,
+                          kernel_nl_dump_cb cb,
+                          kernel_nl_dump_done_fn done,
+                          void *arg);
+
+/* forget an in-flight dump; done() will not run */
+void kernel_nl_dump_cancel(struct kernel_nl_dump *d);
+
+/* request socket for poll(), opening it if needed; -errno on failure */
+int kernel_nl_fd(void);
+
+/* read what is available, expire overdue work, run done() callbacks */
+void kernel_nl_process(void);
+
+/* poll() timeout in ms until kernel_nl_process() has work, -1 if none */
+int kernel_nl_timeout(void);
+
+void kernel_nl_close(void);
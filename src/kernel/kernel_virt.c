@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <net/if.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/veth.h>
+
+#include "kernel_virt.h"
+#include "kernel_nl.h"
+
+/*
+ * Common head of every creation: name, IFF_UP and an open
+ * IFLA_LINKINFO carrying the kind. Returns the LINKINFO nest, or NULL
+ * if the request buffer is full.
+ */
+static struct rtattr *create_begin(struct kernel_nl_req *req,
+                                   const char *name,
+                                   const char *kind)
+{
+    struct ifinfomsg *ifm =
+        kernel_nl_init(req, RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL,
+                       sizeof(*ifm));
+    ifm->ifi_family = AF_UNSPEC;
+    ifm->ifi_flags  = IFF_UP;
+    ifm->ifi_change = IFF_UP;
+
+    if (!kernel_nl_put_str(req, IFLA_IFNAME, name))
+        return NULL;
+
+    struct rtattr *li = kernel_nl_nest(req, IFLA_LINKINFO);
+    if (!li || !kernel_nl_put_str(req, IFLA_INFO_KIND, kind))
+        return NULL;
+
+    return li;
+}
+
+int kernel_virt_batch_vlan(struct kernel_nl_batch *b,
+                           const char *name,
+                           int parent_ifindex,
+                           uint16_t vid,
+                           void *ctx)
+{
+    struct kernel_nl_req req;
+
+    struct rtattr *li = create_begin(&req, name, "vlan");
+    if (!li)
+        return -ENOBUFS;
+
+    struct rtattr *data = kernel_nl_nest(&req, IFLA_INFO_DATA);
+    if (!data || !kernel_nl_put_u16(&req, IFLA_VLAN_ID, vid))
+        return -ENOBUFS;
+    kernel_nl_nest_end(&req, data);
+    kernel_nl_nest_end(&req, li);
+
+    /* IFLA_LINK sits at the top level, after the nest */
+    if (!kernel_nl_put_u32(&req, IFLA_LINK, (uint32_t)parent_ifindex))
+        return -ENOBUFS;
+
+    return kernel_nl_batch_add(b, &req, ctx);
+}
+
+int kernel_virt_batch_veth(struct kernel_nl_batch *b,
+                           const char *name,
+                           const char *peer,
+                           void *ctx)
+{
+    struct kernel_nl_req req;
+
+    struct rtattr *li = create_begin(&req, name, "veth");
+    if (!li)
+        return -ENOBUFS;
+
+    struct rtattr *data = kernel_nl_nest(&req, IFLA_INFO_DATA);
+    if (!data)
+        return -ENOBUFS;
+
+    /*
+     * The peer is described by its own ifinfomsg + attributes. It is
+     * opened before the pair is linked, where veth refuses IFF_UP
+     * (ENOTCONN), so it stays down: it is the peer node's to raise.
+     */
+    struct ifinfomsg pifm = { .ifi_family = AF_UNSPEC };
+
+    struct rtattr *pi = kernel_nl_put(&req, VETH_INFO_PEER,
+                                      &pifm, sizeof(pifm));
+    if (!pi || !kernel_nl_put_str(&req, IFLA_IFNAME, peer))
+        return -ENOBUFS;
+    kernel_nl_nest_end(&req, pi);
+
+    kernel_nl_nest_end(&req, data);
+    kernel_nl_nest_end(&req, li);
+
+    return kernel_nl_batch_add(b, &req, ctx);
+}
+
+int kernel_virt_batch_bond(struct kernel_nl_batch *b,
+                           const char *name,
+                           const struct kernel_bond_opts *opts,
+                           void *ctx)
+{
+    struct kernel_nl_req req;
+
+    struct rtattr *li = create_begin(&req, name, "bond");
+    if (!li)
+        return -ENOBUFS;
+
+    if (opts && (opts->mode >= 0 || opts->miimon)) {
+        struct rtattr *data = kernel_nl_nest(&req, IFLA_INFO_DATA);
+        if (!data)
+            return -ENOBUFS;
+
+        if (opts->mode >= 0 &&
+            !kernel_nl_put_u8(&req, IFLA_BOND_MODE, (uint8_t)opts->mode))
+            return -ENOBUFS;
+
+        if (opts->miimon &&
+            !kernel_nl_put_u32(&req, IFLA_BOND_MIIMON, opts->miimon))
+            return -ENOBUFS;
+
+        kernel_nl_nest_end(&req, data);
+    }
+
+    kernel_nl_nest_end(&req, li);
+
+    return kernel_nl_batch_add(b, &req, ctx);
+}
@@ -0,0 +1,40 @@
+// src/kernel/kernel_virt.h
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Virtual link creation
+ *
+ * Each builder queues exactly one RTM_NEWLINK (NLM_F_CREATE |
+ * NLM_F_EXCL) that creates the link with its kind-specific
+ * IFLA_INFO_DATA and IFF_UP, so a whole activation wave of links can
+ * share one batch. Callers check the link cache first: an existing
+ * link is only brought up, never recreated.
+ */
+
+struct kernel_nl_batch;
+
+/* 802.1Q subinterface name on parent_ifindex */
+int kernel_virt_batch_vlan(struct kernel_nl_batch *b,
+                           const char *name,
+                           int parent_ifindex,
+                           uint16_t vid,
+                           void *ctx);
+
+/* veth pair; only name comes up, peer is left down */
+int kernel_virt_batch_veth(struct kernel_nl_batch *b,
+                           const char *name,
+                           const char *peer,
+                           void *ctx);
+
+struct kernel_bond_opts {
+    int      mode;      /* BOND_MODE_*, -1: kernel default */
+    uint32_t miimon;    /* ms, 0: kernel default */
+};
+
+int kernel_virt_batch_bond(struct kernel_nl_batch *b,
+                           const char *name,
+                           const struct kernel_bond_opts *opts,
+                           void *ctx);
@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "l2.h"
+
+#define VID_WORD(v) ((v) / 64)
+#define VID_BIT(v)  ((uint64_t)1 << ((v) % 64))
+
+/* mask of bits lo..hi (inclusive) within one word */
+static inline uint64_t bits_between(unsigned int lo, unsigned int hi)
+{
+    uint64_t upper = (hi == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (hi + 1)) - 1);
+    return upper & ~(((uint64_t)1 << lo) - 1);
+}
+
+void l2_vlan_set_clear(struct l2_vlan_set *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+int l2_vlan_set_add_range(struct l2_vlan_set *s,
+                          uint16_t first,
+                          uint16_t last,
+                          bool tagged,
+                          bool pvid)
+{
+    if (!l2_vid_valid(first) || !l2_vid_valid(last) || first > last)
+        return -1;
+
+    /* a single VLAN is the ingress default; a range cannot be */
+    if (pvid && first != last)
+        return -1;
+
+    for (unsigned int w = VID_WORD(first); w <= VID_WORD(last); w++) {
+        unsigned int lo = (w == VID_WORD(first)) ? first % 64 : 0;
+        unsigned int hi = (w == VID_WORD(last))  ? last % 64  : 63;
+        uint64_t m = bits_between(lo, hi);
+
+        s->member[w] |= m;
+        if (tagged)
+            s->tagged[w] |= m;
+        else
+            s->tagged[w] &= ~m;
+        if (pvid)
+            s->pvid[w] |= m;
+        else
+            s->pvid[w] &= ~m;
+    }
+
+    return 0;
+}
+
+size_t l2_vlan_set_count(const struct l2_vlan_set *s)
+{
+    size_t n = 0;
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++)
+        n += (size_t)__builtin_popcountll(s->member[w]);
+    return n;
+}
+
+size_t l2_vlan_set_pvid_count(const struct l2_vlan_set *s)
+{
+    size_t n = 0;
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++)
+        n += (size_t)__builtin_popcountll(s->pvid[w]);
+    return n;
+}
+
+bool l2_vlan_set_subset(const struct l2_vlan_set *a,
+                        const struct l2_vlan_set *b)
+{
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++)
+        if (a->member[w] & ~b->member[w])
+            return false;
+    return true;
+}
+
+bool l2_vlan_set_valid(const struct l2_vlan_set *s)
+{
+    uint64_t reserved_lo = VID_BIT(0);
+    uint64_t reserved_hi = VID_BIT(4095);
+
+    if ((s->member[0] & reserved_lo) ||
+        (s->member[L2_VLAN_WORDS - 1] & reserved_hi))
+        return false;
+
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++) {
+        if ((s->tagged[w] | s->pvid[w]) & ~s->member[w])
+            return false;
+    }
+
+    return l2_vlan_set_pvid_count(s) <= 1;
+}
+
+uint16_t l2_vlan_set_first_untagged(const struct l2_vlan_set *s)
+{
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++) {
+        uint64_t m = s->member[w] & ~s->tagged[w];
+        if (m)
+            return (uint16_t)(w * 64 + (unsigned int)__builtin_ctzll(m));
+    }
+    return 0;
+}
+
+void l2_vlan_set_diff(const struct l2_vlan_set *want,
+                      const struct l2_vlan_set *have,
+                      struct l2_vlan_set *add,
+                      struct l2_vlan_set *del)
+{
+    for (unsigned int w = 0; w < L2_VLAN_WORDS; w++) {
+        uint64_t changed = ~have->member[w] |
+                           (want->tagged[w] ^ have->tagged[w]) |
+                           (want->pvid[w] ^ have->pvid[w]);
+        uint64_t m = want->member[w] & changed;
+
+        add->member[w] = m;
+        add->tagged[w] = want->tagged[w] & m;
+        add->pvid[w]   = want->pvid[w] & m;
+
+        del->member[w] = have->member[w] & ~want->member[w];
+        del->tagged[w] = 0;
+        del->pvid[w]   = 0;
+    }
+}
+
+/*
+ * First VID >= from that is a member (want_member), or that breaks a
+ * run with the given flags (not a member, or tagged/pvid differ).
+ * Returns 4096 when none is found.
+ */
+static unsigned int scan(const uint64_t *member,
+                         const uint64_t *tagged,
+                         const uint64_t *pvid,
+                         uint64_t tmask,
+                         uint64_t pmask,
+                         bool want_member,
+                         unsigned int from)
+{
+    while (from < 4096) {
+        unsigned int w = VID_WORD(from);
+        uint64_t m;
+
+        if (want_member)
+            m = member[w];
+        else
+            m = ~member[w] | (tagged[w] ^ tmask) | (pvid[w] ^ pmask);
+
+        m &= ~(VID_BIT(from) - 1);
+        if (m)
+            return w * 64 + (unsigned int)__builtin_ctzll(m);
+
+        from = (w + 1) * 64;
+    }
+    return 4096;
+}
+
+bool l2_vlan_set_next_range(const struct l2_vlan_set *s,
+                            unsigned int *vid,
+                            struct l2_vlan_range *r)
+{
+    unsigned int first = scan(s->member, NULL, NULL, 0, 0, true, *vid);
+    if (first >= 4096) {
+        *vid = 4096;
+        return false;
+    }
+
+    uint64_t bit = VID_BIT(first);
+    bool tagged  = (s->tagged[VID_WORD(first)] & bit) != 0;
+    bool pvid    = (s->pvid[VID_WORD(first)] & bit) != 0;
+
+    unsigned int end = scan(s->member, s->tagged, s->pvid,
+                            tagged ? ~(uint64_t)0 : 0,
+                            pvid ? ~(uint64_t)0 : 0,
+                            false, first + 1);
+
+    r->first  = (uint16_t)first;
+    r->last   = (uint16_t)(end - 1);
+    r->tagged = tagged;
+    r->pvid   = pvid;
+
+    *vid = end;
+    return true;
+}
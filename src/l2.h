@@ -3,10 +3,95 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-struct l2_vlan {
-    uint16_t vid;
+/*
+ * VLAN sets
+ *
+ * Bridge and bridge-port VLAN intent is kept as three 4096-bit maps
+ * indexed by VID. Inheritance, overrides and validation are whole-word
+ * operations, independent of how many VLANs a trunk carries.
+ *
+ *   member  VID is configured
+ *   tagged  egress tagged (subset of member)
+ *   pvid    ingress default VLAN (subset of member)
+ *
+ * VIDs 0 and 4095 are reserved and never set.
+ */
+
+#define L2_VID_MIN    1
+#define L2_VID_MAX    4094
+#define L2_VLAN_WORDS (4096 / 64)
+
+struct l2_vlan_set {
+    uint64_t member[L2_VLAN_WORDS];
+    uint64_t tagged[L2_VLAN_WORDS];
+    uint64_t pvid[L2_VLAN_WORDS];
+};
+
+/* a run of consecutive VIDs with identical flags */
+struct l2_vlan_range {
+    uint16_t first;
+    uint16_t last;
     bool     tagged;
     bool     pvid;
-    struct l2_vlan *next;
 };
+
+static inline bool l2_vid_valid(unsigned int vid)
+{
+    return vid >= L2_VID_MIN && vid <= L2_VID_MAX;
+}
+
+static inline bool l2_vlan_set_has(const struct l2_vlan_set *s, uint16_t vid)
+{
+    return (s->member[vid / 64] >> (vid % 64)) & 1;
+}
+
+void l2_vlan_set_clear(struct l2_vlan_set *s);
+
+/* add VIDs first..last with the given flags; -1 on an invalid range */
+int l2_vlan_set_add_range(struct l2_vlan_set *s,
+                          uint16_t first,
+                          uint16_t last,
+                          bool tagged,
+                          bool pvid);
+
+static inline int l2_vlan_set_add(struct l2_vlan_set *s,
+                                  uint16_t vid,
+                                  bool tagged,
+                                  bool pvid)
+{
+    return l2_vlan_set_add_range(s, vid, vid, tagged, pvid);
+}
+
+size_t l2_vlan_set_count(const struct l2_vlan_set *s);
+size_t l2_vlan_set_pvid_count(const struct l2_vlan_set *s);
+
+/* true if every member VID of a is also a member of b */
+bool l2_vlan_set_subset(const struct l2_vlan_set *a,
+                        const struct l2_vlan_set *b);
+
+/* structural checks: reserved VIDs, flags outside member, >1 pvid */
+bool l2_vlan_set_valid(const struct l2_vlan_set *s);
+
+/* lowest VID matching member & ~tagged, 0 if none */
+uint16_t l2_vlan_set_first_untagged(const struct l2_vlan_set *s);
+
+/*
+ * Reconcile have towards want: add gets every VID of want that is
+ * missing from have or carries different flags (with want's flags),
+ * del gets every VID of have that want does not name.
+ */
+void l2_vlan_set_diff(const struct l2_vlan_set *want,
+                      const struct l2_vlan_set *have,
+                      struct l2_vlan_set *add,
+                      struct l2_vlan_set *del);
+
+/*
+ * Range iteration: start with *vid = 0; each call yields the next
+ * maximal run of members with uniform flags and advances *vid.
+ * Returns false when the set is exhausted.
+ */
+bool l2_vlan_set_next_range(const struct l2_vlan_set *s,
+                            unsigned int *vid,
+                            struct l2_vlan_range *r);
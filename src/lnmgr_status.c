@@ -8,6 +8,8 @@
  * - disabled always wins
  * - admin-down always wins over graph readiness
  * - failed is sticky
+ * - in-flight kernel writes => WAITING/pending
+ * - a link that does not exist yet => WAITING/absent
  * - any explain != NONE => WAITING
  * - NONE => UP
  */
@@ -39,6 +41,18 @@ lnmgr_status_from_graph(const struct explain *gex, bool admin_up)
         return out;
     }
 
+    if (gex->type == EXPLAIN_PENDING) {
+        out.status = LNMGR_STATUS_WAITING;
+        out.code   = LNMGR_CODE_PENDING;
+        return out;
+    }
+
+    if (gex->type == EXPLAIN_ABSENT) {
+        out.status = LNMGR_STATUS_WAITING;
+        out.code   = LNMGR_CODE_ABSENT;
+        return out;
+    }
+
     if (gex->type != EXPLAIN_NONE) {
         out.status = LNMGR_STATUS_WAITING;
         out.code   = LNMGR_CODE_SIGNAL;
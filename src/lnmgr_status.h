@@ -27,6 +27,8 @@ typedef enum {
     LNMGR_CODE_BLOCKED,
     LNMGR_CODE_SIGNAL,
     LNMGR_CODE_FAILED,
+    LNMGR_CODE_PENDING,
+    LNMGR_CODE_ABSENT,
     LNMGR_CODE_UNKNOWN,
 } lnmgr_code_t;
 
@@ -55,6 +55,9 @@
 #include "socket.h"
 #include "signal/signal_netlink.h"
 #include "signal/signal_nl80211.h"
+#include "signal/signal_addr.h"
+#include "kernel/kernel_nl.h"
+#include "kernel/kernel_cache.h"
 
 #define LNMGR_SOCKET_PATH "/run/lnmgr.sock"
 
@@ -110,6 +113,16 @@ static void setup_signals(void)
     signal(SIGPIPE, SIG_IGN);
 }
 
+/* the earlier of two poll() timeouts, -1 meaning none */
+static int min_timeout(int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
 int main(int argc, char **argv)
 {
     if (argc != 2) {
@@ -134,11 +147,13 @@ int main(int argc, char **argv)
     if (graph_prepare(g) < 0) {
         fprintf(stderr, "invalid configuration\n");
 
-        /* mark all enabled nodes as FAILED(TOPOLOGY) */
-        for (struct node *n = g->nodes; n; n = n->next) {
+        /* mark all enabled nodes as FAILED, keeping specific reasons */
+        for (size_t i = 0; i < g->count; i++) {
+            struct node *n = g->vec[i];
             if (n->enabled) {
                 n->state = NODE_FAILED;
-                n->fail_reason = FAIL_TOPOLOGY;
+                if (n->fail_reason == FAIL_NONE)
+                    n->fail_reason = FAIL_TOPOLOGY;
             }
         }
     }
@@ -148,6 +163,7 @@ int main(int argc, char **argv)
     int ctl_fd  = socket_listen(LNMGR_SOCKET_PATH);
     int nl_fd   = signal_netlink_fd();
     int wifi_fd = signal_nl80211_fd();
+    int addr_fd = signal_addr_fd();
 
     if (ctl_fd < 0 || nl_fd < 0) {
         perror("initialization failed");
@@ -155,21 +171,29 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    /* establish initial facts */
-    signal_netlink_sync(g);
-    // signal_nl80211_sync(g); /* optional later */
+    /* establish initial facts; the dump completes in the event loop */
+    if (signal_netlink_sync(g) < 0) {
+        perror("initial link dump");
+        graph_destroy(g);
+        return 1;
+    }
+    signal_nl80211_sync(g);
+    signal_addr_sync(g);
 
-    /* ---------- initial evaluation (AUTO + config) ---------- */
+    /* initial evaluation (AUTO + config) once the links are known */
+    bool pending = true;
 
-    graph_evaluate(g);
-    socket_notify_subscribers(g, /* admin_up = */ true);
+    /* address and wifi signals follow link bindings and admin state */
+    unsigned int links_seen = g->links_gen;
+    bool links_moved = true;
 
     printf("lnmgrd: configuration loaded, running (Ctrl+C to exit)\n");
 
     /* ---------- main event loop ---------- */
     while (running) {
-        struct pollfd pfds[4];
+        struct pollfd pfds[6];
         nfds_t nfds = 0;
+        int kfd = kernel_nl_fd();
 
         pfds[nfds++] = (struct pollfd){
             .fd     = sigpipe[0],
@@ -188,12 +212,29 @@ int main(int argc, char **argv)
             };
         }
 
+        if (addr_fd >= 0) {
+            pfds[nfds++] = (struct pollfd){
+                .fd     = addr_fd,
+                .events = POLLIN | POLLERR | POLLHUP,
+            };
+        }
+
+        /* acks for submitted kernel actions */
+        if (kfd >= 0) {
+            pfds[nfds++] = (struct pollfd){
+                .fd     = kfd,
+                .events = POLLIN,
+            };
+        }
+
         pfds[nfds++] = (struct pollfd){
             .fd     = ctl_fd,
             .events = POLLIN | POLLERR | POLLHUP,
         };
 
-        int rc = poll(pfds, nfds, -1);
+        int rc = poll(pfds, nfds,
+                      min_timeout(kernel_nl_timeout(),
+                                  signal_netlink_timeout()));
         if (rc < 0) {
             if (errno == EINTR)
                 continue;
@@ -216,33 +257,53 @@ int main(int argc, char **argv)
         i++;
 
         /* ---------- rtnetlink ---------- */
-        if (pfds[i].revents & POLLIN) {
+        /* POLLERR is a pending overrun: reading reports and handles it */
+        if (pfds[i].revents & (POLLIN | POLLERR)) {
             DPRINTF("poll nl_fd=%d\n", nl_fd);
-            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
-                nl_activity = signal_netlink_handle(g);
-                changed |= nl_activity;
-            }
+            nl_activity = signal_netlink_handle(g);
+            changed |= nl_activity;
         }
 
-        if (pfds[i].revents & (POLLERR | POLLHUP)) {
-            DPRINTF("netlink error → resync\n");
+        if (pfds[i].revents & POLLHUP) {
+            DPRINTF("netlink hangup → resync\n");
             signal_netlink_sync(g);
             changed = true;
         }
         i++;
 
+        /* rate-limited resync after lost notifications */
+        signal_netlink_tick(g);
+
         /* ---------- nl80211 ---------- */
         if (wifi_fd >= 0) {
-            if (pfds[i].revents & POLLIN)
+            if (pfds[i].revents & (POLLIN | POLLERR))
                 changed |= signal_nl80211_handle(g);
 
-            if (pfds[i].revents & (POLLERR | POLLHUP)) {
+            if (pfds[i].revents & POLLHUP) {
                 signal_nl80211_sync(g);
                 changed = true;
             }
             i++;
         }
 
+        /* ---------- addresses / routes ---------- */
+        if (addr_fd >= 0) {
+            if (pfds[i].revents & (POLLIN | POLLERR))
+                changed |= signal_addr_handle(g);
+
+            if (pfds[i].revents & POLLHUP) {
+                signal_addr_sync(g);
+                changed = true;
+            }
+            i++;
+        }
+
+        /* ---------- kernel action acks (and timeouts) ---------- */
+        if (kfd >= 0)
+            i++;
+        kernel_nl_process();
+        changed |= graph_complete_actions(g);
+
         /* ---------- control socket ---------- */
         if (pfds[i].revents & POLLIN) {
             int cfd = accept(ctl_fd, NULL, NULL);
@@ -274,16 +335,38 @@ int main(int argc, char **argv)
         }
 
         /* ---------- evaluate + notify ONCE ---------- */
-        if (changed || nl_activity) {
+        if (changed || nl_activity)
+            pending = true;
+
+        /* links moved: addresses, routes and wifi state follow them */
+        if (nl_activity || g->links_gen != links_seen)
+            links_moved = true;
+
+        if (links_moved && !signal_netlink_syncing()) {
+            pending |= signal_addr_refresh(g);
+            pending |= signal_nl80211_refresh(g);
+            links_seen  = g->links_gen;
+            links_moved = false;
+        }
+
+        /* not on a half-dumped link view */
+        if (pending && !signal_netlink_syncing()) {
             graph_evaluate(g);
             socket_notify_subscribers(g, true);
+            pending = false;
         }
     }    
     printf("lnmgrd: shutting down\n");
 
+    /* take managed links down while the kernel channel is still open */
+    graph_flush(g);
+
     socket_close(ctl_fd, LNMGR_SOCKET_PATH);
     signal_netlink_close();
     signal_nl80211_close();
+    signal_addr_close();
+    kernel_nl_close();
+    kernel_cache_flush();
     graph_destroy(g);
 
     return 0;
@@ -19,6 +19,7 @@ static const struct node_kind_desc kind_table[] = {
     { KIND_LINK_GRE,       "gre",        NODE_LINK, NKF_PRODUCES_L3 },
     { KIND_LINK_VTI,       "vti",        NODE_LINK, NKF_PRODUCES_L3 },
     { KIND_LINK_XFRM,      "xfrm",       NODE_LINK, NKF_PRODUCES_L3 },
+    { KIND_LINK_VETH,      "veth",       NODE_LINK, NKF_PRODUCES_L2 },
 
     /* ---------------- L2 ---------------- */
     { KIND_L2_BRIDGE,      "bridge",     NODE_L2_AGGREGATE,
@@ -75,6 +76,22 @@ static int feat_bridge_port_resolve(struct graph *g,
                                     struct node *n,
                                     struct node_feature *f);
 
+static int feat_vlan_domain_validate(struct graph *g,
+                                     struct node *n,
+                                     struct node_feature *f);
+
+static int feat_vlan_domain_resolve(struct graph *g,
+                                    struct node *n,
+                                    struct node_feature *f);
+
+static int feat_veth_validate(struct graph *g,
+                              struct node *n,
+                              struct node_feature *f);
+
+static int feat_veth_resolve(struct graph *g,
+                             struct node *n,
+                             struct node_feature *f);
+
 static const struct node_feature_ops feature_ops[] = {
     {
         .type     = FEAT_MASTER,
@@ -97,6 +114,27 @@ static const struct node_feature_ops feature_ops[] = {
         .resolve  = feat_bridge_port_resolve,
         .cap_check = NULL,
     },
+    {
+        .type     = FEAT_VLAN_DOMAIN,
+        .name     = "vlan",
+        .validate = feat_vlan_domain_validate,
+        .resolve  = feat_vlan_domain_resolve,
+        .cap_check = NULL,
+    },
+    {
+        .type     = FEAT_VETH,
+        .name     = "veth",
+        .validate = feat_veth_validate,
+        .resolve  = feat_veth_resolve,
+        .cap_check = NULL,
+    },
+    {
+        .type     = FEAT_BOND,
+        .name     = "bond",
+        .validate = NULL,
+        .resolve  = NULL,
+        .cap_check = NULL,
+    },
 };
 
 
@@ -199,24 +237,8 @@ static int feat_bridge_validate(struct graph *g,
             return FAIL_TOPOLOGY;
     }
 
-    bool seen_pvid = false;
-
-    for (struct l2_vlan *v = fb->vlans; v; v = v->next) {
-        if (v->vid < 1 || v->vid > 4094)
-            return FAIL_TOPOLOGY;
-
-        if (v->pvid) {
-            if (seen_pvid)
-                return FAIL_TOPOLOGY;
-            seen_pvid = true;
-        }
-
-        /* Duplicate VID check */
-        for (struct l2_vlan *u = fb->vlans; u != v; u = u->next) {
-            if (u->vid == v->vid)
-                return FAIL_TOPOLOGY;
-        }
-    }
+    if (fb->vlans && !l2_vlan_set_valid(fb->vlans))
+        return FAIL_TOPOLOGY;
 
     return 0;
 }
@@ -245,24 +267,8 @@ static int feat_bridge_port_validate(struct graph *g,
     if (!node_feature_find(n, FEAT_MASTER))
         return FAIL_TOPOLOGY;
 
-    bool seen_pvid = false;
-
-    for (struct l2_vlan *v = bp->vlans; v; v = v->next) {
-        if (v->vid < 1 || v->vid > 4094)
-            return FAIL_TOPOLOGY;
-
-        if (v->pvid) {
-            if (seen_pvid)
-                return FAIL_TOPOLOGY;
-            seen_pvid = true;
-        }
-
-        /* Duplicate VID check */
-        for (struct l2_vlan *u = bp->vlans; u != v; u = u->next) {
-            if (u->vid == v->vid)
-                return FAIL_TOPOLOGY;
-        }
-    }
+    if (bp->vlans && !l2_vlan_set_valid(bp->vlans))
+        return FAIL_TOPOLOGY;
 
     return 0;
 }
@@ -288,15 +294,72 @@ static int feat_bridge_port_resolve(struct graph *g,
     n->topo.is_bridge_port = true;
     n->topo.vlans          = ((struct feat_bridge_port *)f)->vlans;
 
+    /* an ethernet/wifi link enslaved to a bridge acts as its port */
+    n->actions = action_ops_for_kind(KIND_L2_BRIDGE_PORT);
+
+    return 0;
+}
+
+static int feat_vlan_domain_validate(struct graph *g,
+                                     struct node *n,
+                                     struct node_feature *f)
+{
+    (void)g;
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)f;
+
+    if (!l2_vid_valid(fv->vid))
+        return FAIL_TOPOLOGY;
+
+    if (!fv->parent_id || !fv->parent_id[0] ||
+        strcmp(fv->parent_id, n->id) == 0)
+        return FAIL_TOPOLOGY;
+
+    return 0;
+}
+
+static int feat_vlan_domain_resolve(struct graph *g,
+                                    struct node *n,
+                                    struct node_feature *f)
+{
+    (void)n;
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)f;
+
+    /* a parent outside the graph is looked up in the kernel by name */
+    fv->parent = graph_find_node(g, fv->parent_id);
+    return 0;
+}
+
+static int feat_veth_validate(struct graph *g,
+                              struct node *n,
+                              struct node_feature *f)
+{
+    (void)g;
+    struct feat_veth *fv = (struct feat_veth *)f;
+
+    if (!fv->peer || !fv->peer[0] || strcmp(fv->peer, n->id) == 0)
+        return FAIL_TOPOLOGY;
+
+    return 0;
+}
+
+static int feat_veth_resolve(struct graph *g,
+                             struct node *n,
+                             struct node_feature *f)
+{
+    (void)n;
+    struct feat_veth *fv = (struct feat_veth *)f;
+
+    fv->peer_node = graph_find_node(g, fv->peer);
     return 0;
 }
 
-void node_on_present(struct node *n)
+void node_on_present(struct graph *g, struct node *n)
 {
     if (n->present)
         return;   /* no edge */
 
     n->present = true;
+    graph_mark_dirty(g, n);
 
     /*
      * New lifecycle starts.
@@ -304,6 +367,7 @@ void node_on_present(struct node *n)
      */
     n->auto_latched = false;
     n->activated    = false;
+    n->activating   = false;
 
     /*
      * DO NOT touch n->state here.
@@ -312,12 +376,13 @@ void node_on_present(struct node *n)
      */
 }
 
-void node_on_absent(struct node *n)
+void node_on_absent(struct graph *g, struct node *n)
 {
     if (!n->present)
         return;   /* no edge */
 
     n->present = false;
+    graph_mark_dirty(g, n);
 
     /*
      * Lifecycle ends.
@@ -325,5 +390,6 @@ void node_on_absent(struct node *n)
      */
     n->auto_latched = false;
     n->activated    = false;
+    n->activating   = false;
     n->state        = NODE_INACTIVE;
 }
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "l2.h"
+
 struct graph;
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
@@ -31,6 +33,7 @@ typedef enum {
     KIND_LINK_GRE,
     KIND_LINK_VTI,
     KIND_LINK_XFRM,
+    KIND_LINK_VETH,
 
     /* L2 */
     KIND_L2_BRIDGE,
@@ -100,6 +103,10 @@ typedef enum {
     /* DSA / switch specifics (optional, later) */
     FEAT_DSA_PORT,       /* marks link as DSA port, cpu/user, switch id, etc. */
 
+    /* Virtual links lnmgrd creates itself */
+    FEAT_VETH,           /* veth pair: the peer's name */
+    FEAT_BOND,           /* bond instance settings */
+
     FEAT_MAX
 } node_feature_type_t;
 
@@ -109,14 +116,6 @@ struct node_feature {
     struct node_feature    *next;
 };
 
-struct l2_vlan {
-    uint16_t vid;        /* 1..4094 */
-    bool     tagged;     /* false => untagged */
-    bool     pvid;       /* ingress default VLAN */
-    bool     inherited;   /* true if inherited from bridge */
-    struct l2_vlan *next;
-};
-
 struct feat_master {
     struct node_feature base;
 
@@ -132,14 +131,18 @@ struct feat_bridge {
 
     /* vlan filtering + default behavior (you can add knobs later) */
     bool vlan_filtering;        /* default true for vlan-aware */
-    struct l2_vlan *vlans;      /* bridge-wide allowed VLANs / membership */
+    uint16_t default_pvid;      /* 0: kernel default */
+    struct l2_vlan_set *vlans;  /* bridge-wide allowed VLANs, NULL = any */
 };
 
 struct feat_bridge_port {
     struct node_feature base;
 
     /* per-port membership within the master bridge */
-    struct l2_vlan *vlans;      /* tagged/untagged/pvid per VID */
+    struct l2_vlan_set *vlans;     /* tagged/untagged/pvid per VID */
+
+    /* bridge VLANs + port overrides, rebuilt on each resolve */
+    struct l2_vlan_set *resolved;
 };
 
 struct feat_vlan_domain {
@@ -148,6 +151,24 @@ struct feat_vlan_domain {
     /* e.g. “lan1.100” semantics if you want a node representing a VLAN device */
     uint16_t vid;
     bool     reorder_hdr; /* placeholder / future */
+
+    /* 802.1Q subinterface: lower link by name; a node if the graph has one */
+    char        *parent_id;
+    struct node *parent;
+};
+
+struct feat_veth {
+    struct node_feature base;
+
+    char *peer;                /* kernel name of the other end */
+    struct node *peer_node;    /* resolved, if the graph has it */
+};
+
+struct feat_bond {
+    struct node_feature base;
+
+    int      mode;             /* BOND_MODE_*, -1: kernel default */
+    uint32_t miimon;           /* ms, 0: kernel default */
 };
 
 struct feat_dsa_port {
@@ -195,7 +216,7 @@ struct node_topology {
     bool is_bridge_port;
 
     /* VLANs (resolved intent) */
-    struct l2_vlan *vlans;      /* bridge-wide or per-port */
+    struct l2_vlan_set *vlans;  /* bridge-wide or per-port */
 };
 
 /* ---------- descriptor ---------- */
@@ -228,9 +249,9 @@ const struct node_kind_desc *node_kind_lookup(node_kind_t kind);
 
 const struct node_kind_desc *node_kind_lookup_name(const char *name);
 
-void node_on_present(struct node *n);
+void node_on_present(struct graph *g, struct node *n);
 
-void node_on_absent(struct node *n);
+void node_on_absent(struct graph *g, struct node *n);
 
 
 #endif /* LNMGR_NODE_H */
\ No newline at end of file
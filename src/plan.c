@@ -0,0 +1,297 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "plan.h"
+#include "kernel/kernel_cache.h"
+
+void plan_init(struct plan *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+void plan_reset(struct plan *p)
+{
+    p->n = 0;
+}
+
+void plan_free(struct plan *p)
+{
+    free(p->ops);
+    free(p->by_key);
+    plan_init(p);
+}
+
+struct plan_op *plan_add(struct plan *p,
+                         plan_op_type_t type,
+                         int ifindex,
+                         const char *name)
+{
+    if (p->n == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 64;
+        struct plan_op **by_key = realloc(p->by_key, cap * sizeof(*by_key));
+        if (!by_key)
+            return NULL;
+        p->by_key = by_key;
+
+        struct plan_op *ops = realloc(p->ops, cap * sizeof(*ops));
+        if (!ops)
+            return NULL;
+        p->ops = ops;
+        p->cap = cap;
+    }
+
+    struct plan_op *op = &p->ops[p->n];
+    memset(op, 0, sizeof(*op));
+    op->type    = type;
+    op->ifindex = ifindex;
+    op->name    = name;
+    op->seq     = p->n++;
+    return op;
+}
+
+int plan_add_vlans(struct plan *p,
+                   plan_op_type_t type,
+                   int ifindex,
+                   const char *name,
+                   const struct l2_vlan_set *set)
+{
+    struct l2_vlan_range vr;
+    unsigned int from = 0;
+
+    while (l2_vlan_set_next_range(set, &from, &vr)) {
+        struct plan_op *op = plan_add(p, type, ifindex, name);
+        if (!op)
+            return -1;
+
+        op->first  = vr.first;
+        op->last   = vr.last;
+        op->tagged = vr.tagged;
+        op->pvid   = vr.pvid;
+    }
+
+    return 0;
+}
+
+bool plan_claim(struct plan *p, size_t first,
+                struct node *n, unsigned int gen)
+{
+    for (size_t i = first; i < p->n; i++) {
+        p->ops[i].node = n;
+        p->ops[i].gen  = gen;
+    }
+
+    return p->n > first;
+}
+
+/* ---- optimizer ---- */
+
+/* 0: teardown, 1: creation, 2: changes to existing links */
+static int op_class(const struct plan_op *op)
+{
+    switch (op->type) {
+    case PLAN_DOWN:   return 0;
+    case PLAN_CREATE: return 1;
+    default:          return 2;
+    }
+}
+
+/* teardown keeps its recorded (reverse rank) order */
+static int op_group(const struct plan_op *op)
+{
+    return op_class(op) == 2 ? op->ifindex : 0;
+}
+
+static int op_cmp(const void *a, const void *b)
+{
+    const struct plan_op *x = a, *y = b;
+    int cx = op_class(x), cy = op_class(y);
+
+    if (cx != cy)
+        return cx < cy ? -1 : 1;
+
+    int gx = op_group(x), gy = op_group(y);
+    if (gx != gy)
+        return gx < gy ? -1 : 1;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int cmp_int(long a, long b)
+{
+    return (a > b) - (a < b);
+}
+
+/* what an op does, then when it was recorded */
+static int op_key_cmp(const void *a, const void *b)
+{
+    const struct plan_op *x = *(const struct plan_op *const *)a;
+    const struct plan_op *y = *(const struct plan_op *const *)b;
+    int c;
+
+    if ((c = cmp_int(x->type, y->type)) ||
+        (c = cmp_int(x->ifindex, y->ifindex)) ||
+        (c = cmp_int(x->arg, y->arg)) ||
+        (c = cmp_int(x->first, y->first)) ||
+        (c = cmp_int(x->last, y->last)) ||
+        (c = cmp_int(x->tagged, y->tagged)) ||
+        (c = cmp_int(x->pvid, y->pvid)))
+        return c;
+
+    if (x->type == PLAN_CREATE &&
+        (c = strcmp(x->name ? x->name : "", y->name ? y->name : "")))
+        return c;
+
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static bool op_same(const struct plan_op *a, const struct plan_op *b)
+{
+    if (a->type != b->type ||
+        a->ifindex != b->ifindex ||
+        a->arg != b->arg ||
+        a->first != b->first ||
+        a->last != b->last ||
+        a->tagged != b->tagged ||
+        a->pvid != b->pvid)
+        return false;
+
+    if (a->type == PLAN_CREATE)
+        return a->name && b->name && strcmp(a->name, b->name) == 0;
+
+    return true;
+}
+
+/* a teardown op on ifindex runs before anything else in the plan */
+static bool taken_down(const struct plan *p, size_t teardown, int ifindex)
+{
+    for (size_t i = 0; i < teardown; i++)
+        if (p->ops[i].type == PLAN_DOWN && p->ops[i].ifindex == ifindex)
+            return true;
+    return false;
+}
+
+static void drop_cached(struct plan *p)
+{
+    size_t teardown = 0;
+
+    while (teardown < p->n && p->ops[teardown].type == PLAN_DOWN)
+        teardown++;
+
+    for (size_t i = 0; i < p->n; i++) {
+        struct plan_op *op = &p->ops[i];
+
+        if (op->type != PLAN_UP && op->type != PLAN_DOWN)
+            continue;
+
+        const struct kernel_link_info *l = kernel_cache_find(op->ifindex);
+        if (!l)
+            continue;
+
+        bool up = (l->flags & IFF_UP) != 0;
+
+        if (op->type == PLAN_DOWN && !up)
+            op->type = PLAN_NOP;
+        else if (op->type == PLAN_UP && up &&
+                 !taken_down(p, teardown, op->ifindex))
+            op->type = PLAN_NOP;
+    }
+}
+
+/*
+ * Sorted by what they do, repeats are adjacent and the earliest comes
+ * first. It is the one kept: same class and group, lower seq, so it is
+ * also lowered before any of its repeats. A creation nobody waits for
+ * is not sent and cannot stand in for one somebody does.
+ */
+static void drop_repeated(struct plan *p)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < p->n; i++)
+        if (p->ops[i].type != PLAN_NOP && p->ops[i].type != PLAN_VLAN_SYNC)
+            p->by_key[n++] = &p->ops[i];
+
+    qsort(p->by_key, n, sizeof(*p->by_key), op_key_cmp);
+
+    struct plan_op *kept = NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        struct plan_op *op = p->by_key[i];
+
+        if (kept && op_same(kept, op)) {
+            op->type = PLAN_NOP;
+            op->dup  = (size_t)(kept - p->ops) + 1;
+            continue;
+        }
+
+        kept = (op->type != PLAN_CREATE || op->node) ? op : NULL;
+    }
+}
+
+static void merge_vlans(struct plan *p)
+{
+    struct plan_op *prev = NULL;
+
+    for (size_t i = 0; i < p->n; i++) {
+        struct plan_op *op = &p->ops[i];
+
+        if (op->type == PLAN_NOP)
+            continue;
+
+        if (prev &&
+            (op->type == PLAN_VLAN_ADD || op->type == PLAN_VLAN_DEL) &&
+            prev->type == op->type &&
+            prev->ifindex == op->ifindex &&
+            prev->node == op->node &&
+            prev->gen == op->gen &&
+            !prev->pvid && !op->pvid &&
+            prev->tagged == op->tagged &&
+            prev->last + 1 == op->first) {
+            prev->last = op->last;
+            op->type = PLAN_NOP;
+            continue;
+        }
+
+        prev = op;
+    }
+}
+
+void plan_optimize(struct plan *p)
+{
+    if (p->n == 0)
+        return;
+
+    qsort(p->ops, p->n, sizeof(*p->ops), op_cmp);
+
+    drop_cached(p);
+    drop_repeated(p);
+    merge_vlans(p);
+}
+
+size_t plan_count(const struct plan *p)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < p->n; i++)
+        if (p->ops[i].type != PLAN_NOP)
+            n++;
+    return n;
+}
+
+const char *plan_op_str(plan_op_type_t type)
+{
+    switch (type) {
+    case PLAN_NOP:       return "nop";
+    case PLAN_CREATE:    return "create";
+    case PLAN_MASTER:    return "master";
+    case PLAN_UP:        return "up";
+    case PLAN_DOWN:      return "down";
+    case PLAN_VLAN_DEL:  return "vlan-del";
+    case PLAN_VLAN_ADD:  return "vlan-add";
+    case PLAN_VLAN_SYNC: return "vlan-sync";
+    }
+    return "?";
+}
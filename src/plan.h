@@ -0,0 +1,97 @@
+#ifndef LNMGR_PLAN_H
+#define LNMGR_PLAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "l2.h"
+
+/*
+ * Operation plan
+ *
+ * An evaluation pass does not talk to the kernel itself: activations
+ * and deactivations record the link operations they intend, the
+ * optimizer rewrites the list, and only then is it lowered to netlink
+ * messages and submitted (actions.c). PLAN shows the same list without
+ * sending it.
+ */
+
+struct node;
+
+typedef enum {
+    PLAN_NOP = 0,       /* optimized away; still owned */
+    PLAN_CREATE,        /* new link from the owner's kind and features */
+    PLAN_MASTER,        /* enslave ifindex to arg */
+    PLAN_UP,
+    PLAN_DOWN,
+    PLAN_VLAN_DEL,      /* bridge port VLANs first..last */
+    PLAN_VLAN_ADD,
+    PLAN_VLAN_SYNC,     /* once the above landed: re-read port VLANs */
+} plan_op_type_t;
+
+struct plan_op {
+    plan_op_type_t type;
+    int            ifindex;     /* 0 for CREATE */
+    int            arg;         /* MASTER: master, CREATE: lower link */
+    uint16_t       first;       /* VLAN ops */
+    uint16_t       last;
+    bool           tagged;
+    bool           pvid;
+    const char    *name;        /* link name */
+    const char    *master;      /* MASTER: master name */
+
+    struct node   *node;        /* owner; NULL if nobody waits for it */
+    unsigned int   gen;         /* owner's act_gen */
+    size_t         seq;         /* position when recorded */
+    size_t         dup;         /* dropped repeat: index + 1 of the op
+                                   kept in its place, 0 otherwise */
+};
+
+struct plan {
+    struct plan_op *ops;
+    size_t          n;
+    size_t          cap;
+
+    struct plan_op **by_key;    /* optimizer scratch, cap entries */
+};
+
+void plan_init(struct plan *p);
+void plan_reset(struct plan *p);
+void plan_free(struct plan *p);
+
+/* append an unowned op; NULL on allocation failure */
+struct plan_op *plan_add(struct plan *p,
+                         plan_op_type_t type,
+                         int ifindex,
+                         const char *name);
+
+/* one op per range of set; -1 on allocation failure */
+int plan_add_vlans(struct plan *p,
+                   plan_op_type_t type,
+                   int ifindex,
+                   const char *name,
+                   const struct l2_vlan_set *set);
+
+/* give ops first.. to n; false if there are none */
+bool plan_claim(struct plan *p, size_t first,
+                struct node *n, unsigned int gen);
+
+/*
+ * Rewrite the plan in place:
+ *   - teardown first, in recorded order, then creations, then the
+ *     changes to existing links grouped by ifindex
+ *   - admin state the link cache already shows is dropped
+ *   - repeated ops are dropped; the first one is kept and the others
+ *     point at it (dup), so their owners can wait for its result
+ *   - adjacent VLAN ranges with the same flags are merged
+ * Dropped ops become PLAN_NOP and keep their owner.
+ */
+void plan_optimize(struct plan *p);
+
+/* ops left after optimizing */
+size_t plan_count(const struct plan *p);
+
+const char *plan_op_str(plan_op_type_t type);
+
+#endif
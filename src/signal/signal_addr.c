@@ -0,0 +1,728 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <fcntl.h>     /* fcntl, F_GETFL, F_SETFL, O_NONBLOCK */
+#include <unistd.h>   /* close */
+#include <arpa/inet.h> /* ntohs */
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/filter.h>
+#include <asm/socket.h> /* SO_ATTACH_FILTER */
+
+#include "signal_addr.h"
+#include "graph.h"
+#include "node.h"
+#include "kernel/kernel_cache.h"
+#include "kernel/kernel_nl.h"
+
+/* private netlink socket */
+static int      nl_fd = -1;
+static uint32_t nl_portid;
+static uint32_t nl_seq;
+
+/* signals produced, resolved once at open */
+static signal_atom_t atom_ipv4  = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_ipv6  = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_route = SIGNAL_ATOM_NONE;
+
+/* datagrams of the dumps are at most 32 KiB */
+static char rxbuf[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+/* ------------------------------------------------------------ */
+/* per-ifindex cache                                            */
+
+struct addr_entry {
+    uint8_t             family;
+    uint8_t             prefixlen;
+    bool                usable;
+    uint8_t             addr[16];
+    struct addr_entry  *next;
+};
+
+/* one nexthop of a default route, out of its link */
+struct route_entry {
+    uint8_t             family;
+    uint32_t            table;
+    uint32_t            priority;
+    uint8_t             gw[16];
+    struct route_entry *next;
+};
+
+struct addr_link {
+    int                 ifindex;
+    struct addr_entry  *addrs;
+    struct route_entry *routes;
+    struct addr_link   *next;
+};
+
+#define ADDR_BUCKETS 64   /* power of two */
+
+static struct addr_link *links[ADDR_BUCKETS];
+
+static unsigned int link_slot(int ifindex)
+{
+    return (unsigned int)ifindex & (ADDR_BUCKETS - 1);
+}
+
+static struct addr_link *link_find(int ifindex)
+{
+    for (struct addr_link *l = links[link_slot(ifindex)]; l; l = l->next)
+        if (l->ifindex == ifindex)
+            return l;
+    return NULL;
+}
+
+static struct addr_link *link_get(int ifindex)
+{
+    struct addr_link *l = link_find(ifindex);
+    if (l)
+        return l;
+
+    l = calloc(1, sizeof(*l));
+    if (!l)
+        return NULL;
+
+    l->ifindex = ifindex;
+    l->next    = links[link_slot(ifindex)];
+    links[link_slot(ifindex)] = l;
+    return l;
+}
+
+static void routes_drop(struct addr_link *l, uint8_t family)
+{
+    struct route_entry **pp = &l->routes;
+
+    while (*pp) {
+        struct route_entry *r = *pp;
+        if (r->family == family) {
+            *pp = r->next;
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+}
+
+/* release l if nothing is left on it */
+static void link_put(struct addr_link *l)
+{
+    if (l->addrs || l->routes)
+        return;
+
+    for (struct addr_link **pp = &links[link_slot(l->ifindex)]; *pp;
+         pp = &(*pp)->next) {
+        if (*pp == l) {
+            *pp = l->next;
+            free(l);
+            return;
+        }
+    }
+}
+
+static void cache_flush(void)
+{
+    for (size_t i = 0; i < ADDR_BUCKETS; i++) {
+        while (links[i]) {
+            struct addr_link *l = links[i];
+
+            while (l->addrs) {
+                struct addr_entry *a = l->addrs;
+                l->addrs = a->next;
+                free(a);
+            }
+            routes_drop(l, AF_INET);
+            routes_drop(l, AF_INET6);
+
+            links[i] = l->next;
+            free(l);
+        }
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* cache → signals                                              */
+
+/* dump in flight: addresses first, then routes; 0 when idle */
+static struct {
+    uint16_t type;
+    uint32_t seq;
+    bool     again;     /* start over once this one is done */
+} dump;
+
+static bool apply_node(struct graph *g, struct node *n)
+{
+    const struct addr_link *l = n->ifindex > 0 ? link_find(n->ifindex) : NULL;
+    bool v4 = false, v6 = false;
+    bool changed = false;
+
+    for (const struct addr_entry *a = l ? l->addrs : NULL; a; a = a->next) {
+        if (!a->usable)
+            continue;
+        if (a->family == AF_INET)
+            v4 = true;
+        else
+            v6 = true;
+    }
+
+    changed |= graph_set_signal_atom_carried(g, n, atom_ipv4,  v4);
+    changed |= graph_set_signal_atom_carried(g, n, atom_ipv6,  v6);
+    changed |= graph_set_signal_atom_carried(g, n, atom_route,
+                                             l && l->routes);
+    return changed;
+}
+
+/* an event touched ifindex; a dump applies everything once it is done */
+static bool apply_ifindex(struct graph *g, int ifindex)
+{
+    if (dump.type)
+        return false;
+
+    struct node *n = graph_find_ifindex(g, ifindex);
+    return n ? apply_node(g, n) : false;
+}
+
+static bool apply_all(struct graph *g)
+{
+    return graph_update_nodes(g, apply_node);
+}
+
+/* ------------------------------------------------------------ */
+/* addresses                                                    */
+
+static bool addr_msg(struct graph *g, const struct nlmsghdr *nh)
+{
+    const struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+        return false;
+    if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+        return false;
+
+    size_t alen = ifa->ifa_family == AF_INET ? 4 : 16;
+    const void *local = NULL, *address = NULL;
+    uint32_t flags = ifa->ifa_flags;
+    int len = IFA_PAYLOAD(nh);
+
+    for (const struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case IFA_LOCAL:
+            if (RTA_PAYLOAD(rta) >= alen)
+                local = RTA_DATA(rta);
+            break;
+        case IFA_ADDRESS:
+            if (RTA_PAYLOAD(rta) >= alen)
+                address = RTA_DATA(rta);
+            break;
+        case IFA_FLAGS:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+                flags = *(const uint32_t *)RTA_DATA(rta);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* on point-to-point links IFA_ADDRESS is the peer */
+    const void *addr = local ? local : address;
+    if (!addr || (int)ifa->ifa_index <= 0)
+        return false;
+
+    struct addr_link *l = nh->nlmsg_type == RTM_NEWADDR ?
+                          link_get((int)ifa->ifa_index) :
+                          link_find((int)ifa->ifa_index);
+    if (!l)
+        return false;
+
+    struct addr_entry **pp = &l->addrs;
+    for (; *pp; pp = &(*pp)->next) {
+        const struct addr_entry *a = *pp;
+        if (a->family == ifa->ifa_family &&
+            a->prefixlen == ifa->ifa_prefixlen &&
+            memcmp(a->addr, addr, alen) == 0)
+            break;
+    }
+
+    if (nh->nlmsg_type == RTM_DELADDR) {
+        if (!*pp)
+            return false;
+
+        struct addr_entry *a = *pp;
+        *pp = a->next;
+        free(a);
+
+        /* the kernel disables IPv4 on a link that lost its last address */
+        if (ifa->ifa_family == AF_INET) {
+            bool any = false;
+            for (a = l->addrs; a; a = a->next)
+                any |= a->family == AF_INET;
+            if (!any)
+                routes_drop(l, AF_INET);
+        }
+    } else {
+        struct addr_entry *a = *pp;
+
+        if (!a) {
+            a = calloc(1, sizeof(*a));
+            if (!a)
+                return false;
+
+            a->family    = ifa->ifa_family;
+            a->prefixlen = ifa->ifa_prefixlen;
+            memcpy(a->addr, addr, alen);
+            *pp = a;
+        }
+
+        a->usable = ifa->ifa_scope < RT_SCOPE_LINK &&
+                    !(flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED));
+    }
+
+    int ifindex = l->ifindex;
+    link_put(l);
+    return apply_ifindex(g, ifindex);
+}
+
+/* ------------------------------------------------------------ */
+/* default routes                                               */
+
+struct route_key {
+    uint8_t  family;
+    uint32_t table;
+    uint32_t priority;
+};
+
+static bool route_set(struct graph *g, bool add,
+                      const struct route_key *k,
+                      int ifindex, const void *gw, size_t gwlen)
+{
+    uint8_t gwbuf[16] = { 0 };
+
+    if (ifindex <= 0)
+        return false;
+    if (gw)
+        memcpy(gwbuf, gw, gwlen);
+
+    struct addr_link *l = add ? link_get(ifindex) : link_find(ifindex);
+    if (!l)
+        return false;
+
+    struct route_entry **pp = &l->routes;
+    for (; *pp; pp = &(*pp)->next) {
+        const struct route_entry *r = *pp;
+        if (r->family == k->family &&
+            r->table == k->table &&
+            r->priority == k->priority &&
+            memcmp(r->gw, gwbuf, sizeof(gwbuf)) == 0)
+            break;
+    }
+
+    if (add && !*pp) {
+        struct route_entry *r = calloc(1, sizeof(*r));
+        if (!r)
+            return false;
+
+        r->family   = k->family;
+        r->table    = k->table;
+        r->priority = k->priority;
+        memcpy(r->gw, gwbuf, sizeof(gwbuf));
+        *pp = r;
+    } else if (!add && *pp) {
+        struct route_entry *r = *pp;
+        *pp = r->next;
+        free(r);
+    }
+
+    link_put(l);
+    return apply_ifindex(g, ifindex);
+}
+
+/* NLM_F_REPLACE: the route may have moved to other links */
+static bool route_replace(struct graph *g, const struct route_key *k)
+{
+    bool changed = false;
+
+    for (size_t i = 0; i < ADDR_BUCKETS; i++) {
+        struct addr_link *next;
+
+        for (struct addr_link *l = links[i]; l; l = next) {
+            bool hit = false;
+
+            next = l->next;
+            for (struct route_entry **pp = &l->routes; *pp; ) {
+                struct route_entry *r = *pp;
+                if (r->family == k->family &&
+                    r->table == k->table &&
+                    r->priority == k->priority) {
+                    *pp = r->next;
+                    free(r);
+                    hit = true;
+                } else {
+                    pp = &r->next;
+                }
+            }
+
+            if (hit) {
+                int ifindex = l->ifindex;
+                link_put(l);
+                changed |= apply_ifindex(g, ifindex);
+            }
+        }
+    }
+
+    return changed;
+}
+
+static bool route_msg(struct graph *g, const struct nlmsghdr *nh)
+{
+    const struct rtmsg *rtm = NLMSG_DATA(nh);
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)))
+        return false;
+    if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6)
+        return false;
+    if (rtm->rtm_dst_len != 0 || rtm->rtm_type != RTN_UNICAST)
+        return false;
+
+    struct route_key k = {
+        .family = rtm->rtm_family,
+        .table  = rtm->rtm_table,
+    };
+    size_t alen = rtm->rtm_family == AF_INET ? 4 : 16;
+    const struct rtattr *multipath = NULL;
+    const void *gw = NULL;
+    int oif = 0;
+    int len = RTM_PAYLOAD(nh);
+
+    for (const struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case RTA_TABLE:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+                k.table = *(const uint32_t *)RTA_DATA(rta);
+            break;
+        case RTA_PRIORITY:
+            if (RTA_PAYLOAD(rta) >= sizeof(uint32_t))
+                k.priority = *(const uint32_t *)RTA_DATA(rta);
+            break;
+        case RTA_OIF:
+            if (RTA_PAYLOAD(rta) >= sizeof(int))
+                oif = *(const int *)RTA_DATA(rta);
+            break;
+        case RTA_GATEWAY:
+            if (RTA_PAYLOAD(rta) >= alen)
+                gw = RTA_DATA(rta);
+            break;
+        case RTA_MULTIPATH:
+            multipath = rta;
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* local and broadcast addresses, not a way out */
+    if (k.table == RT_TABLE_LOCAL)
+        return false;
+
+    bool add = nh->nlmsg_type == RTM_NEWROUTE;
+    bool changed = false;
+
+    if (add && (nh->nlmsg_flags & NLM_F_REPLACE))
+        changed |= route_replace(g, &k);
+
+    if (!multipath)
+        return changed | route_set(g, add, &k, oif, gw, alen);
+
+    int mlen = RTA_PAYLOAD(multipath);
+    for (const struct rtnexthop *rtnh = RTA_DATA(multipath);
+         RTNH_OK(rtnh, mlen);
+         mlen -= RTNH_ALIGN(rtnh->rtnh_len), rtnh = RTNH_NEXT(rtnh)) {
+        const void *nhgw = NULL;
+        int alen_left = rtnh->rtnh_len - sizeof(*rtnh);
+
+        for (const struct rtattr *rta = RTNH_DATA(rtnh);
+             RTA_OK(rta, alen_left); rta = RTA_NEXT(rta, alen_left)) {
+            if (rta->rta_type == RTA_GATEWAY && RTA_PAYLOAD(rta) >= alen)
+                nhgw = RTA_DATA(rta);
+        }
+
+        changed |= route_set(g, add, &k, rtnh->rtnh_ifindex, nhgw, alen);
+    }
+
+    return changed;
+}
+
+/* ------------------------------------------------------------ */
+/* socket                                                       */
+
+/*
+ * Route notifications cover every prefix in every table; only default
+ * routes matter here. Like the link socket's filter this one passes
+ * dump replies untouched.
+ */
+static void attach_route_filter(int fd)
+{
+    struct sock_filter insn[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+                 offsetof(struct nlmsghdr, nlmsg_flags)),
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, ntohs(NLM_F_MULTI), 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffffu),
+
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+                 offsetof(struct nlmsghdr, nlmsg_type)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_NEWROUTE), 2, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohs(RTM_DELROUTE), 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffffu),
+
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+                 NLMSG_HDRLEN + offsetof(struct rtmsg, rtm_dst_len)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffffu),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog prog = {
+        .len    = sizeof(insn) / sizeof(insn[0]),
+        .filter = insn,
+    };
+
+    /* an optimisation only: without it every route is read and ignored */
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &prog, sizeof(prog)) < 0)
+        perror("setsockopt(SO_ATTACH_FILTER)");
+}
+
+static int open_rtnetlink(void)
+{
+    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd < 0)
+        return -1;
+
+    int rcvbuf = 1024 * 1024;   /* 1 MB */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                   &rcvbuf, sizeof(rcvbuf)) < 0) {
+        perror("setsockopt(SO_RCVBUF)");
+        close(fd);
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_nl sa = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                     RTMGRP_IPV4_ROUTE  | RTMGRP_IPV6_ROUTE,
+    };
+
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* dump replies are addressed to it */
+    socklen_t salen = sizeof(sa);
+    if (getsockname(fd, (struct sockaddr *)&sa, &salen) < 0) {
+        close(fd);
+        return -1;
+    }
+    nl_portid = sa.nl_pid;
+
+    int one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &one, sizeof(one));
+
+    attach_route_filter(fd);
+    return fd;
+}
+
+int signal_addr_fd(void)
+{
+    if (nl_fd >= 0)
+        return nl_fd;
+
+    atom_ipv4  = signal_atom_intern("has_ipv4");
+    atom_ipv6  = signal_atom_intern("has_ipv6");
+    atom_route = signal_atom_intern("default_route");
+
+    nl_fd = open_rtnetlink();
+    return nl_fd;
+}
+
+/* ------------------------------------------------------------ */
+/* dumps                                                        */
+
+static int dump_start(uint16_t type)
+{
+    struct kernel_nl_req req;
+
+    /* the family is the first byte of both headers; AF_UNSPEC is all */
+    kernel_nl_init(&req, type, NLM_F_DUMP,
+                   type == RTM_GETADDR ? sizeof(struct ifaddrmsg)
+                                       : sizeof(struct rtmsg));
+
+    if (++nl_seq == 0)
+        nl_seq = 1;
+    req.nh.nlmsg_seq = nl_seq;
+
+    if (send(nl_fd, &req.nh, req.nh.nlmsg_len, 0) < 0) {
+        dump.type = 0;
+        return -1;
+    }
+
+    dump.type = type;
+    dump.seq  = nl_seq;
+    return 0;
+}
+
+static bool dump_owns(const struct nlmsghdr *nh)
+{
+    return dump.type &&
+           nh->nlmsg_seq == dump.seq &&
+           nh->nlmsg_pid == nl_portid;
+}
+
+/* NLMSG_DONE (or an error) of the dump in flight */
+static bool dump_done(struct graph *g)
+{
+    if (dump.type == RTM_GETADDR && !dump.again) {
+        if (dump_start(RTM_GETROUTE) < 0)
+            perror("netlink: route dump");
+        return false;
+    }
+
+    dump.type = 0;
+
+    if (dump.again) {
+        dump.again = false;
+        signal_addr_sync(g);
+        return false;
+    }
+
+    /* events were only cached meanwhile */
+    return apply_all(g);
+}
+
+int signal_addr_sync(struct graph *g)
+{
+    (void)g;
+
+    if (nl_fd < 0)
+        return -1;
+
+    if (dump.type) {
+        dump.again = true;
+        return 0;
+    }
+
+    /* signals keep their values until the dumps are through */
+    cache_flush();
+    return dump_start(RTM_GETADDR);
+}
+
+/* ------------------------------------------------------------ */
+
+bool signal_addr_handle(struct graph *g)
+{
+    bool changed = false;
+
+    for (;;) {
+        ssize_t len = recv(nl_fd, rxbuf, sizeof(rxbuf), MSG_TRUNC);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                /* kernel dropped messages */
+                signal_addr_sync(g);
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return changed;
+        }
+
+        if ((size_t)len > sizeof(rxbuf)) {
+            /* a message lost its tail: same as a dropped one */
+            signal_addr_sync(g);
+            continue;
+        }
+
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)rxbuf;
+             NLMSG_OK(nh, len);
+             nh = NLMSG_NEXT(nh, len)) {
+
+            if (dump_owns(nh) && (nh->nlmsg_type == NLMSG_DONE ||
+                                  nh->nlmsg_type == NLMSG_ERROR)) {
+                if (nh->nlmsg_type == NLMSG_ERROR) {
+                    const struct nlmsgerr *e = NLMSG_DATA(nh);
+                    fprintf(stderr, "netlink: %s dump: %s\n",
+                            dump.type == RTM_GETADDR ? "address" : "route",
+                            strerror(-e->error));
+                }
+                changed |= dump_done(g);
+                continue;
+            }
+
+            switch (nh->nlmsg_type) {
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                changed |= addr_msg(g, nh);
+                break;
+            case RTM_NEWROUTE:
+            case RTM_DELROUTE:
+                changed |= route_msg(g, nh);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return changed;
+}
+
+bool signal_addr_refresh(struct graph *g)
+{
+    if (nl_fd < 0 || dump.type)
+        return false;
+
+    /* IPv4 routes of a link that went down are gone, unannounced */
+    for (size_t i = 0; i < ADDR_BUCKETS; i++) {
+        struct addr_link *next;
+
+        for (struct addr_link *l = links[i]; l; l = next) {
+            next = l->next;
+
+            const struct kernel_link_info *k = kernel_cache_find(l->ifindex);
+            if (k && !(k->flags & IFF_UP)) {
+                routes_drop(l, AF_INET);
+                link_put(l);
+            }
+        }
+    }
+
+    return apply_all(g);
+}
+
+/* ------------------------------------------------------------ */
+
+void signal_addr_close(void)
+{
+    if (nl_fd >= 0) {
+        close(nl_fd);
+        nl_fd = -1;
+    }
+
+    cache_flush();
+    memset(&dump, 0, sizeof(dump));
+}
@@ -0,0 +1,39 @@
+#ifndef LNMGR_SIGNAL_ADDR_H
+#define LNMGR_SIGNAL_ADDR_H
+
+#include "graph.h"
+
+/*
+ * Address / route signal producer
+ *
+ * Produces graph signals (per bound ifindex):
+ *   - "has_ipv4"       a usable IPv4 address (scope global or site)
+ *   - "has_ipv6"       a usable IPv6 address (not link-local, DAD done)
+ *   - "default_route"  a unicast default route leaves through the link
+ *
+ * Unlike link state these are not facts every node depends on, so they
+ * are only maintained on nodes that carry them (config "signals").
+ *
+ * Lifecycle:
+ *   - signal_addr_fd() opens the socket and subscribes
+ *   - signal_addr_sync() requests address and route dumps
+ *   - signal_addr_handle() processes readable events, dump replies
+ *     included
+ *   - signal_addr_refresh() re-derives the signals after link changes
+ *   - signal_addr_close() releases resources
+ */
+
+int  signal_addr_fd(void);
+int  signal_addr_sync(struct graph *g);
+bool signal_addr_handle(struct graph *g);
+
+/*
+ * Links moved (ifindex bindings, admin state): re-derive the signals
+ * of every node carrying them. The kernel drops the IPv4 routes of a
+ * link that goes down without telling, so they are pruned here.
+ */
+bool signal_addr_refresh(struct graph *g);
+
+void signal_addr_close(void);
+
+#endif /* LNMGR_SIGNAL_ADDR_H */
@@ -1,5 +1,8 @@
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -7,17 +10,31 @@
 #include <fcntl.h>     /* fcntl, F_GETFL, F_SETFL, O_NONBLOCK */
 #include <unistd.h>   /* close */
 #include <poll.h>
+#include <time.h>
+#include <stdlib.h>
+#include <arpa/inet.h> /* ntohl, ntohs */
 
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/if.h>
+#include <linux/filter.h>
+#include <asm/socket.h> /* SO_ATTACH_FILTER */
 
 #include "signal_netlink.h"
 #include "graph.h"
 #include "node.h"
+#include "kernel/kernel_cache.h"
+#include "kernel/kernel_nl.h"
 
 /* private netlink socket */
-static int nl_fd = -1;
+static int      nl_fd = -1;
+static uint32_t nl_portid;
+static uint32_t nl_seq;     /* last sequence number used */
+
+/* signals produced, resolved once at open */
+static signal_atom_t atom_carrier  = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_admin_up = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_running  = SIGNAL_ATOM_NONE;
 
 /* ------------------------------------------------------------ */
 
@@ -53,10 +70,33 @@ static int open_rtnetlink(void)
         return -1;
     }
 
+    /* dump replies are addressed to it */
+    socklen_t salen = sizeof(sa);
+    if (getsockname(fd, (struct sockaddr *)&sa, &salen) < 0) {
+        close(fd);
+        return -1;
+    }
+    nl_portid = sa.nl_pid;
+
+    /* reject malformed requests instead of silently dumping everything */
+    int one = 1;
+    setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &one, sizeof(one));
+
     return fd;
 }
 
-static int request_getlink(int fd)
+/* n consecutive sequence numbers, never 0 (unsolicited notifications) */
+static uint32_t seq_alloc(uint32_t n)
+{
+    if (nl_seq > UINT32_MAX - n)
+        nl_seq = 0;
+
+    uint32_t base = nl_seq + 1;
+    nl_seq += n;
+    return base;
+}
+
+static int request_getlink(int fd, uint32_t seq)
 {
     struct {
         struct nlmsghdr  nh;
@@ -66,7 +106,7 @@ static int request_getlink(int fd)
             .nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
             .nlmsg_type  = RTM_GETLINK,
             .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
-            .nlmsg_seq   = 1,
+            .nlmsg_seq   = seq,
         },
         .ifm = {
             .ifi_family = AF_UNSPEC,
@@ -76,57 +116,298 @@ static int request_getlink(int fd)
     return send(fd, &req, req.nh.nlmsg_len, 0);
 }
 
+/* ------------------------------------------------------------ */
+/* kernel-side filter                                           */
+
+/*
+ * Hosts can carry thousands of links lnmgr does not manage (container
+ * veths), and RTMGRP_LINK reports all of them. A classic BPF program
+ * on the socket drops their RTM_NEWLINK / RTM_DELLINK notifications
+ * before they are copied out: a link message passes if its ifindex is
+ * bound to a node or its IFLA_IFNAME is a node id. Everything else,
+ * including dump replies (NLM_F_MULTI; the filter only sees the first
+ * message of a dump skb), passes untouched. VLAN parents that are
+ * not nodes pass as well (by name, and by ifindex once cached): the
+ * action path looks them up in the link cache too.
+ *
+ * Between dumps the link cache thus only follows the links the action
+ * path looks up.
+ *
+ * cBPF loads are big-endian, netlink is host order: constants are
+ * converted with ntohl/ntohs to compare equal to what the load sees.
+ * Jumps only reach 255 instructions, so every test is followed by its
+ * own return.
+ */
+
+#define FILTER_ACCEPT 0xffffffffu
+#define FILTER_DROP   0u
+
+#define IFI_INDEX_OFF (NLMSG_HDRLEN + offsetof(struct ifinfomsg, ifi_index))
+#define IFLA_OFF      (NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct ifinfomsg)))
+
+static unsigned int filter_gen;
+static bool         filter_set;
+
+struct filter_prog {
+    struct sock_filter *insn;
+    size_t              n;
+    size_t              cap;
+};
+
+static void emit(struct filter_prog *p, uint16_t code,
+                 uint8_t jt, uint8_t jf, uint32_t k)
+{
+    if (p->n < p->cap)
+        p->insn[p->n] = (struct sock_filter)BPF_JUMP(code, k, jt, jf);
+    p->n++;
+}
+
+/* A == k: accept, else fall through */
+static void emit_accept_if(struct filter_prog *p, uint32_t k)
+{
+    emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, k);
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_ACCEPT);
+}
+
+/* instructions emit_name() produces for a name of len bytes */
+static size_t name_insns(size_t len)
+{
+    size_t cmp = len + 1;   /* with the terminating NUL */
+
+    return 2 * (cmp / 4 + (cmp % 4 >= 2) + (cmp % 2)) + 1;
+}
+
+/* X = offset of IFLA_IFNAME; accept if its payload is name */
+static void emit_name(struct filter_prog *p, const char *name, size_t len)
+{
+    char buf[IFNAMSIZ + 4] = { 0 };
+    size_t cmp = len + 1;
+    size_t off = 0;
+
+    memcpy(buf, name, len);
+
+    /* each compare skips the rest of the block on mismatch */
+    size_t left = name_insns(len);
+
+    for (; cmp - off >= 4; off += 4) {
+        uint32_t w;
+        memcpy(&w, buf + off, 4);
+        emit(p, BPF_LD | BPF_W | BPF_IND, 0, 0, RTA_LENGTH(0) + off);
+        left -= 2;
+        emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, (uint8_t)left, ntohl(w));
+    }
+
+    if (cmp - off >= 2) {
+        uint16_t h;
+        memcpy(&h, buf + off, 2);
+        emit(p, BPF_LD | BPF_H | BPF_IND, 0, 0, RTA_LENGTH(0) + off);
+        left -= 2;
+        emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, (uint8_t)left, ntohs(h));
+        off += 2;
+    }
+
+    if (cmp - off == 1) {
+        emit(p, BPF_LD | BPF_B | BPF_IND, 0, 0, RTA_LENGTH(0) + off);
+        left -= 2;
+        emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, (uint8_t)left,
+             (uint8_t)buf[off]);
+    }
+
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_ACCEPT);
+}
+
+/* the kernel name of a VLAN parent outside the graph, if n has one */
+static const char *unmanaged_parent(struct node *n)
+{
+    const struct feat_vlan_domain *fv = (const struct feat_vlan_domain *)
+                node_feature_find(n, FEAT_VLAN_DOMAIN);
+
+    if (!fv || fv->parent || !fv->parent_id ||
+        strlen(fv->parent_id) >= IFNAMSIZ)
+        return NULL;
+
+    return fv->parent_id;
+}
+
+static int cmp_len(const void *a, const void *b)
+{
+    size_t x = strlen(*(const char *const *)a);
+    size_t y = strlen(*(const char *const *)b);
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Lay the program out into p (counting only once p->cap is reached).
+ * Names go shortest first: a load past the end of the message aborts
+ * the program, and a matching name never needs more bytes than its
+ * own.
+ */
+static void filter_build(struct filter_prog *p, struct graph *g,
+                         const char **names, size_t n_names)
+{
+    p->n = 0;
+
+    /* dump replies and anything that is not a link message */
+    emit(p, BPF_LD | BPF_H | BPF_ABS, 0, 0,
+         offsetof(struct nlmsghdr, nlmsg_flags));
+    emit(p, BPF_JMP | BPF_JSET | BPF_K, 0, 1, ntohs(NLM_F_MULTI));
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_ACCEPT);
+
+    emit(p, BPF_LD | BPF_H | BPF_ABS, 0, 0,
+         offsetof(struct nlmsghdr, nlmsg_type));
+    emit(p, BPF_JMP | BPF_JEQ | BPF_K, 2, 0, ntohs(RTM_NEWLINK));
+    emit(p, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, ntohs(RTM_DELLINK));
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_ACCEPT);
+
+    /* bound ifindex, cached ifindex of an unmanaged parent */
+    emit(p, BPF_LD | BPF_W | BPF_ABS, 0, 0, IFI_INDEX_OFF);
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        const char *parent = unmanaged_parent(n);
+
+        if (n->ifindex > 0)
+            emit_accept_if(p, ntohl((uint32_t)n->ifindex));
+
+        const struct kernel_link_info *l =
+            parent ? kernel_cache_find_name(parent) : NULL;
+        if (l)
+            emit_accept_if(p, ntohl((uint32_t)l->ifindex));
+    }
+
+    /* node id or unmanaged parent name */
+    emit(p, BPF_LD | BPF_W | BPF_IMM, 0, 0, IFLA_OFF);
+    emit(p, BPF_LDX | BPF_W | BPF_IMM, 0, 0, IFLA_IFNAME);
+    emit(p, BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_NLATTR);
+    emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0);
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_DROP);
+    emit(p, BPF_MISC | BPF_TAX, 0, 0, 0);
+
+    for (size_t i = 0; i < n_names; i++)
+        emit_name(p, names[i], strlen(names[i]));
+
+    emit(p, BPF_RET | BPF_K, 0, 0, FILTER_DROP);
+}
+
+static void filter_detach(void)
+{
+    if (filter_set) {
+        int dummy = 0;
+        setsockopt(nl_fd, SOL_SOCKET, SO_DETACH_FILTER,
+                   &dummy, sizeof(dummy));
+        filter_set = false;
+    }
+}
+
+/*
+ * (Re)attach the filter for the graph's current ids and bindings. On
+ * any failure the socket is left unfiltered: extra wakeups are safe,
+ * missed links are not.
+ */
+static void filter_update(struct graph *g)
+{
+    if (filter_set && filter_gen == g->links_gen)
+        return;
+
+    filter_gen = g->links_gen;
+
+    const char **names = malloc((g->count ? 2 * g->count : 1) *
+                                sizeof(*names));
+    if (!names) {
+        filter_detach();
+        return;
+    }
+
+    size_t n_names = 0;
+    for (size_t i = 0; i < g->count; i++) {
+        const char *id = g->vec[i]->id;
+        const char *parent = unmanaged_parent(g->vec[i]);
+
+        if (strlen(id) < IFNAMSIZ)
+            names[n_names++] = id;
+        if (parent)
+            names[n_names++] = parent;
+    }
+    qsort(names, n_names, sizeof(*names), cmp_len);
+
+    struct filter_prog p = { 0 };
+    filter_build(&p, g, names, n_names);
+
+    if (p.n > BPF_MAXINSNS) {
+        free(names);
+        filter_detach();
+        return;
+    }
+
+    p.insn = calloc(p.n, sizeof(*p.insn));
+    if (!p.insn) {
+        free(names);
+        filter_detach();
+        return;
+    }
+    p.cap = p.n;
+    filter_build(&p, g, names, n_names);
+    free(names);
+
+    struct sock_fprog fprog = {
+        .len    = (unsigned short)p.n,
+        .filter = p.insn,
+    };
+
+    if (setsockopt(nl_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &fprog, sizeof(fprog)) < 0) {
+        perror("setsockopt(SO_ATTACH_FILTER)");
+        filter_detach();
+    } else {
+        filter_set = true;
+    }
+
+    free(p.insn);
+}
+
 /* ------------------------------------------------------------ */
 /* common link → signal translation                             */
 
-static bool clear_link_state(struct graph *g, const char *ifname)
+static bool clear_link_state(struct graph *g, struct node *n)
 {
     bool changed = false;
 
-    struct node *n = graph_find_node(g, ifname);
-    if (!n)
-        return false;
-
     /* ---- absence edge ---- */
     if (n->present) {
-        node_on_absent(n);
+        node_on_absent(g, n);
         changed = true;
     }
 
     /* ---- signals ---- */
-    changed |= graph_set_signal(g, ifname, "carrier",  false);
-    changed |= graph_set_signal(g, ifname, "admin_up", false);
-    changed |= graph_set_signal(g, ifname, "running",  false);
+    changed |= graph_set_signal_atom(g, n, atom_carrier,  false);
+    changed |= graph_set_signal_atom(g, n, atom_admin_up, false);
+    changed |= graph_set_signal_atom(g, n, atom_running,  false);
 
     return changed;
 }
 
 static bool apply_link_state(struct graph *g,
-                             const char *ifname,
+                             struct node *n,
                              unsigned int flags)
 {
     bool changed = false;
 
-    struct node *n = graph_find_node(g, ifname);
-    if (!n)
-        return false;
-
     /* ---- presence edge ---- */
     if (!n->present) {
-        node_on_present(n);
+        node_on_present(g, n);
         changed = true;
     }
 
     /* ---- signals ---- */
-    changed |= graph_set_signal(g, ifname, "carrier",
-                                !!(flags & IFF_LOWER_UP));
-    changed |= graph_set_signal(g, ifname, "admin_up",
-                                !!(flags & IFF_UP));
-    changed |= graph_set_signal(g, ifname, "running",
-                                !!(flags & IFF_RUNNING));
+    changed |= graph_set_signal_atom(g, n, atom_carrier,
+                                     !!(flags & IFF_LOWER_UP));
+    changed |= graph_set_signal_atom(g, n, atom_admin_up,
+                                     !!(flags & IFF_UP));
+    changed |= graph_set_signal_atom(g, n, atom_running,
+                                     !!(flags & IFF_RUNNING));
 
     DPRINTF("link %s: carrier=%d admin=%d running=%d\n",
-            ifname,
+            n->id,
             !!(flags & IFF_LOWER_UP),
             !!(flags & IFF_UP),
             !!(flags & IFF_RUNNING));
@@ -134,6 +415,83 @@ static bool apply_link_state(struct graph *g,
     return changed;
 }
 
+static const char *link_ifname(struct nlmsghdr *nh)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    int attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+
+    for (struct rtattr *rta = IFLA_RTA(ifi);
+         RTA_OK(rta, attrlen);
+         rta = RTA_NEXT(rta, attrlen)) {
+        if (rta->rta_type == IFLA_IFNAME)
+            return RTA_DATA(rta);
+    }
+    return NULL;
+}
+
+/*
+ * Resolve the node for an RTM_NEWLINK.
+ *
+ * The ifindex binding is authoritative. The name is only used to bind
+ * a link seen for the first time, or to notice that a bound link was
+ * renamed: the old node then loses its kernel object and the new name
+ * is bound instead.
+ */
+static struct node *link_resolve(struct graph *g,
+                                 struct nlmsghdr *nh,
+                                 bool *changed)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    const char *ifname = link_ifname(nh);
+
+    struct node *n = graph_find_ifindex(g, ifi->ifi_index);
+    if (n) {
+        if (!ifname || strcmp(n->id, ifname) == 0)
+            return n;
+
+        DPRINTF("link %s renamed to %s\n", n->id, ifname);
+        *changed |= clear_link_state(g, n);
+        graph_unbind_ifindex(g, n);
+    }
+
+    if (!ifname)
+        return NULL;
+
+    n = graph_find_node(g, ifname);
+    if (!n)
+        return NULL;
+
+    graph_bind_ifindex(g, n, ifi->ifi_index);
+    return n;
+}
+
+static bool handle_link_msg(struct graph *g, struct nlmsghdr *nh)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    bool changed = false;
+    struct node *n;
+
+    /* mirror for the action path, whether or not a node cares */
+    kernel_cache_update(nh);
+
+    if (nh->nlmsg_type == RTM_DELLINK) {
+        n = graph_find_ifindex(g, ifi->ifi_index);
+        if (!n)
+            return false;
+
+        changed = clear_link_state(g, n);
+        graph_unbind_ifindex(g, n);
+        return changed;
+    }
+
+    n = link_resolve(g, nh, &changed);
+    if (!n)
+        return changed;
+
+    changed |= apply_link_state(g, n, ifi->ifi_flags);
+    return changed;
+}
+
 /* ------------------------------------------------------------ */
 
 int signal_netlink_fd(void)
@@ -141,106 +499,490 @@ int signal_netlink_fd(void)
     if (nl_fd >= 0)
         return nl_fd;
 
+    atom_carrier  = signal_atom_intern("carrier");
+    atom_admin_up = signal_atom_intern("admin_up");
+    atom_running  = signal_atom_intern("running");
+
     nl_fd = open_rtnetlink();
     return nl_fd;
 }
 
-static void drain_netlink_socket(int fd)
+/* ------------------------------------------------------------ */
+/* receive                                                      */
+
+/*
+ * Datagrams are read in batches with recvmmsg() into reusable slots,
+ * one datagram per slot. MSG_TRUNC makes the kernel report the full
+ * length of a datagram that did not fit: its remainder is lost, so the
+ * slots are grown to fit before the next call and the caller resyncs.
+ */
+#define NL_RX_SLOTS     8
+#define NL_RX_SLOT_MIN  8192
+
+static struct {
+    char           *buf;
+    size_t          slot;       /* bytes per slot */
+    size_t          want;       /* grow to this before the next call */
+    struct mmsghdr  msgs[NL_RX_SLOTS];
+    struct iovec    iov[NL_RX_SLOTS];
+} rx;
+
+static struct signal_netlink_stats nl_stats;
+
+const struct signal_netlink_stats *signal_netlink_stats(void)
 {
-    for (;;) {
-        char buf[4096];
-        struct iovec iov = {
-            .iov_base = buf,
-            .iov_len  = sizeof(buf),
+    return &nl_stats;
+}
+
+static int rx_grow(size_t need)
+{
+    size_t slot = rx.slot ? rx.slot : NL_RX_SLOT_MIN;
+
+    while (slot < need)
+        slot *= 2;
+
+    char *buf = realloc(rx.buf, slot * NL_RX_SLOTS);
+    if (!buf)
+        return -1;
+
+    rx.buf  = buf;
+    rx.slot = slot;
+    return 0;
+}
+
+/*
+ * Receive up to NL_RX_SLOTS datagrams without blocking. Returns how
+ * many, or -1 with errno set (EAGAIN when the socket is empty).
+ * *truncated is set if any of them lost data.
+ */
+static int rx_batch(int fd, bool *truncated)
+{
+    *truncated = false;
+
+    if (!rx.buf || rx.want > rx.slot) {
+        if (rx_grow(rx.want) < 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+        rx.want = 0;
+    }
+
+    for (int i = 0; i < NL_RX_SLOTS; i++) {
+        rx.iov[i] = (struct iovec){
+            .iov_base = rx.buf + (size_t)i * rx.slot,
+            .iov_len  = rx.slot,
         };
-        struct sockaddr_nl sa;
-        struct msghdr msg = {
-            .msg_name    = &sa,
-            .msg_namelen = sizeof(sa),
-            .msg_iov     = &iov,
-            .msg_iovlen  = 1,
+        rx.msgs[i] = (struct mmsghdr){
+            .msg_hdr = {
+                .msg_iov    = &rx.iov[i],
+                .msg_iovlen = 1,
+            },
         };
+    }
 
-        ssize_t len = recvmsg(fd, &msg, 0);
-        if (len < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-                return;
+    nl_stats.recv_calls++;
+
+    int n = recvmmsg(fd, rx.msgs, NL_RX_SLOTS, MSG_DONTWAIT | MSG_TRUNC,
+                     NULL);
+    if (n < 0) {
+        if (errno == ENOBUFS)
+            nl_stats.overruns++;
+        return -1;
+    }
+
+    nl_stats.datagrams += (uint64_t)n;
+    if ((uint64_t)n > nl_stats.batch_max)
+        nl_stats.batch_max = (uint64_t)n;
+
+    for (int i = 0; i < n; i++) {
+        size_t len = rx.msgs[i].msg_len;
+
+        if (len > rx.slot || (rx.msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            nl_stats.truncated++;
+            if (len > rx.want)
+                rx.want = len;
+            *truncated = true;
+        }
+    }
+
+    return n;
+}
+
+/* i-th datagram of the last batch; *len is clamped to what was kept */
+static struct nlmsghdr *rx_datagram(int i, size_t *len)
+{
+    size_t l = rx.msgs[i].msg_len;
+
+    *len = l < rx.slot ? l : rx.slot;
+    return (struct nlmsghdr *)(rx.buf + (size_t)i * rx.slot);
+}
+
+/* ------------------------------------------------------------ */
+/* link dump                                                    */
+
+/*
+ * RTM_GETLINK dumps run inside the event loop: the request is sent and
+ * replies are picked out of the normal receive path by their sequence
+ * number, so the control socket keeps being served meanwhile.
+ *
+ * Notifications that arrive during a dump are held back and replayed
+ * after NLMSG_DONE. The socket delivers in order, so a held event that
+ * came in before the dump reported its link is older than the dump's
+ * view and is dropped; the rest are newer and win.
+ */
+static struct {
+    bool      active;
+    bool      again;    /* start over once this one is done */
+    uint32_t  seq;
+
+    /* held notifications, packed nlmsghdrs */
+    char     *buf;
+    size_t    len;
+    size_t    cap;
+} dump;
+
+bool signal_netlink_syncing(void)
+{
+    return dump.active;
+}
+
+static void resync_supersede(void);
+
+static int dump_start(void)
+{
+    dump.seq = seq_alloc(1);
+
+    if (request_getlink(nl_fd, dump.seq) < 0)
+        return -1;
+
+    dump.active = true;
+    dump.again  = false;
+    resync_supersede();
+    return 0;
+}
+
+static bool dump_owns(const struct nlmsghdr *nh)
+{
+    return dump.active &&
+           nh->nlmsg_seq == dump.seq &&
+           nh->nlmsg_pid == nl_portid;
+}
+
+static void dump_hold(const struct nlmsghdr *nh)
+{
+    size_t len = NLMSG_ALIGN(nh->nlmsg_len);
+
+    if (dump.len + len > dump.cap) {
+        size_t cap = dump.cap ? dump.cap : 16384;
+
+        while (cap < dump.len + len)
+            cap *= 2;
+
+        char *buf = realloc(dump.buf, cap);
+        if (!buf) {
+            /* the next dump sees it */
+            dump.again = true;
             return;
         }
+        dump.buf = buf;
+        dump.cap = cap;
+    }
+
+    memcpy(dump.buf + dump.len, nh, nh->nlmsg_len);
+    dump.len += len;
+}
+
+/* the dump reported ifindex: what is held for it is older */
+static void dump_supersede(int ifindex)
+{
+    for (size_t off = 0; off < dump.len; ) {
+        struct nlmsghdr *nh = (struct nlmsghdr *)(dump.buf + off);
+        struct ifinfomsg *ifi = NLMSG_DATA(nh);
+
+        if (nh->nlmsg_type != NLMSG_NOOP && ifi->ifi_index == ifindex)
+            nh->nlmsg_type = NLMSG_NOOP;
+
+        off += NLMSG_ALIGN(nh->nlmsg_len);
     }
 }
 
-/* initial RTM_GETLINK dump */
+static bool dump_finish(struct graph *g)
+{
+    bool changed = false;
+
+    dump.active = false;
+
+    for (size_t off = 0; off < dump.len; ) {
+        struct nlmsghdr *nh = (struct nlmsghdr *)(dump.buf + off);
+
+        if (nh->nlmsg_type != NLMSG_NOOP)
+            changed |= handle_link_msg(g, nh);
+
+        off += NLMSG_ALIGN(nh->nlmsg_len);
+    }
+    dump.len = 0;
+
+    if (dump.again && dump_start() < 0)
+        perror("netlink: link dump");
+
+    return changed;
+}
+
+/* one message of the dump in flight */
+static bool dump_msg(struct graph *g, struct nlmsghdr *nh)
+{
+    switch (nh->nlmsg_type) {
+    case NLMSG_DONE:
+        return dump_finish(g);
+
+    case NLMSG_ERROR: {
+        const struct nlmsgerr *e = NLMSG_DATA(nh);
+
+        fprintf(stderr, "netlink: link dump: %s\n", strerror(-e->error));
+        return dump_finish(g);
+    }
+
+    case RTM_NEWLINK:
+        /* links changed under the dump; its view may be inconsistent */
+        if (nh->nlmsg_flags & NLM_F_DUMP_INTR)
+            dump.again = true;
+
+        if (dump.len)
+            dump_supersede(((struct ifinfomsg *)NLMSG_DATA(nh))->ifi_index);
+        return handle_link_msg(g, nh);
+
+    default:
+        return false;
+    }
+}
+
+/* start a full RTM_GETLINK dump, or another one after the current */
 int signal_netlink_sync(struct graph *g)
 {
-    drain_netlink_socket(nl_fd);
+    (void)g;
+
+    if (dump.active) {
+        dump.again = true;
+        return 0;
+    }
+
+    return dump_start();
+}
+
+/* ------------------------------------------------------------ */
+/* targeted resync                                              */
+
+/*
+ * An overrun loses notifications, but only the graph's links matter,
+ * and a full dump on a host with many links tends to overrun the
+ * socket again. Instead each node's link is queried on its own: by
+ * ifindex when bound, by name otherwise, with IFLA_EXT_MASK dropping
+ * the statistics from the replies. A reply is the link's current
+ * state, so it applies in order with the notifications around it.
+ *
+ * At most NL_RESYNC_WINDOW queries are outstanding, and a resync
+ * starts at most every NL_RESYNC_INTERVAL_MS: overruns in between are
+ * folded into the next one, which the event loop's timeout starts.
+ */
+#define NL_RESYNC_WINDOW       32
+#define NL_RESYNC_INTERVAL_MS  250
+
+struct resync_target {
+    int  ifindex;               /* 0: query by name */
+    char name[IFNAMSIZ];
+};
+
+static struct {
+    struct resync_target *t;
+    size_t    n;
+    size_t    cap;
+    size_t    sent;
+    size_t    answered;
+    uint32_t  base;             /* seq of t[0] */
+    bool      active;
+    bool      pending;          /* another one is due */
+    int64_t   last;             /* start of the last one */
+} resync;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    if (request_getlink(nl_fd) < 0)
+static int resync_query(const struct resync_target *t, uint32_t seq)
+{
+    struct kernel_nl_req req;
+    struct ifinfomsg *ifi = kernel_nl_init(&req, RTM_GETLINK, 0,
+                                           sizeof(*ifi));
+
+    req.nh.nlmsg_seq = seq;
+    ifi->ifi_family  = AF_UNSPEC;
+    ifi->ifi_index   = t->ifindex;
+
+    if (!t->ifindex && !kernel_nl_put_str(&req, IFLA_IFNAME, t->name))
+        return -1;
+    if (!kernel_nl_put_u32(&req, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS))
         return -1;
 
-    bool done = false;
+    return send(nl_fd, &req.nh, req.nh.nlmsg_len, 0) < 0 ? -1 : 0;
+}
 
-    while (!done) {
-        char buf[4096];
+static void resync_send(void)
+{
+    while (resync.sent < resync.n &&
+           resync.sent - resync.answered < NL_RESYNC_WINDOW) {
+        uint32_t seq = resync.base + (uint32_t)resync.sent;
 
-        struct iovec iov = {
-            .iov_base = buf,
-            .iov_len  = sizeof(buf),
-        };
+        if (resync_query(&resync.t[resync.sent], seq) < 0) {
+            perror("netlink: link resync");
+            resync.active  = false;
+            resync.pending = true;
+            return;
+        }
 
-        struct sockaddr_nl sa;
-        struct msghdr msg = {
-            .msg_name    = &sa,
-            .msg_namelen = sizeof(sa),
-            .msg_iov     = &iov,
-            .msg_iovlen  = 1,
-        };
+        resync.sent++;
+        nl_stats.resync_queries++;
+    }
+}
 
-        ssize_t len = recvmsg(nl_fd, &msg, 0);
-        if (len < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                /* wait for more dump data */
-                struct pollfd pfd = {
-                    .fd = nl_fd,
-                    .events = POLLIN,
-                };
-                poll(&pfd, 1, -1);
-                continue;
-            }
-            return -1;
+static void resync_start(struct graph *g)
+{
+    resync.pending = false;
+    resync.last    = now_ms();
+    resync.n       = 0;
+
+    if (resync.cap < g->count) {
+        struct resync_target *t = realloc(resync.t, g->count * sizeof(*t));
+        if (!t) {
+            /* retried on the next interval */
+            resync.pending = true;
+            return;
         }
+        resync.t   = t;
+        resync.cap = g->count;
+    }
 
-        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf;
-             NLMSG_OK(nh, len);
-             nh = NLMSG_NEXT(nh, len)) {
+    for (size_t i = 0; i < g->count; i++) {
+        const struct node *n = g->vec[i];
+        struct resync_target *t = &resync.t[resync.n];
 
-            if (nh->nlmsg_type == NLMSG_DONE) {
-                done = true;
-                break;
-            }
+        if (n->ifindex > 0) {
+            t->ifindex = n->ifindex;
+        } else if (strlen(n->id) < IFNAMSIZ) {
+            t->ifindex = 0;
+            strcpy(t->name, n->id);
+        } else {
+            continue;
+        }
+        resync.n++;
+    }
 
-            if (nh->nlmsg_type != RTM_NEWLINK)
-                continue;
+    nl_stats.resyncs++;
 
-            struct ifinfomsg *ifi = NLMSG_DATA(nh);
-            int attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+    resync.base     = seq_alloc((uint32_t)(resync.n ? resync.n : 1));
+    resync.sent     = 0;
+    resync.answered = 0;
+    resync.active   = resync.n > 0;
 
-            const char *ifname = NULL;
-            for (struct rtattr *rta = IFLA_RTA(ifi);
-                 RTA_OK(rta, attrlen);
-                 rta = RTA_NEXT(rta, attrlen)) {
-                if (rta->rta_type == IFLA_IFNAME) {
-                    ifname = RTA_DATA(rta);
-                    break;
-                }
-            }
+    resync_send();
+}
+
+static void resync_poll(struct graph *g)
+{
+    if (!resync.pending || dump.active)
+        return;
 
-            if (ifname)
-                apply_link_state(g, ifname, ifi->ifi_flags);
+    if (now_ms() - resync.last >= NL_RESYNC_INTERVAL_MS)
+        resync_start(g);
+}
+
+/* a full dump is starting: a resync still waiting is covered by it */
+static void resync_supersede(void)
+{
+    resync.pending = false;
+}
+
+/* lost messages: bring the graph's links up to date */
+static void resync_request(void)
+{
+    if (dump.active) {
+        /* the dump lost replies too */
+        dump.again = true;
+        return;
+    }
+
+    /*
+     * The running one's replies may be lost as well: start over, from
+     * signal_netlink_tick() once the socket is drained, or the replies
+     * would overrun it again.
+     */
+    resync.active  = false;
+    resync.pending = true;
+}
+
+static const struct resync_target *resync_owns(const struct nlmsghdr *nh)
+{
+    if (!resync.active || nh->nlmsg_pid != nl_portid)
+        return NULL;
+
+    uint32_t i = nh->nlmsg_seq - resync.base;
+    return i < resync.sent ? &resync.t[i] : NULL;
+}
+
+static bool resync_msg(struct graph *g, struct nlmsghdr *nh,
+                       const struct resync_target *t)
+{
+    bool changed = false;
+
+    if (nh->nlmsg_type == RTM_NEWLINK) {
+        changed = handle_link_msg(g, nh);
+    } else if (nh->nlmsg_type == NLMSG_ERROR) {
+        const struct nlmsgerr *e = NLMSG_DATA(nh);
+
+        /* the link went away unnoticed */
+        if (e->error == -ENODEV && t->ifindex > 0) {
+            struct {
+                struct nlmsghdr  nh;
+                struct ifinfomsg ifi;
+            } del = {
+                .nh = {
+                    .nlmsg_len  = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+                    .nlmsg_type = RTM_DELLINK,
+                },
+                .ifi = {
+                    .ifi_family = AF_UNSPEC,
+                    .ifi_index  = t->ifindex,
+                },
+            };
+            changed = handle_link_msg(g, &del.nh);
         }
+    } else {
+        return false;
     }
 
-    return 0;
+    if (++resync.answered == resync.n)
+        resync.active = false;
+    else
+        resync_send();
+
+    return changed;
+}
+
+int signal_netlink_timeout(void)
+{
+    /* resync_poll() waits for the dump, and dump_finish() follows up */
+    if (!resync.pending || dump.active)
+        return -1;
+
+    int64_t left = resync.last + NL_RESYNC_INTERVAL_MS - now_ms();
+    return left <= 0 ? 0 : (int)left;
+}
+
+void signal_netlink_tick(struct graph *g)
+{
+    resync_poll(g);
 }
 
 /* ------------------------------------------------------------ */
@@ -250,69 +992,58 @@ bool signal_netlink_handle(struct graph *g)
     bool changed = false;
 
     for (;;) {
-        char buf[4096];
-
-        struct iovec iov = {
-            .iov_base = buf,
-            .iov_len  = sizeof(buf),
-        };
+        bool truncated;
 
-        struct sockaddr_nl sa;
-        struct msghdr msg = {
-            .msg_name    = &sa,
-            .msg_namelen = sizeof(sa),
-            .msg_iov     = &iov,
-            .msg_iovlen  = 1,
-        };
-
-        ssize_t len = recvmsg(nl_fd, &msg, 0);
-        if (len < 0) {
+        int n = rx_batch(nl_fd, &truncated);
+        if (n < 0) {
             if (errno == ENOBUFS) {
                 /* kernel dropped messages */
-                signal_netlink_sync(g);
-                return true;
+                resync_request();
+                continue;
             }
             if (errno == EAGAIN || errno == EWOULDBLOCK)
                 break;
 
             return changed;
         }
- 
-        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf;
-             NLMSG_OK(nh, len);
-             nh = NLMSG_NEXT(nh, len)) {
-
-            if (nh->nlmsg_type != RTM_NEWLINK &&
-                nh->nlmsg_type != RTM_DELLINK)
-                continue;
 
-            struct ifinfomsg *ifi = NLMSG_DATA(nh);
-            int attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+        for (int i = 0; i < n; i++) {
+            size_t len;
+            struct nlmsghdr *nh = rx_datagram(i, &len);
 
-            const char *ifname = NULL;
+            for (; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+                nl_stats.messages++;
 
-            for (struct rtattr *rta = IFLA_RTA(ifi);
-                 RTA_OK(rta, attrlen);
-                 rta = RTA_NEXT(rta, attrlen)) {
+                if (dump_owns(nh)) {
+                    changed |= dump_msg(g, nh);
+                    continue;
+                }
 
-                if (rta->rta_type == IFLA_IFNAME) {
-                    ifname = RTA_DATA(rta);
-                    break;
+                const struct resync_target *t = resync_owns(nh);
+                if (t) {
+                    changed |= resync_msg(g, nh, t);
+                    continue;
                 }
-            }
 
-            if (!ifname)
-                continue;
+                if (nh->nlmsg_type != RTM_NEWLINK &&
+                    nh->nlmsg_type != RTM_DELLINK)
+                    continue;
 
-            if (nh->nlmsg_type == RTM_DELLINK) {
-                changed |= clear_link_state(g, ifname);
-                continue;
+                if (dump.active)
+                    dump_hold(nh);
+                else
+                    changed |= handle_link_msg(g, nh);
             }
+        }
 
-            changed |= apply_link_state(g, ifname, ifi->ifi_flags);
+        if (truncated) {
+            /* a message lost its tail: same as a dropped one */
+            resync_request();
         }
     }
 
+    /* new bindings have to pass from now on */
+    filter_update(g);
     return changed;
 }
 
@@ -323,5 +1054,16 @@ void signal_netlink_close(void)
     if (nl_fd >= 0) {
         close(nl_fd);
         nl_fd = -1;
+        filter_set = false;
     }
+
+    free(rx.buf);
+    rx.buf  = NULL;
+    rx.slot = 0;
+
+    free(dump.buf);
+    memset(&dump, 0, sizeof(dump));
+
+    free(resync.t);
+    memset(&resync, 0, sizeof(resync));
 }
\ No newline at end of file
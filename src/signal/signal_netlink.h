@@ -1,6 +1,8 @@
 #ifndef LNMGR_SIGNAL_NETLINK_H
 #define LNMGR_SIGNAL_NETLINK_H
 
+#include <stdint.h>
+
 #include "graph.h"
 
 /*
@@ -10,19 +12,54 @@
  *   - "carrier"  (IFF_LOWER_UP)
  *
  * Lifecycle:
- *   - signal_netlink_fd() opens socket and performs initial dump
- *   - signal_netlink_handle() processes readable events
+ *   - signal_netlink_fd() opens the socket
+ *   - signal_netlink_sync() requests a link dump
+ *   - signal_netlink_handle() processes readable events, dump replies
+ *     included
  *   - signal_netlink_close() releases resources
  */
 
-/* Returns netlink fd, opening and syncing on first call */
+/* Returns netlink fd, opening it on first call */
 int  signal_netlink_fd(void);
 
+/*
+ * Request a full link dump. It does not block: replies are processed
+ * by signal_netlink_handle() as they arrive. If a dump is already
+ * running another one follows it.
+ */
 int signal_netlink_sync(struct graph *g);
 
+/* a dump is in flight: the link view is incomplete */
+bool signal_netlink_syncing(void);
+
+/*
+ * After lost notifications the graph's links are re-queried one by
+ * one, rate-limited. poll() timeout in ms until signal_netlink_tick()
+ * has a resync to start, -1 if none.
+ */
+int  signal_netlink_timeout(void);
+void signal_netlink_tick(struct graph *g);
+
 /* Handle one readable netlink event */
 bool signal_netlink_handle(struct graph *g);
 
+/*
+ * Receive counters, reported by the STATS command. datagrams and
+ * messages over recv_calls give the batching a burst gets.
+ */
+struct signal_netlink_stats {
+    uint64_t recv_calls;    /* recvmmsg() calls, empty ones included */
+    uint64_t datagrams;
+    uint64_t messages;      /* netlink messages in those datagrams */
+    uint64_t batch_max;     /* most datagrams a single call returned */
+    uint64_t truncated;     /* datagrams larger than their buffer */
+    uint64_t overruns;      /* ENOBUFS: the socket buffer overflowed */
+    uint64_t resyncs;       /* targeted resyncs started after losses */
+    uint64_t resync_queries;
+};
+
+const struct signal_netlink_stats *signal_netlink_stats(void);
+
 /* Close netlink socket */
 void signal_netlink_close(void);
 
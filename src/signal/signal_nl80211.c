@@ -1,4 +1,6 @@
 // SPDX-License-Identifier: MIT
+#define _GNU_SOURCE
+
 #include <linux/netlink.h>
 #include <linux/genetlink.h>
 #include <linux/nl80211.h>
@@ -6,19 +8,31 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>     /* fcntl, F_GETFL, F_SETFL, O_NONBLOCK */
 #include <unistd.h>
 #include <sys/socket.h>
-#include <net/if.h>
 
 #include "signal_nl80211.h"
 #include "graph.h"
+#include "node.h"
 
 /* ------------------------------------------------------------ */
 /* globals */
 
-static int nl_fd = -1;
-static int nl80211_family = -1;
+static int      nl_fd = -1;
+static int      nl80211_family = -1;
+static uint32_t nl_portid;
+static uint32_t nl_seq;
+
+static signal_atom_t atom_beaconing  = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_associated = SIGNAL_ATOM_NONE;
+static signal_atom_t atom_connected  = SIGNAL_ATOM_NONE;
+
+/* family replies and interface dumps run large */
+static char rxbuf[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
 
 /* ------------------------------------------------------------ */
 /* minimal NLA helpers (kernel ABI compatible) */
@@ -37,18 +51,68 @@ static inline struct nlattr *nla_next(const struct nlattr *nla, int *rem)
     return (struct nlattr *)((char *)nla + len);
 }
 
+static inline void *nla_data(const struct nlattr *nla)
+{
+    return (char *)nla + NLA_HDRLEN;
+}
+
+static inline int nla_payload(const struct nlattr *nla)
+{
+    return nla->nla_len - NLA_HDRLEN;
+}
+
 static inline uint32_t nla_get_u32(const struct nlattr *nla)
 {
-    return *(uint32_t *)((char *)nla + NLA_HDRLEN);
+    return *(uint32_t *)nla_data(nla);
+}
+
+/* first attribute of a genl message */
+static inline struct nlattr *genl_attrs(const struct nlmsghdr *nlh, int *rem)
+{
+    *rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    return (struct nlattr *)((char *)NLMSG_DATA(nlh) + GENL_HDRLEN);
 }
 
 /* ------------------------------------------------------------ */
-/* resolve generic netlink family ID */
+/* resolve generic netlink family ID and multicast groups */
 
-static int genl_resolve_family(int fd, const char *name)
+struct genl_group {
+    const char *name;
+    int         id;     /* -1 until resolved */
+};
+
+static void genl_parse_groups(const struct nlattr *groups,
+                              struct genl_group *want, size_t n_want)
 {
-    char buf[512];
+    int rem = nla_payload(groups);
+
+    for (struct nlattr *grp = nla_data(groups); nla_ok(grp, rem);
+         grp = nla_next(grp, &rem)) {
+        const char *name = NULL;
+        int id = -1;
+        int grem = nla_payload(grp);
+
+        for (struct nlattr *na = nla_data(grp); nla_ok(na, grem);
+             na = nla_next(na, &grem)) {
+            if (na->nla_type == CTRL_ATTR_MCAST_GRP_NAME &&
+                nla_payload(na) > 0 &&
+                ((char *)nla_data(na))[nla_payload(na) - 1] == '\0')
+                name = nla_data(na);
+            else if (na->nla_type == CTRL_ATTR_MCAST_GRP_ID &&
+                     nla_payload(na) >= 4)
+                id = (int)nla_get_u32(na);
+        }
 
+        for (size_t i = 0; name && i < n_want; i++)
+            if (strcmp(want[i].name, name) == 0)
+                want[i].id = id;
+    }
+}
+
+/* runs before the socket turns non-blocking */
+static int genl_resolve_family(int fd, const char *name,
+                               struct genl_group *groups, size_t n_groups)
+{
     struct {
         struct nlmsghdr     nlh;
         struct genlmsghdr   genl;
@@ -70,6 +134,9 @@ static int genl_resolve_family(int fd, const char *name)
     };
 
     size_t nlen = strlen(name) + 1;
+    if (nlen > sizeof(req.name))
+        return -1;
+
     req.attr.nla_len = NLA_HDRLEN + nlen;
     memcpy(req.name, name, nlen);
 
@@ -78,139 +145,626 @@ static int genl_resolve_family(int fd, const char *name)
     if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0)
         return -1;
 
-    ssize_t len = recv(fd, buf, sizeof(buf), 0);
-    if (len < 0)
+    ssize_t len = recv(fd, rxbuf, sizeof(rxbuf), MSG_TRUNC);
+    if (len < 0 || (size_t)len > sizeof(rxbuf))
         return -1;
 
-    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+    int family = -1;
+
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)rxbuf;
          NLMSG_OK(nlh, len);
          nlh = NLMSG_NEXT(nlh, len)) {
 
-        struct genlmsghdr *genl = NLMSG_DATA(nlh);
-        struct nlattr *na = (struct nlattr *)((char *)genl + GENL_HDRLEN);
-        int rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+        if (nlh->nlmsg_type != GENL_ID_CTRL)
+            continue;   /* NLMSG_ERROR: no such family */
+
+        int rem;
+        for (struct nlattr *na = genl_attrs(nlh, &rem); nla_ok(na, rem);
+             na = nla_next(na, &rem)) {
+            if (na->nla_type == CTRL_ATTR_FAMILY_ID &&
+                nla_payload(na) >= 2)
+                family = *(uint16_t *)nla_data(na);
+            else if (na->nla_type == CTRL_ATTR_MCAST_GROUPS)
+                genl_parse_groups(na, groups, n_groups);
+        }
+    }
+
+    return family;
+}
+
+/* ------------------------------------------------------------ */
+/* per-ifindex cache                                            */
+
+/*
+ * What nl80211 last reported for each wireless interface. Events
+ * arrive for links no node is bound to yet; the cache lets a later
+ * binding pick the state up (signal_nl80211_refresh).
+ */
+struct wifi_iface {
+    int                 ifindex;
+    uint32_t            iftype;     /* NL80211_IFTYPE_*, 0 if unknown */
+    bool                beaconing;
+    bool                associated;
+    bool                connected;
+    bool                seen;       /* by the interface dump in flight */
+    bool                stations;   /* station dump still to run */
+    struct wifi_iface  *next;
+};
+
+static struct wifi_iface *ifaces;
+
+static struct wifi_iface *iface_find(int ifindex)
+{
+    for (struct wifi_iface *w = ifaces; w; w = w->next)
+        if (w->ifindex == ifindex)
+            return w;
+    return NULL;
+}
+
+static struct wifi_iface *iface_get(int ifindex)
+{
+    struct wifi_iface *w = iface_find(ifindex);
+    if (w)
+        return w;
+
+    w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+
+    w->ifindex = ifindex;
+    w->next    = ifaces;
+    ifaces     = w;
+    return w;
+}
+
+static bool iftype_ap(uint32_t t)
+{
+    return t == NL80211_IFTYPE_AP || t == NL80211_IFTYPE_P2P_GO;
+}
+
+static bool iftype_sta(uint32_t t)
+{
+    return t == NL80211_IFTYPE_STATION || t == NL80211_IFTYPE_P2P_CLIENT;
+}
+
+static void cache_flush(void)
+{
+    while (ifaces) {
+        struct wifi_iface *w = ifaces;
+        ifaces = w->next;
+        free(w);
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* cache → signals                                              */
+
+/*
+ * Dump in flight: interfaces first, then the stations of each station
+ * mode interface, one at a time; 0 when idle.
+ */
+static struct {
+    uint8_t  cmd;
+    uint32_t seq;
+    int      ifindex;       /* GET_STATION: interface dumped */
+    bool     station;       /* GET_STATION: the AP answered */
+    bool     authorized;
+    bool     again;         /* start over once this one is done */
+} dump;
+
+static bool apply_iface(struct graph *g, const struct wifi_iface *w)
+{
+    struct node *n = graph_find_ifindex(g, w->ifindex);
+    bool changed = false;
+
+    if (!n || !n->present)
+        return false;
+
+    /* an interface changing mode drops what the old mode reported */
+    changed |= graph_set_signal_atom_carried(g, n, atom_beaconing,
+                        iftype_ap(w->iftype) && w->beaconing);
+    changed |= graph_set_signal_atom_carried(g, n, atom_associated,
+                        iftype_sta(w->iftype) && w->associated);
+    changed |= graph_set_signal_atom_carried(g, n, atom_connected,
+                        iftype_sta(w->iftype) && w->connected);
+    return changed;
+}
+
+/* a node whose link is not wireless (anymore) reports nothing */
+static bool apply_node(struct graph *g, struct node *n)
+{
+    if (!n->present || n->ifindex <= 0)
+        return false;
+
+    const struct wifi_iface *w = iface_find(n->ifindex);
+    if (w)
+        return apply_iface(g, w);
+
+    bool changed = false;
+    changed |= graph_set_signal_atom_carried(g, n, atom_beaconing,  false);
+    changed |= graph_set_signal_atom_carried(g, n, atom_associated, false);
+    changed |= graph_set_signal_atom_carried(g, n, atom_connected,  false);
+    return changed;
+}
+
+static bool apply_all(struct graph *g)
+{
+    return graph_update_nodes(g, apply_node);
+}
+
+/* ------------------------------------------------------------ */
+/* messages                                                     */
 
-        for (; nla_ok(na, rem); na = nla_next(na, &rem)) {
-            if (na->nla_type == CTRL_ATTR_FAMILY_ID)
-                return *(int *)((char *)na + NLA_HDRLEN);
+/* NEW_INTERFACE / SET_INTERFACE, dumped or announced */
+static bool iface_msg(struct graph *g, const struct nlmsghdr *nlh)
+{
+    int ifindex = 0;
+    uint32_t iftype = NL80211_IFTYPE_UNSPECIFIED;
+    bool ssid = false;
+    int rem;
+
+    for (struct nlattr *na = genl_attrs(nlh, &rem); nla_ok(na, rem);
+         na = nla_next(na, &rem)) {
+        switch (na->nla_type) {
+        case NL80211_ATTR_IFINDEX:
+            if (nla_payload(na) >= 4)
+                ifindex = (int)nla_get_u32(na);
+            break;
+        case NL80211_ATTR_IFTYPE:
+            if (nla_payload(na) >= 4)
+                iftype = nla_get_u32(na);
+            break;
+        case NL80211_ATTR_SSID:
+            ssid = nla_payload(na) > 0;
+            break;
+        default:
+            break;
         }
     }
 
-    return -1;
+    if (ifindex <= 0)
+        return false;   /* wdev without a netdev (P2P device) */
+
+    struct wifi_iface *w = iface_get(ifindex);
+    if (!w)
+        return false;
+
+    if (w->iftype != iftype) {
+        w->associated = false;
+        w->connected  = false;
+    }
+    w->iftype = iftype;
+    w->seen   = true;
+
+    /* an AP only reports its SSID while it beacons */
+    w->beaconing = iftype_ap(iftype) && ssid;
+
+    return apply_iface(g, w);
+}
+
+static bool iface_del(struct graph *g, int ifindex)
+{
+    for (struct wifi_iface **pp = &ifaces; *pp; pp = &(*pp)->next) {
+        struct wifi_iface *w = *pp;
+
+        if (w->ifindex != ifindex)
+            continue;
+
+        *pp = w->next;
+        free(w);
+
+        struct node *n = graph_find_ifindex(g, ifindex);
+        return n ? apply_node(g, n) : false;
+    }
+
+    return false;
+}
+
+/* a GET_STATION reply of a station mode interface: its AP */
+static void station_msg(const struct nlmsghdr *nlh)
+{
+    int rem;
+
+    dump.station = true;
+
+    for (struct nlattr *na = genl_attrs(nlh, &rem); nla_ok(na, rem);
+         na = nla_next(na, &rem)) {
+        if (na->nla_type != NL80211_ATTR_STA_INFO)
+            continue;
+
+        int irem = nla_payload(na);
+        for (struct nlattr *ia = nla_data(na); nla_ok(ia, irem);
+             ia = nla_next(ia, &irem)) {
+            if (ia->nla_type != NL80211_STA_INFO_STA_FLAGS ||
+                nla_payload(ia) < (int)sizeof(struct nl80211_sta_flag_update))
+                continue;
+
+            const struct nl80211_sta_flag_update *f = nla_data(ia);
+            if (f->set & (1u << NL80211_STA_FLAG_AUTHORIZED))
+                dump.authorized = true;
+        }
+    }
+}
+
+/* MLME events of one interface */
+static bool mlme_msg(struct graph *g, const struct nlmsghdr *nlh,
+                     uint8_t cmd)
+{
+    int ifindex = 0;
+    uint16_t status = 0;
+    int rem;
+
+    switch (cmd) {
+    case NL80211_CMD_START_AP:
+    case NL80211_CMD_STOP_AP:
+    case NL80211_CMD_CONNECT:
+    case NL80211_CMD_DISCONNECT:
+    case NL80211_CMD_PORT_AUTHORIZED:
+        break;
+    default:
+        return false;
+    }
+
+    for (struct nlattr *na = genl_attrs(nlh, &rem); nla_ok(na, rem);
+         na = nla_next(na, &rem)) {
+        if (na->nla_type == NL80211_ATTR_IFINDEX &&
+            nla_payload(na) >= 4)
+            ifindex = (int)nla_get_u32(na);
+        else if (na->nla_type == NL80211_ATTR_STATUS_CODE &&
+                 nla_payload(na) >= 2)
+            status = *(uint16_t *)nla_data(na);
+    }
+
+    if (ifindex <= 0)
+        return false;
+
+    struct wifi_iface *w = iface_get(ifindex);
+    if (!w)
+        return false;
+
+    switch (cmd) {
+
+    /* --- AP events --- */
+    case NL80211_CMD_START_AP:
+    case NL80211_CMD_STOP_AP:
+        if (!w->iftype)
+            w->iftype = NL80211_IFTYPE_AP;
+        w->beaconing = (cmd == NL80211_CMD_START_AP);
+        break;
+
+    /* --- STA events --- */
+    case NL80211_CMD_CONNECT:
+    case NL80211_CMD_DISCONNECT: {
+        /* a failed attempt is reported as CONNECT with a status */
+        bool assoc = (cmd == NL80211_CMD_CONNECT && status == 0);
+
+        if (!w->iftype)
+            w->iftype = NL80211_IFTYPE_STATION;
+        w->associated = assoc;
+        w->connected  = false;  /* the port is authorized after this */
+        break;
+    }
+
+    default:    /* NL80211_CMD_PORT_AUTHORIZED */
+        w->connected = w->associated;
+        break;
+    }
+
+    /* the dump in flight may predate this; it is applied as it ends */
+    if (dump.cmd == NL80211_CMD_GET_STATION && dump.ifindex == ifindex) {
+        dump.station    = w->associated;
+        dump.authorized = w->connected;
+    }
+
+    return apply_iface(g, w);
 }
 
 /* ------------------------------------------------------------ */
 /* socket init */
 
-int signal_nl80211_fd(void)
+static int open_genl(void)
 {
-    if (nl_fd >= 0)
-        return nl_fd;
+    struct genl_group groups[] = {
+        { NL80211_MULTICAST_GROUP_MLME,   -1 },
+        { NL80211_MULTICAST_GROUP_CONFIG, -1 },
+    };
 
-    nl_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
-    if (nl_fd < 0)
+    int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+    if (fd < 0)
         return -1;
 
     struct sockaddr_nl sa = {
         .nl_family = AF_NETLINK,
     };
 
-    if (bind(nl_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+        goto fail;
+
+    /* dump replies are addressed to it */
+    socklen_t salen = sizeof(sa);
+    if (getsockname(fd, (struct sockaddr *)&sa, &salen) < 0)
         goto fail;
+    nl_portid = sa.nl_pid;
 
-    nl80211_family = genl_resolve_family(nl_fd, "nl80211");
+    nl80211_family = genl_resolve_family(fd, "nl80211",
+                                         groups,
+                                         sizeof(groups) / sizeof(groups[0]));
     if (nl80211_family < 0)
         goto fail;
 
-    return nl_fd;
+    /* AP and STA events come from mlme; interfaces from config */
+    for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (groups[i].id < 0 ||
+            setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                       &groups[i].id, sizeof(groups[i].id)) < 0) {
+            fprintf(stderr, "nl80211: cannot join group %s\n",
+                    groups[i].name);
+            goto fail;
+        }
+    }
+
+    int rcvbuf = 1024 * 1024;   /* 1 MB */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                   &rcvbuf, sizeof(rcvbuf)) < 0)
+        perror("setsockopt(SO_RCVBUF)");
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        goto fail;
+
+    return fd;
 
 fail:
-    close(nl_fd);
-    nl_fd = -1;
+    close(fd);
+    nl80211_family = -1;
     return -1;
 }
 
-int signal_nl80211_sync(struct graph *g)
+int signal_nl80211_fd(void)
 {
-    (void)g;
-    return 0;
+    if (nl_fd >= 0)
+        return nl_fd;
+
+    atom_beaconing  = signal_atom_intern("beaconing");
+    atom_associated = signal_atom_intern("associated");
+    atom_connected  = signal_atom_intern("connected");
+
+    nl_fd = open_genl();
+    return nl_fd;
 }
 
 /* ------------------------------------------------------------ */
-/* event handler */
+/* dumps                                                        */
 
-bool signal_nl80211_handle(struct graph *g)
+static int dump_start(uint8_t cmd, int ifindex)
 {
-    char buf[8192];
-    bool changed = false;
+    struct {
+        struct nlmsghdr     nlh;
+        struct genlmsghdr   genl;
+        struct nlattr       attr;
+        uint32_t            ifindex;
+    } req = {
+        .nlh = {
+            .nlmsg_len   = NLMSG_LENGTH(GENL_HDRLEN),
+            .nlmsg_type  = (uint16_t)nl80211_family,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+        },
+        .genl = {
+            .cmd = cmd,
+        },
+        .attr = {
+            .nla_len  = NLA_HDRLEN + sizeof(uint32_t),
+            .nla_type = NL80211_ATTR_IFINDEX,
+        },
+        .ifindex = (uint32_t)ifindex,
+    };
 
-    ssize_t len = recv(nl_fd, buf, sizeof(buf), 0);
-    if (len < 0) {
-        if (errno == EINTR)
-            return false;
-        return false;
+    if (ifindex > 0)
+        req.nlh.nlmsg_len += NLA_ALIGN(req.attr.nla_len);
+
+    if (++nl_seq == 0)
+        nl_seq = 1;
+    req.nlh.nlmsg_seq = nl_seq;
+
+    if (send(nl_fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+        dump.cmd = 0;
+        return -1;
     }
 
-    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
-         NLMSG_OK(nlh, len);
-         nlh = NLMSG_NEXT(nlh, len)) {
+    dump.cmd        = cmd;
+    dump.seq        = nl_seq;
+    dump.ifindex    = ifindex;
+    dump.station    = false;
+    dump.authorized = false;
+    return 0;
+}
+
+static bool dump_owns(const struct nlmsghdr *nh)
+{
+    return dump.cmd &&
+           nh->nlmsg_seq == dump.seq &&
+           nh->nlmsg_pid == nl_portid;
+}
 
-        if (nlh->nlmsg_type != nl80211_family)
+/* next station mode interface whose AP is still to be asked for */
+static bool dump_next_station(void)
+{
+    for (struct wifi_iface *w = ifaces; w; w = w->next) {
+        if (!w->stations)
             continue;
 
-        struct genlmsghdr *genl = NLMSG_DATA(nlh);
+        w->stations = false;
+        if (dump_start(NL80211_CMD_GET_STATION, w->ifindex) == 0)
+            return true;
+
+        perror("nl80211: station dump");
+    }
+
+    return false;
+}
+
+/* NLMSG_DONE (or an error) of the dump in flight */
+static bool dump_done(struct graph *g)
+{
+    bool changed = false;
+
+    if (dump.cmd == NL80211_CMD_GET_INTERFACE) {
+        /* interfaces the dump did not list are gone */
+        for (struct wifi_iface **pp = &ifaces; *pp; ) {
+            struct wifi_iface *w = *pp;
+
+            if (!w->seen) {
+                *pp = w->next;
+                free(w);
+                continue;
+            }
+
+            w->seen     = false;
+            w->stations = iftype_sta(w->iftype);
+            pp = &w->next;
+        }
 
-        /* --- extract ifname --- */
-        char ifname[IF_NAMESIZE];
-        bool have_ifname = false;
+        changed |= apply_all(g);
+    } else if (dump.cmd == NL80211_CMD_GET_STATION) {
+        /* no entry (or an error): not associated */
+        struct wifi_iface *w = iface_find(dump.ifindex);
+        if (w) {
+            w->associated = dump.station;
+            w->connected  = dump.station && dump.authorized;
+            changed |= apply_iface(g, w);
+        }
+    }
 
-        struct nlattr *na =
-            (struct nlattr *)((char *)genl + GENL_HDRLEN);
-        int rem = nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    dump.cmd = 0;
+
+    if (dump.again) {
+        dump.again = false;
+        signal_nl80211_sync(g);
+        return changed;
+    }
+
+    dump_next_station();
+    return changed;
+}
+
+int signal_nl80211_sync(struct graph *g)
+{
+    (void)g;
+
+    if (nl_fd < 0)
+        return -1;
+
+    if (dump.cmd) {
+        dump.again = true;
+        return 0;
+    }
+
+    /* signals keep their values until the dumps are through */
+    for (struct wifi_iface *w = ifaces; w; w = w->next) {
+        w->seen     = false;
+        w->stations = false;
+    }
+
+    return dump_start(NL80211_CMD_GET_INTERFACE, 0);
+}
+
+/* ------------------------------------------------------------ */
+/* event handler */
 
-        for (; nla_ok(na, rem); na = nla_next(na, &rem)) {
-            if (na->nla_type == NL80211_ATTR_IFINDEX) {
-                int ifindex = nla_get_u32(na);
-                if (if_indextoname(ifindex, ifname))
-                    have_ifname = true;
+bool signal_nl80211_handle(struct graph *g)
+{
+    bool changed = false;
+
+    if (nl_fd < 0)
+        return false;
+
+    for (;;) {
+        ssize_t len = recv(nl_fd, rxbuf, sizeof(rxbuf), MSG_TRUNC);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                /* kernel dropped events */
+                signal_nl80211_sync(g);
+                continue;
             }
+            if (errno == EINTR)
+                continue;
+
+            break;  /* EAGAIN: drained */
         }
 
-        if (!have_ifname)
+        if ((size_t)len > sizeof(rxbuf)) {
+            /* a message lost its tail: same as a dropped one */
+            signal_nl80211_sync(g);
             continue;
+        }
 
-        struct node *n = graph_find_node(g, ifname);
-        if (!n || !n->present)
-            continue;
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)rxbuf;
+             NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
 
-        switch (genl->cmd) {
+            if (dump_owns(nlh) && (nlh->nlmsg_type == NLMSG_DONE ||
+                                   nlh->nlmsg_type == NLMSG_ERROR)) {
+                changed |= dump_done(g);
+                continue;
+            }
 
-        /* --- AP events --- */
-        case NL80211_CMD_START_AP:
-        case NL80211_CMD_STOP_AP: {
-            bool up = (genl->cmd == NL80211_CMD_START_AP);
+            if (nlh->nlmsg_type != nl80211_family)
+                continue;
+
+            const struct genlmsghdr *genl = NLMSG_DATA(nlh);
+
+            switch (genl->cmd) {
+            case NL80211_CMD_NEW_INTERFACE:
+            case NL80211_CMD_SET_INTERFACE:
+                changed |= iface_msg(g, nlh);
+                break;
+
+            case NL80211_CMD_DEL_INTERFACE: {
+                int rem;
+                for (struct nlattr *na = genl_attrs(nlh, &rem);
+                     nla_ok(na, rem); na = nla_next(na, &rem)) {
+                    if (na->nla_type == NL80211_ATTR_IFINDEX &&
+                        nla_payload(na) >= 4) {
+                        changed |= iface_del(g, (int)nla_get_u32(na));
+                        break;
+                    }
+                }
+                break;
+            }
 
-            changed |= graph_set_signal(g, ifname, "beaconing", up);
-            break;
+            case NL80211_CMD_NEW_STATION:
+                if (dump_owns(nlh) && dump.cmd == NL80211_CMD_GET_STATION)
+                    station_msg(nlh);
+                break;
+
+            default:
+                changed |= mlme_msg(g, nlh, genl->cmd);
+                break;
+            }
         }
+    }
 
-        /* --- STA events --- */
-        case NL80211_CMD_CONNECT:
-        case NL80211_CMD_DISCONNECT: {
-            bool assoc = (genl->cmd == NL80211_CMD_CONNECT);
-            bool conn  = assoc;
+    return changed;
+}
 
-            changed |= graph_set_signal(g, ifname, "associated", assoc);
-            changed |= graph_set_signal(g, ifname, "connected",  conn);
-            break;
-        }
+bool signal_nl80211_refresh(struct graph *g)
+{
+    if (nl_fd < 0 || dump.cmd == NL80211_CMD_GET_INTERFACE)
+        return false;
 
-        default:
-            break;
-        }    
+    /*
+     * A supplicant authorizes the port without an nl80211 event, then
+     * sets the link's operstate: ask the AP again on link changes.
+     */
+    for (struct wifi_iface *w = ifaces; w; w = w->next) {
+        if (iftype_sta(w->iftype) && w->associated && !w->connected)
+            w->stations = true;
     }
 
-    return changed;
+    if (!dump.cmd)
+        dump_next_station();
+
+    return apply_all(g);
 }
 
 /* ------------------------------------------------------------ */
@@ -221,4 +775,7 @@ void signal_nl80211_close(void)
         close(nl_fd);
         nl_fd = -1;
     }
-}
\ No newline at end of file
+
+    cache_flush();
+    memset(&dump, 0, sizeof(dump));
+}
@@ -6,20 +6,34 @@
 /*
  * nl80211 signal producer
  *
- * Produces graph signals (per ifname):
- *   - "associated"
- *   - "authenticated"
- *   - "connected"
+ * Produces graph signals (per bound ifindex):
+ *   - "beaconing"   an AP / P2P GO interface is beaconing
+ *   - "associated"  a station interface is associated with an AP
+ *   - "connected"   ... and its port is authorized
+ *
+ * Like the address signals they are only maintained on nodes that
+ * carry them (config "signals").
  *
  * Lifecycle:
- *   - signal_nl80211_fd() opens socket and subscribes
- *   - signal_nl80211_handle() processes readable events
+ *   - signal_nl80211_fd() opens the socket and joins the "mlme" and
+ *     "config" multicast groups
+ *   - signal_nl80211_sync() requests interface and station dumps
+ *   - signal_nl80211_handle() drains readable events, dump replies
+ *     included
+ *   - signal_nl80211_refresh() re-derives the signals after link changes
  *   - signal_nl80211_close() releases resources
  */
 
 int  signal_nl80211_fd(void);
-int signal_nl80211_sync(struct graph *g);
+int  signal_nl80211_sync(struct graph *g);
 bool signal_nl80211_handle(struct graph *g);
+
+/*
+ * links moved (ifindex bindings, operstate): apply the cached wifi
+ * state, and dump the stations still waiting for port authorization
+ */
+bool signal_nl80211_refresh(struct graph *g);
+
 void signal_nl80211_close(void);
 
-#endif /* LNMGR_SIGNAL_NL80211_H */
\ No newline at end of file
+#endif /* LNMGR_SIGNAL_NL80211_H */
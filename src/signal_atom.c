@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "signal_atom.h"
+
+static char  *atom_names[SIGNAL_ATOM_MAX];
+static int    atom_count;
+
+signal_atom_t signal_atom_lookup(const char *name)
+{
+    if (!name)
+        return SIGNAL_ATOM_NONE;
+
+    for (int i = 0; i < atom_count; i++) {
+        if (strcmp(atom_names[i], name) == 0)
+            return i;
+    }
+    return SIGNAL_ATOM_NONE;
+}
+
+signal_atom_t signal_atom_intern(const char *name)
+{
+    signal_atom_t a = signal_atom_lookup(name);
+    if (a != SIGNAL_ATOM_NONE || !name)
+        return a;
+
+    if (atom_count == SIGNAL_ATOM_MAX) {
+        fprintf(stderr, "signal '%s': too many distinct signals (max %d)\n",
+                name, SIGNAL_ATOM_MAX);
+        return SIGNAL_ATOM_NONE;
+    }
+
+    char *copy = strdup(name);
+    if (!copy)
+        return SIGNAL_ATOM_NONE;
+
+    atom_names[atom_count] = copy;
+    return atom_count++;
+}
+
+const char *signal_atom_name(signal_atom_t atom)
+{
+    if (atom < 0 || atom >= atom_count)
+        return NULL;
+
+    return atom_names[atom];
+}
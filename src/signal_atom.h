@@ -0,0 +1,41 @@
+#ifndef LNMGR_SIGNAL_ATOM_H
+#define LNMGR_SIGNAL_ATOM_H
+
+#include <stdint.h>
+
+/*
+ * Signal atoms
+ *
+ * Signal names are interned once into small integers. Nodes keep their
+ * signals as bitmasks indexed by atom, so readiness checks and producer
+ * updates never touch strings.
+ *
+ * The table is global and append-only; atoms stay valid for the life
+ * of the process.
+ */
+
+typedef int signal_atom_t;
+
+#define SIGNAL_ATOM_NONE  (-1)
+#define SIGNAL_ATOM_MAX   64    /* bits in a node signal mask */
+
+/* Returns the atom for name, creating it; SIGNAL_ATOM_NONE if full */
+signal_atom_t signal_atom_intern(const char *name);
+
+/* Returns the atom for name, or SIGNAL_ATOM_NONE if never interned */
+signal_atom_t signal_atom_lookup(const char *name);
+
+const char *signal_atom_name(signal_atom_t atom);
+
+static inline uint64_t signal_atom_bit(signal_atom_t atom)
+{
+    return (uint64_t)1 << atom;
+}
+
+/* lowest atom set in mask; iterate with mask &= mask - 1 */
+static inline signal_atom_t signal_atom_first(uint64_t mask)
+{
+    return mask ? __builtin_ctzll(mask) : SIGNAL_ATOM_NONE;
+}
+
+#endif /* LNMGR_SIGNAL_ATOM_H */
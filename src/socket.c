@@ -3,6 +3,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -13,6 +14,8 @@
 #include "enum_str.h"
 #include "actions.h"
 #include "graph.h"
+#include "plan.h"
+#include "signal/signal_netlink.h"
 
 static struct subscriber *subscribers = NULL;
 
@@ -54,7 +57,7 @@ static bool fd_printf_nb(int fd, const char *fmt, ...)
 
 static bool json_emit_signals_nb(int fd, struct node *n)
 {
-    if (!n->signals)
+    if (!n->sig_mask)
         return true;
 
     if (!write_all(fd, ", \"signals\": {", 14))
@@ -62,7 +65,9 @@ static bool json_emit_signals_nb(int fd, struct node *n)
 
     bool first = true;
 
-    for (struct signal *s = n->signals; s; s = s->next) {
+    for (uint64_t m = n->sig_mask; m; m &= m - 1) {
+        signal_atom_t a = signal_atom_first(m);
+
         if (!first) {
             if (!write_all(fd, ", ", 2))
                 return false;
@@ -72,8 +77,8 @@ static bool json_emit_signals_nb(int fd, struct node *n)
         char buf[256];
         int len = snprintf(buf, sizeof(buf),
             "\"%s\": %s",
-            s->name,
-            s->value ? "true" : "false");
+            signal_atom_name(a),
+            (n->sig_value & signal_atom_bit(a)) ? "true" : "false");
 
         if (len < 0 || len >= (int)sizeof(buf))
             return false;
@@ -88,82 +93,69 @@ static bool json_emit_signals_nb(int fd, struct node *n)
     return true;
 }
 
+/*
+ * Subscriber state is addressed by node->idx, so diffing a notify is a
+ * linear walk. A slot whose id no longer matches was handed to another
+ * node (deletion or reload) and starts over as unknown.
+ */
 static struct node_state *
-subscriber_get_node(struct subscriber *s, const char *id)
+subscriber_get_node(struct subscriber *s, struct node *n)
 {
-    for (struct node_state *ns = s->states; ns; ns = ns->next) {
-        if (strcmp(ns->id, id) == 0)
-            return ns;
+    if (n->idx >= s->states_n) {
+        size_t cap = s->states_n ? s->states_n * 2 : 16;
+        while (cap <= n->idx)
+            cap *= 2;
+
+        struct node_state *st = realloc(s->states, cap * sizeof(*st));
+        if (!st)
+            return NULL;
+
+        memset(st + s->states_n, 0, (cap - s->states_n) * sizeof(*st));
+        s->states   = st;
+        s->states_n = cap;
     }
 
-    struct node_state *ns = calloc(1, sizeof(*ns));
-    if (!ns)
-        return NULL;
+    struct node_state *ns = &s->states[n->idx];
 
-    ns->id = strdup(id);
-    if (!ns->id) {
-        free(ns);
+    if (ns->id && strcmp(ns->id, n->id) == 0)
+        return ns;
+
+    free(ns->id);
+    ns->id = strdup(n->id);
+    if (!ns->id)
         return NULL;
-    }
 
     ns->last.status = LNMGR_STATUS_UNKNOWN;
     ns->last.code   = LNMGR_CODE_NONE;
-
-    ns->next = s->states;
-    s->states = ns;
+    ns->sig_value   = 0;
 
     return ns;
 }
 
-static struct signal_state *
-signal_state_get(struct signal_state **list, const char *name)
+static void subscriber_free(struct subscriber *s)
 {
-    for (struct signal_state *ss = *list; ss; ss = ss->next) {
-        if (strcmp(ss->name, name) == 0)
-            return ss;
-    }
-
-    struct signal_state *ss = calloc(1, sizeof(*ss));
-    if (!ss)
-        return NULL;
-
-    ss->name = strdup(name);
-    if (!ss->name) {
-        free(ss);
-        return NULL;
-    }
+    for (size_t i = 0; i < s->states_n; i++)
+        free(s->states[i].id);
 
-    ss->value = false;
-
-    ss->next = *list;
-    *list = ss;
-
-    return ss;
+    free(s->states);
+    free(s);
 }
 
+/*
+ * Only signals the node carries count; a signal that just appeared
+ * with value false is not a change (the snapshot started at false).
+ */
 static bool
 signals_changed(struct node_state *ns, struct node *n)
 {
-    bool changed = false;
-
-    for (struct signal *s = n->signals; s; s = s->next) {
-        struct signal_state *ss =
-            signal_state_get(&ns->signals, s->name);
-        if (!ss)
-            continue;
-
-        if (ss->value != s->value) {
-            ss->value = s->value;
-            changed = true;
-        }
-    }
+    uint64_t diff = (ns->sig_value ^ n->sig_value) & n->sig_mask;
 
-    return changed;
+    ns->sig_value = n->sig_value & n->sig_mask;
+    return diff != 0;
 }
 
 static bool socket_send_event(int fd,
-                              struct graph *g,
-                              const char *id,
+                              struct node *n,
                               const struct lnmgr_explain *ex)
 {
     const char *state = lnmgr_status_to_str(ex->status);
@@ -171,7 +163,7 @@ static bool socket_send_event(int fd,
 
      if (!fd_printf_nb(fd,
         "{ \"type\": \"event\", \"id\": \"%s\", \"state\": \"%s\"",
-        id, state))
+        n->id, state))
         return false;
 
     if (code) {
@@ -179,14 +171,8 @@ static bool socket_send_event(int fd,
             return false;
     }
     
-    struct node *n = graph_find_node(g, id);
-    if (n) {
-        if (!json_emit_signals_nb(fd, n))
-            return false;
-    } else {
-        if (!fd_printf_nb(fd, ", \"signals\": {}"))
-            return false;
-    }
+    if (!json_emit_signals_nb(fd, n))
+        return false;
 
     if (!fd_printf_nb(fd, " }\n"))
         return false;
@@ -202,7 +188,7 @@ static void drop_subscriber(struct subscriber *prev, struct subscriber *s)
         subscribers = s->next;
 
     close(s->fd);
-    free(s);
+    subscriber_free(s);
 }
 
 static void notify_subscribers(struct graph *g, bool admin_up)
@@ -213,11 +199,12 @@ static void notify_subscribers(struct graph *g, bool admin_up)
     while (s) {
         bool alive = true;
 
-        for (struct node *n = g->nodes; n; n = n->next) {
+        for (size_t i = 0; i < g->count; i++) {
+            struct node *n = g->vec[i];
             struct lnmgr_explain now =
                 lnmgr_status_for_node(g, n, admin_up);
 
-            struct node_state *ns = subscriber_get_node(s, n->id);
+            struct node_state *ns = subscriber_get_node(s, n);
             if (!ns)
                 continue;
 
@@ -234,7 +221,7 @@ static void notify_subscribers(struct graph *g, bool admin_up)
             if (!changed)
                 continue;
 
-            if (!socket_send_event(s->fd, g, n->id, &now)) {
+            if (!socket_send_event(s->fd, n, &now)) {
                 alive = false;
                 break;   /* stop sending to this subscriber */
             }
@@ -272,7 +259,12 @@ static bool send_snapshot(int fd, struct subscriber *s, struct graph *g)
 
     bool first = true;
 
-    for (struct node_state *ns = s->states; ns; ns = ns->next) {
+    for (size_t i = 0; i < s->states_n; i++) {
+        struct node_state *ns = &s->states[i];
+
+        if (!ns->id)
+            continue;
+
         if (!first) {
             if (!write_all(fd, ",", 1))
                 return false;
@@ -336,22 +328,14 @@ static bool send_snapshot(int fd, struct subscriber *s, struct graph *g)
 
 static void subscriber_init_states(struct subscriber *s, struct graph *g)
 {
-    struct node_state *tail = NULL;
-
-    for (struct node *n = g->nodes; n; n = n->next) {
-        struct node_state *ns = calloc(1, sizeof(*ns));
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+        struct node_state *ns = subscriber_get_node(s, n);
         if (!ns)
             continue;
 
-        ns->id = strdup(n->id);
         ns->last = lnmgr_status_for_node(g, n, true /* admin_up placeholder */);
-
-        if (!tail)
-            s->states = ns;
-        else
-            tail->next = ns;
-
-        tail = ns;
+        ns->sig_value = n->sig_value & n->sig_mask;
     }
 }
 
@@ -385,7 +369,7 @@ static void add_subscriber(int fd, struct graph *g)
 
         /* real error */
         close(fd);
-        free(s);
+        subscriber_free(s);
         return;
     }
 
@@ -460,10 +444,11 @@ static bool reply_status_all(int fd, struct graph *g)
     if (!fd_printf_nb(fd, "{ \"type\": \"status\", \"nodes\": ["))
         return false;
  
-    struct node *n = g->nodes;
     bool first = true;
 
-    while (n) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+
         if (!first) {
            if (!fd_printf_nb(fd, ","))
                 return false;
@@ -482,8 +467,6 @@ static bool reply_status_all(int fd, struct graph *g)
             code ? ", \"code\": \"" : "",
             code ? code : ""))
             return false;
- 
-        n = n->next;
     }
 
     if (!fd_printf_nb(fd, "] }\n"))
@@ -497,10 +480,11 @@ static bool reply_dump(int fd, struct graph *g)
     if (!fd_printf_nb(fd, "{ \"type\": \"dump\", \"nodes\": ["))
         return false;
 
-    struct node *n = g->nodes;
     bool first = true;
 
-    while (n) {
+    for (size_t i = 0; i < g->count; i++) {
+        struct node *n = g->vec[i];
+
         if (!first)
             if (!fd_printf_nb(fd, ","))
                 return false;
@@ -549,8 +533,6 @@ static bool reply_dump(int fd, struct graph *g)
 
         if (!fd_printf_nb(fd, " }"))
             return false;
-
-        n = n->next;
     }
 
     if (!fd_printf_nb(fd, "] }\n"))
@@ -566,6 +548,135 @@ static bool reply_save(int fd, struct graph *g)
     return true;
 }
 
+static bool reply_stats(int fd, struct graph *g)
+{
+    const struct graph_stats *st = &g->stats;
+    const struct signal_netlink_stats *nl = signal_netlink_stats();
+
+    if (!fd_printf_nb(fd,
+        "{ \"type\": \"stats\", "
+        "\"nodes\": %zu, "
+        "\"evaluations\": %" PRIu64 ", "
+        "\"activations\": %" PRIu64 ", "
+        "\"deactivations\": %" PRIu64 ", "
+        "\"netlink\": { "
+        "\"recv_calls\": %" PRIu64 ", "
+        "\"datagrams\": %" PRIu64 ", "
+        "\"messages\": %" PRIu64 ", "
+        "\"batch_max\": %" PRIu64 ", "
+        "\"truncated\": %" PRIu64 ", "
+        "\"overruns\": %" PRIu64 ", "
+        "\"resyncs\": %" PRIu64 ", "
+        "\"resync_queries\": %" PRIu64 " } }\n",
+        g->count,
+        st->evaluations,
+        st->activations,
+        st->deactivations,
+        nl->recv_calls,
+        nl->datagrams,
+        nl->messages,
+        nl->batch_max,
+        nl->truncated,
+        nl->overruns,
+        nl->resyncs,
+        nl->resync_queries))
+        return false;
+
+    return true;
+}
+
+static bool reply_plan_op(int fd, const struct plan_op *op)
+{
+    if (!fd_printf_nb(fd, "{ \"op\": \"%s\", \"link\": \"%s\"",
+                      plan_op_str(op->type), op->name ? op->name : ""))
+        return false;
+
+    switch (op->type) {
+    case PLAN_MASTER:
+        if (!fd_printf_nb(fd, ", \"master\": \"%s\"",
+                          op->master ? op->master : ""))
+            return false;
+        break;
+
+    case PLAN_VLAN_ADD:
+    case PLAN_VLAN_DEL:
+        if (op->first == op->last) {
+            if (!fd_printf_nb(fd, ", \"vlans\": \"%u\"", op->first))
+                return false;
+        } else {
+            if (!fd_printf_nb(fd, ", \"vlans\": \"%u-%u\"",
+                              op->first, op->last))
+                return false;
+        }
+        if (op->type == PLAN_VLAN_ADD &&
+            !fd_printf_nb(fd, ", \"tagged\": %s, \"pvid\": %s",
+                          op->tagged ? "true" : "false",
+                          op->pvid ? "true" : "false"))
+            return false;
+        break;
+
+    default:
+        break;
+    }
+
+    return fd_printf_nb(fd, " }");
+}
+
+/*
+ * Dry run of what converging the current configuration would send:
+ * the optimized op list, how many ops were planned before optimizing
+ * and how many netlink messages the result costs.
+ */
+static bool reply_plan(int fd, struct graph *g)
+{
+    struct plan p;
+    bool ok = false;
+
+    plan_init(&p);
+
+    if (graph_plan(g, &p) < 0) {
+        ok = fd_printf_nb(fd, "{ \"error\": \"out of memory\" }\n");
+        goto out;
+    }
+
+    if (!fd_printf_nb(fd, "{ \"type\": \"plan\", \"ops\": ["))
+        goto out;
+
+    bool first = true;
+
+    for (size_t i = 0; i < p.n; i++) {
+        const struct plan_op *op = &p.ops[i];
+
+        if (op->type == PLAN_NOP)
+            continue;
+
+        if (!first && !fd_printf_nb(fd, ","))
+            goto out;
+        first = false;
+
+        if (!reply_plan_op(fd, op))
+            goto out;
+    }
+
+    ok = fd_printf_nb(fd,
+        "], \"planned\": %zu, \"optimized\": %zu, \"messages\": %zu }\n",
+        p.n, plan_count(&p), action_plan_messages(&p));
+
+out:
+    plan_free(&p);
+    return ok;
+}
+
+static bool reply_flush(int fd, struct graph *g)
+{
+    size_t nodes = g->count;
+
+    graph_flush(g);
+
+    return fd_printf_nb(fd,
+        "{ \"type\": \"flush\", \"nodes\": %zu }\n", nodes);
+}
+
 static bool handle_signal_cmd(int fd, struct graph *g, char *args)
 {
     char node[64], sig[64];
@@ -628,7 +739,7 @@ int socket_handle_client(int fd, struct graph *g)
         if (strcmp(line, "HELLO") == 0) {
             if (!fd_printf_nb(fd,
                 "{ \"type\": \"hello\", \"version\": 1, "
-                "\"features\": [\"status\",\"dump\",\"save\",\"subscribe\"] }\n"))
+                "\"features\": [\"status\",\"dump\",\"save\",\"subscribe\",\"stats\",\"flush\",\"plan\"] }\n"))
                 return SOCKET_ERROR;
             continue;
         }
@@ -657,11 +768,29 @@ int socket_handle_client(int fd, struct graph *g)
             continue;
         }
 
+        if (strcmp(line, "STATS") == 0) {
+            if (!reply_stats(fd, g))
+                return SOCKET_ERROR;
+            continue;
+        }
+
         if (strcmp(line, "SAVE") == 0) {
             reply_save(fd, g);
             return SOCKET_MUTATE;
         }
 
+        if (strcmp(line, "PLAN") == 0) {
+            if (!reply_plan(fd, g))
+                return SOCKET_ERROR;
+            continue;
+        }
+
+        if (strcmp(line, "FLUSH") == 0) {
+            if (!reply_flush(fd, g))
+                return SOCKET_ERROR;
+            return SOCKET_MUTATE;
+        }
+
         if (strncmp(line, "SIGNAL ", 7) == 0) {
             if (!handle_signal_cmd(fd, g, line + 7))
                 return SOCKET_ERROR;
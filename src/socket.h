@@ -1,6 +1,9 @@
 #ifndef LNMGR_SOCKET_H
 #define LNMGR_SOCKET_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "lnmgr_status.h"
 
 struct graph;
@@ -12,26 +15,19 @@ enum socket_result {
     SOCKET_MUTATE = 2,
 };
 
-struct signal_state {
-    char *name;
-    bool value;
-
-    struct signal_state *next;
-};
-
 struct node_state {
     char *id;                      /* node id */
     struct lnmgr_explain last;     /* last state/code seen */
 
-    struct signal_state *signals;  /* NEW: per-subscriber signal snapshot */
-
-    struct node_state *next;
+    uint64_t sig_value;            /* per-subscriber signal snapshot */
 };
 
 struct subscriber {
     int fd;
 
+    /* indexed by node->idx; id == NULL for unused slots */
     struct node_state *states;
+    size_t             states_n;
 
     struct subscriber *next;
 };
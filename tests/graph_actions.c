@@ -1,7 +1,11 @@
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../src/graph.h"
+#include "../src/actions.h"
+#include "../src/plan.h"
+#include "graph_tests.h"
 
 static action_result_t activate_ok(struct node *n)
 {
@@ -15,21 +19,70 @@ static action_result_t activate_fail(struct node *n)
     return ACTION_FAIL;
 }
 
+static int activations;
+
+static action_result_t activate_count(struct node *n)
+{
+    (void)n;
+    activations++;
+    return ACTION_OK;
+}
+
+static action_result_t activate_pending(struct node *n)
+{
+    (void)n;
+    activations++;
+    return ACTION_PENDING;
+}
+
+static char order[16];
+
+static action_result_t activate_record(struct node *n)
+{
+    strncat(order, n->id, sizeof(order) - strlen(order) - 1);
+    return ACTION_OK;
+}
+
+static void deactivate_record(struct node *n)
+{
+    strncat(order, n->id, sizeof(order) - strlen(order) - 1);
+}
+
 static struct action_ops ok_ops = {
     .activate = activate_ok,
     .deactivate = NULL,
 };
 
+static struct action_ops count_ops = {
+    .activate = activate_count,
+    .deactivate = NULL,
+};
+
+static struct action_ops record_ops = {
+    .activate = activate_record,
+    .deactivate = NULL,
+};
+
+static struct action_ops teardown_ops = {
+    .activate = activate_ok,
+    .deactivate = deactivate_record,
+};
+
 static struct action_ops fail_ops = {
     .activate = activate_fail,
     .deactivate = NULL,
 };
 
+static struct action_ops pending_ops = {
+    .activate = activate_pending,
+    .deactivate = NULL,
+};
+
 void test_action_success(void)
 {
     struct graph *g = graph_create();
 
-    struct node *n = graph_add_node(g, "A", NODE_DEVICE);
+    struct node *n = graph_add_node(g, "A", KIND_LINK_GENERIC);
     n->actions = &ok_ops;
 
     graph_enable_node(g, "A");
@@ -45,7 +98,7 @@ void test_action_failure(void)
 {
     struct graph *g = graph_create();
 
-    struct node *n = graph_add_node(g, "A", NODE_DEVICE);
+    struct node *n = graph_add_node(g, "A", KIND_LINK_GENERIC);
     n->actions = &fail_ops;
 
     graph_enable_node(g, "A");
@@ -60,3 +113,334 @@ void test_action_failure(void)
     graph_destroy(g);
     printf("test_action_failure: OK\n");
 }
+
+/*
+ * Events on one node must not touch unrelated nodes
+ */
+void test_action_blast_radius(void)
+{
+    struct graph *g = graph_create();
+
+    struct node *a = graph_add_node(g, "A", KIND_LINK_GENERIC);
+    struct node *b = graph_add_node(g, "B", KIND_LINK_GENERIC);
+    a->actions = &ok_ops;
+    b->actions = &count_ops;
+
+    graph_add_signal(g, "B", "carrier");
+
+    graph_enable_node(g, "A");
+    graph_enable_node(g, "B");
+
+    activations = 0;
+    graph_evaluate(g);
+    assert(b->state == NODE_WAITING);
+    assert(activations == 1);
+
+    graph_set_signal(g, "A", "ready", true);
+    graph_evaluate(g);
+    assert(activations == 1);
+
+    graph_destroy(g);
+    printf("test_action_blast_radius: OK\n");
+}
+
+/*
+ * Activation follows dependency order, whatever the insertion order
+ */
+void test_action_order(void)
+{
+    struct graph *g = graph_create();
+    const char *ids[] = { "A", "B", "C", "D" };
+
+    for (int i = 0; i < 4; i++) {
+        struct node *n = graph_add_node(g, ids[i], KIND_LINK_GENERIC);
+        n->actions = &record_ops;
+    }
+
+    graph_add_require(g, "A", "B");
+    graph_add_require(g, "B", "C");
+    graph_add_require(g, "C", "D");
+
+    for (int i = 0; i < 4; i++)
+        graph_enable_node(g, ids[i]);
+
+    order[0] = '\0';
+    assert(graph_prepare(g) == 0);
+    graph_evaluate(g);
+
+    assert(strcmp(order, "DCBA") == 0);
+    assert(graph_find_node(g, "A")->state == NODE_ACTIVE);
+
+    graph_destroy(g);
+    printf("test_action_order: OK\n");
+}
+
+/*
+ * Flush tears down dependents before what they depend on, whatever the
+ * order the nodes were declared in
+ */
+void test_action_teardown_order(void)
+{
+    struct graph *g = graph_create();
+    const char *ids[] = { "D", "B", "A", "C" };
+
+    for (int i = 0; i < 4; i++) {
+        struct node *n = graph_add_node(g, ids[i], KIND_LINK_GENERIC);
+        n->actions = &teardown_ops;
+    }
+
+    graph_add_require(g, "A", "B");
+    graph_add_require(g, "B", "C");
+    graph_add_require(g, "C", "D");
+
+    for (int i = 0; i < 4; i++)
+        graph_enable_node(g, ids[i]);
+
+    assert(graph_prepare(g) == 0);
+    graph_evaluate(g);
+    assert(graph_find_node(g, "A")->state == NODE_ACTIVE);
+
+    order[0] = '\0';
+    assert(graph_flush(g) == 0);
+
+    assert(strcmp(order, "ABCD") == 0);
+    assert(g->count == 0);
+
+    graph_destroy(g);
+    printf("test_action_teardown_order: OK\n");
+}
+
+/*
+ * A flush tears down a node that was activated but is WAITING again,
+ * as it does an ACTIVE one
+ */
+void test_action_flush_waiting(void)
+{
+    struct graph *g = graph_create();
+    struct plan p;
+
+    struct action_ops ops = {
+        .activate   = activate_ok,
+        .deactivate = action_ops_for_kind(KIND_LINK_VETH)->deactivate,
+    };
+
+    struct node *n = graph_add_node(g, "A", KIND_LINK_VETH);
+    n->actions = &ops;
+    n->ifindex = 7;
+
+    graph_add_signal(g, "A", "carrier");
+    graph_enable_node(g, "A");
+    graph_evaluate(g);
+    assert(n->state == NODE_WAITING && n->activated);
+
+    plan_init(&p);
+    action_plan_begin(&p);
+    assert(graph_flush(g) == 0);
+
+    assert(p.n == 1);
+    assert(p.ops[0].type == PLAN_DOWN && p.ops[0].ifindex == 7);
+    assert(g->stats.deactivations == 1);
+
+    action_plan_end();
+    plan_free(&p);
+    graph_destroy(g);
+    printf("test_action_flush_waiting: OK\n");
+}
+
+/*
+ * Activation runs once per enable / presence lifecycle, not once per
+ * evaluation of a dirty node
+ */
+void test_action_memoized(void)
+{
+    struct graph *g = graph_create();
+
+    struct node *n = graph_add_node(g, "A", KIND_LINK_GENERIC);
+    n->actions = &count_ops;
+
+    graph_add_signal(g, "A", "carrier");
+    graph_enable_node(g, "A");
+
+    activations = 0;
+    graph_evaluate(g);
+    assert(n->state == NODE_WAITING);
+
+    /* carrier flaps: the node is re-evaluated, its side effects are not */
+    for (int i = 0; i < 4; i++) {
+        graph_set_signal(g, "A", "carrier", true);
+        graph_evaluate(g);
+        assert(n->state == NODE_ACTIVE);
+
+        graph_set_signal(g, "A", "carrier", false);
+        graph_evaluate(g);
+        assert(n->state == NODE_WAITING);
+    }
+
+    assert(activations == 1);
+    assert(g->stats.activations == 1);
+
+    /* a new lifecycle activates again */
+    node_on_absent(g, n);
+    node_on_present(g, n);
+    graph_enable_node(g, "A");
+    graph_evaluate(g);
+    assert(activations == 2);
+
+    graph_destroy(g);
+    printf("test_action_memoized: OK\n");
+}
+
+/*
+ * A submitted activation holds the node (and its dependents) in
+ * WAITING without being resubmitted; a disable abandons it
+ */
+void test_action_pending(void)
+{
+    struct graph *g = graph_create();
+
+    struct node *a = graph_add_node(g, "A", KIND_LINK_GENERIC);
+    struct node *b = graph_add_node(g, "B", KIND_LINK_GENERIC);
+    a->actions = &pending_ops;
+    b->actions = &count_ops;
+
+    graph_add_require(g, "B", "A");
+    graph_enable_node(g, "A");
+    graph_enable_node(g, "B");
+
+    activations = 0;
+    graph_evaluate(g);
+    assert(a->state == NODE_WAITING);
+    assert(a->activating && !a->activated);
+    assert(b->state == NODE_WAITING);
+    assert(activations == 1);
+
+    struct explain e = graph_explain_node(g, "A");
+    assert(e.type == EXPLAIN_PENDING);
+
+    /* re-evaluation does not submit again */
+    graph_mark_dirty(g, a);
+    graph_evaluate(g);
+    assert(activations == 1);
+
+    /* nothing finished: no completions to fold in */
+    assert(!graph_complete_actions(g));
+
+    graph_disable_node(g, "A");
+    assert(!a->activating);
+
+    graph_enable_node(g, "A");
+    graph_evaluate(g);
+    assert(activations == 2);
+    assert(a->act_gen == 2);
+
+    graph_destroy(g);
+    printf("test_action_pending: OK\n");
+}
+
+/*
+ * The optimizer keeps teardown in recorded order ahead of creations,
+ * groups the rest by link, drops repeats and merges VLAN ranges
+ */
+void test_plan_optimize(void)
+{
+    struct graph *g = graph_create();
+    struct node *a = graph_add_node(g, "A", KIND_LINK_GENERIC);
+    struct node *br = graph_add_node(g, "br", KIND_L2_BRIDGE);
+    struct plan p;
+    struct plan_op *op;
+
+    plan_init(&p);
+
+    plan_add(&p, PLAN_UP, 5, "A");
+    op = plan_add(&p, PLAN_VLAN_ADD, 5, "A");
+    op->first = op->last = 10;
+    op = plan_add(&p, PLAN_VLAN_ADD, 5, "A");
+    op->first = 11;
+    op->last  = 20;
+    plan_add(&p, PLAN_UP, 5, "A");
+    assert(plan_claim(&p, 0, a, 1));
+
+    plan_add(&p, PLAN_CREATE, 0, "br");
+    assert(plan_claim(&p, 4, br, 1));
+    assert(!plan_claim(&p, 5, br, 1));
+
+    plan_add(&p, PLAN_DOWN, 7, "x");
+    plan_add(&p, PLAN_DOWN, 3, "y");
+
+    plan_optimize(&p);
+
+    assert(p.n == 7);
+    assert(plan_count(&p) == 5);
+
+    assert(p.ops[0].type == PLAN_DOWN && p.ops[0].ifindex == 7);
+    assert(p.ops[1].type == PLAN_DOWN && p.ops[1].ifindex == 3);
+    assert(p.ops[2].type == PLAN_CREATE && p.ops[2].node == br);
+    assert(p.ops[3].type == PLAN_UP && p.ops[3].node == a);
+    assert(p.ops[4].type == PLAN_VLAN_ADD);
+    assert(p.ops[4].first == 10 && p.ops[4].last == 20);
+    assert(p.ops[5].type == PLAN_NOP && p.ops[5].node == a);
+    assert(p.ops[6].type == PLAN_NOP && p.ops[6].node == a);
+
+    /* merged into its neighbour vs. a repeat of the kept UP */
+    assert(p.ops[5].dup == 0);
+    assert(p.ops[6].dup == 4);
+
+    /* one message per remaining op; the VLAN run packs into one */
+    assert(action_plan_messages(&p) == 5);
+
+    plan_free(&p);
+    graph_destroy(g);
+    printf("test_plan_optimize: OK\n");
+}
+
+/*
+ * PLAN on a fresh config: ports and VLANs over a bridge the same plan
+ * creates are planned against it, not dropped
+ */
+void test_plan_fresh_bridge(void)
+{
+    struct graph *g = graph_create();
+    struct node *br = graph_add_node(g, "br0", KIND_L2_BRIDGE);
+    struct node *lan = graph_add_node(g, "lan1", KIND_LINK_ETHERNET);
+    struct node *v = graph_add_node(g, "br0.10", KIND_L2_VLAN_DOMAIN);
+    struct plan p;
+
+    feat_attach(g, br, FEAT_BRIDGE, sizeof(struct feat_bridge));
+    feat_attach(g, lan, FEAT_BRIDGE_PORT, sizeof(struct feat_bridge_port));
+
+    struct feat_master *fm = (struct feat_master *)
+        feat_attach(g, lan, FEAT_MASTER, sizeof(*fm));
+    fm->master_id = graph_strdup(g, "br0");
+
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)
+        feat_attach(g, v, FEAT_VLAN_DOMAIN, sizeof(*fv));
+    fv->parent_id = graph_strdup(g, "br0");
+    fv->vid = 10;
+
+    assert(graph_prepare(g) == 0);
+
+    lan->present = true;
+    lan->ifindex = 5;
+
+    graph_enable_node(g, "br0");
+    graph_enable_node(g, "lan1");
+    graph_enable_node(g, "br0.10");
+
+    plan_init(&p);
+    assert(graph_plan(g, &p) == 0);
+
+    assert(plan_count(&p) == 4);
+    assert(p.ops[0].type == PLAN_CREATE && p.ops[0].node == br);
+    assert(p.ops[1].type == PLAN_CREATE && p.ops[1].node == v);
+    assert(p.ops[1].arg < 0);
+    assert(p.ops[2].type == PLAN_MASTER && p.ops[2].ifindex == 5);
+    assert(strcmp(p.ops[2].master, "br0") == 0);
+    assert(p.ops[2].arg == p.ops[1].arg);
+    assert(p.ops[3].type == PLAN_UP && p.ops[3].ifindex == 5);
+
+    assert(action_plan_messages(&p) == 4);
+
+    plan_free(&p);
+    graph_destroy(g);
+    printf("test_plan_fresh_bridge: OK\n");
+}
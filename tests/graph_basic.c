@@ -3,10 +3,7 @@
 #include <string.h>
 
 #include "../src/graph.h"
-
-/* action tests */
-void test_action_success(void);
-void test_action_failure(void);
+#include "graph_tests.h"
 
 /*
  * Test 1: single node enable
@@ -16,7 +13,7 @@ static void test_single_node_enable(void)
     struct graph *g = graph_create();
     assert(g);
 
-    struct node *n = graph_add_node(g, "eth0", NODE_DEVICE);
+    struct node *n = graph_add_node(g, "eth0", KIND_LINK_GENERIC);
     assert(n);
 
     /* initially inactive */
@@ -38,8 +35,8 @@ static void test_simple_dependency(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
 
     graph_add_require(g, "B", "A");
 
@@ -65,8 +62,8 @@ static void test_blocked_dependency(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
 
     graph_add_require(g, "B", "A");
 
@@ -93,10 +90,10 @@ static void test_diamond_dependency(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
-    graph_add_node(g, "C", NODE_DEVICE);
-    graph_add_node(g, "D", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
+    graph_add_node(g, "C", KIND_LINK_GENERIC);
+    graph_add_node(g, "D", KIND_LINK_GENERIC);
 
     graph_add_require(g, "B", "A");
     graph_add_require(g, "C", "A");
@@ -126,7 +123,7 @@ static void test_disable_node(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
     graph_enable_node(g, "A");
     graph_evaluate(g);
 
@@ -149,8 +146,8 @@ static void test_simple_cycle(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
 
     graph_add_require(g, "A", "B");
     graph_add_require(g, "B", "A");
@@ -170,10 +167,44 @@ static void test_simple_cycle(void)
     printf("test_simple_cycle: OK\n");
 }
 
+/*
+ * Test 7: only cycle members fail, nodes behind the cycle just wait
+ */
+static void test_cycle_downstream(void)
+{
+    struct graph *g = graph_create();
+
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
+    graph_add_node(g, "C", KIND_LINK_GENERIC);
+
+    graph_add_require(g, "A", "B");
+    graph_add_require(g, "B", "A");
+    graph_add_require(g, "C", "A");
+
+    graph_enable_node(g, "A");
+    graph_enable_node(g, "B");
+    graph_enable_node(g, "C");
+
+    assert(graph_prepare(g) < 0);
+    graph_evaluate(g);
+
+    struct node *A = graph_find_node(g, "A");
+    struct node *C = graph_find_node(g, "C");
+
+    assert(A->state == NODE_FAILED);
+    assert(A->fail_reason == FAIL_CYCLE);
+    assert(C->state == NODE_WAITING);
+    assert(C->fail_reason == FAIL_NONE);
+
+    graph_destroy(g);
+    printf("test_cycle_downstream: OK\n");
+}
+
 static void test_explain_disabled(void)
 {
     struct graph *g = graph_create();
-    graph_add_node(g, "A", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
 
     struct explain e = graph_explain_node(g, "A");
     assert(e.type == EXPLAIN_DISABLED);
@@ -186,8 +217,8 @@ static void test_explain_blocked(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
     graph_add_require(g, "B", "A");
 
     graph_enable_node(g, "B");
@@ -205,8 +236,8 @@ static void test_explain_failed(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
     graph_add_require(g, "A", "B");
     graph_add_require(g, "B", "A");
 
@@ -225,7 +256,7 @@ static void test_signal_blocks(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "eth0", NODE_DEVICE);
+    graph_add_node(g, "eth0", KIND_LINK_GENERIC);
     graph_add_signal(g, "eth0", "carrier");
 
     graph_enable_node(g, "eth0");
@@ -246,7 +277,7 @@ static void test_signal_allows(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "eth0", NODE_DEVICE);
+    graph_add_node(g, "eth0", KIND_LINK_GENERIC);
     graph_add_signal(g, "eth0", "carrier");
 
     graph_enable_node(g, "eth0");
@@ -264,8 +295,8 @@ static void test_dependency_before_signal(void)
 {
     struct graph *g = graph_create();
 
-    graph_add_node(g, "A", NODE_DEVICE);
-    graph_add_node(g, "B", NODE_DEVICE);
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
 
     graph_add_require(g, "B", "A");
     graph_add_signal(g, "B", "ready");
@@ -281,6 +312,253 @@ static void test_dependency_before_signal(void)
     printf("test_dependency_before_signal: OK\n");
 }
 
+/*
+ * A signal on a required node re-evaluates its dependents
+ */
+static void test_signal_propagates(void)
+{
+    struct graph *g = graph_create();
+
+    graph_add_node(g, "A", KIND_LINK_GENERIC);
+    graph_add_node(g, "B", KIND_LINK_GENERIC);
+    graph_add_node(g, "C", KIND_LINK_GENERIC);
+
+    graph_add_require(g, "B", "A");
+    graph_add_require(g, "C", "B");
+    graph_add_signal(g, "A", "carrier");
+
+    graph_enable_node(g, "A");
+    graph_enable_node(g, "B");
+    graph_enable_node(g, "C");
+    graph_evaluate(g);
+
+    assert(graph_find_node(g, "C")->state == NODE_WAITING);
+
+    graph_set_signal(g, "A", "carrier", true);
+    graph_evaluate(g);
+
+    assert(graph_find_node(g, "A")->state == NODE_ACTIVE);
+    assert(graph_find_node(g, "B")->state == NODE_ACTIVE);
+    assert(graph_find_node(g, "C")->state == NODE_ACTIVE);
+
+    graph_destroy(g);
+    printf("test_signal_propagates: OK\n");
+}
+
+/*
+ * Lookup stays correct across index growth and deletion
+ */
+static void test_find_many_nodes(void)
+{
+    struct graph *g = graph_create();
+    char id[32];
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(id, sizeof(id), "lan%d", i);
+        assert(graph_add_node(g, id, KIND_LINK_GENERIC));
+    }
+
+    /* duplicates are rejected */
+    assert(!graph_add_node(g, "lan7", KIND_LINK_GENERIC));
+
+    for (int i = 0; i < 1000; i += 2) {
+        snprintf(id, sizeof(id), "lan%d", i);
+        assert(graph_del_node(g, id) == 0);
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(id, sizeof(id), "lan%d", i);
+        struct node *n = graph_find_node(g, id);
+        assert((i % 2) ? (n && strcmp(n->id, id) == 0) : !n);
+    }
+
+    graph_flush(g);
+    assert(!graph_find_node(g, "lan1"));
+    assert(graph_add_node(g, "lan1", KIND_LINK_GENERIC));
+
+    graph_destroy(g);
+    printf("test_find_many_nodes: OK\n");
+}
+
+/*
+ * Rebuilding after flush and churning nodes/edges reuses storage
+ * without disturbing the live graph
+ */
+static void test_rebuild_after_flush(void)
+{
+    struct graph *g = graph_create();
+    char id[32], prev[32];
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 200; i++) {
+            snprintf(id, sizeof(id), "n%d", i);
+            assert(graph_add_node(g, id, KIND_LINK_GENERIC));
+            if (i)
+                assert(graph_add_require(g, id, prev) == 0);
+            memcpy(prev, id, sizeof(prev));
+        }
+
+        /* drop and re-add the middle of the chain */
+        assert(graph_del_node(g, "n100") == 0);
+        assert(graph_add_node(g, "n100", KIND_LINK_GENERIC));
+        assert(graph_add_require(g, "n100", "n99") == 0);
+        assert(graph_add_require(g, "n101", "n100") == 0);
+
+        for (int i = 0; i < 200; i++) {
+            snprintf(id, sizeof(id), "n%d", i);
+            graph_enable_node(g, id);
+        }
+        graph_evaluate(g);
+
+        assert(graph_find_node(g, "n199")->state == NODE_ACTIVE);
+
+        graph_flush(g);
+        assert(!graph_find_node(g, "n0"));
+    }
+
+    graph_destroy(g);
+    printf("test_rebuild_after_flush: OK\n");
+}
+
+/*
+ * Deleting a node moves another into its slot; evaluation must still
+ * follow the right edges afterwards
+ */
+static void test_delete_reindexes(void)
+{
+    struct graph *g = graph_create();
+
+    graph_add_node(g, "a", KIND_LINK_GENERIC);
+    graph_add_node(g, "b", KIND_LINK_GENERIC);
+    graph_add_node(g, "c", KIND_LINK_GENERIC);
+    graph_add_node(g, "d", KIND_LINK_GENERIC);
+
+    graph_add_require(g, "c", "b");
+    graph_add_require(g, "d", "c");
+    graph_add_signal(g, "b", "carrier");
+
+    graph_enable_node(g, "b");
+    graph_enable_node(g, "c");
+    graph_enable_node(g, "d");
+    graph_evaluate(g);
+
+    assert(graph_del_node(g, "a") == 0);
+
+    for (size_t i = 0; i < g->count; i++)
+        assert(g->vec[i]->idx == i);
+
+    assert(graph_find_node(g, "d")->state == NODE_WAITING);
+
+    graph_set_signal(g, "b", "carrier", true);
+    graph_evaluate(g);
+
+    assert(graph_find_node(g, "b")->state == NODE_ACTIVE);
+    assert(graph_find_node(g, "c")->state == NODE_ACTIVE);
+    assert(graph_find_node(g, "d")->state == NODE_ACTIVE);
+
+    graph_destroy(g);
+    printf("test_delete_reindexes: OK\n");
+}
+
+struct node_feature *
+feat_attach(struct graph *g, struct node *n, node_feature_type_t type,
+            size_t size)
+{
+    struct node_feature *f = graph_alloc(g, size);
+    assert(f);
+
+    f->type = type;
+    f->data = f;
+    f->next = n->features;
+    n->features = f;
+    return f;
+}
+
+/*
+ * Bridge-port VLANs: inherit from the bridge, apply port overrides,
+ * and reject VLANs the bridge does not carry
+ */
+static void test_vlan_port_resolution(void)
+{
+    struct graph *g = graph_create();
+
+    struct node *br = graph_add_node(g, "br-lan", KIND_LINK_GENERIC);
+    struct node *p  = graph_add_node(g, "lan1", KIND_LINK_GENERIC);
+
+    struct feat_bridge *fb = (struct feat_bridge *)
+        feat_attach(g, br, FEAT_BRIDGE, sizeof(*fb));
+    fb->vlans = graph_alloc(g, sizeof(*fb->vlans));
+    assert(l2_vlan_set_add(fb->vlans, 1, false, false) == 0);
+    assert(l2_vlan_set_add_range(fb->vlans, 10, 20, true, false) == 0);
+
+    /* attached at the head: master resolves before bridge-port */
+    struct feat_bridge_port *bp = (struct feat_bridge_port *)
+        feat_attach(g, p, FEAT_BRIDGE_PORT, sizeof(*bp));
+    bp->vlans = graph_alloc(g, sizeof(*bp->vlans));
+    assert(l2_vlan_set_add(bp->vlans, 15, false, true) == 0);
+
+    struct feat_master *fm = (struct feat_master *)
+        feat_attach(g, p, FEAT_MASTER, sizeof(*fm));
+    fm->master_id = graph_strdup(g, "br-lan");
+
+    assert(graph_prepare(g) == 0);
+    assert(p->topo.vlans);
+    assert(l2_vlan_set_count(p->topo.vlans) == 12);
+
+    static const struct l2_vlan_range want[] = {
+        {  1,  1, false, false },
+        { 10, 14, true,  false },
+        { 15, 15, false, true  },
+        { 16, 20, true,  false },
+    };
+    struct l2_vlan_range r;
+    unsigned int from = 0;
+    size_t k = 0;
+
+    while (l2_vlan_set_next_range(p->topo.vlans, &from, &r)) {
+        assert(k < ARRAY_SIZE(want));
+        assert(r.first == want[k].first && r.last == want[k].last);
+        assert(r.tagged == want[k].tagged && r.pvid == want[k].pvid);
+        k++;
+    }
+    assert(k == ARRAY_SIZE(want));
+
+    /* port may not introduce a VLAN the bridge lacks */
+    assert(l2_vlan_set_add(bp->vlans, 30, true, false) == 0);
+    assert(graph_prepare(g) != 0);
+    assert(p->state == NODE_FAILED);
+
+    graph_destroy(g);
+    printf("test_vlan_port_resolution: OK\n");
+}
+
+static void test_vlan_subif_features(void)
+{
+    struct graph *g = graph_create();
+
+    struct node *eth = graph_add_node(g, "eth0", KIND_LINK_GENERIC);
+    struct node *v   = graph_add_node(g, "eth0.100", KIND_LINK_GENERIC);
+
+    struct feat_vlan_domain *fv = (struct feat_vlan_domain *)
+        feat_attach(g, v, FEAT_VLAN_DOMAIN, sizeof(*fv));
+    fv->parent_id = graph_strdup(g, "eth0");
+
+    /* vid 0 is not a VLAN */
+    assert(graph_prepare(g) != 0);
+
+    fv->vid = 100;
+    assert(graph_prepare(g) == 0);
+    assert(fv->parent == eth);
+
+    /* a parent outside the graph is left to the kernel */
+    fv->parent_id = graph_strdup(g, "eth9");
+    assert(graph_prepare(g) == 0);
+    assert(fv->parent == NULL);
+
+    graph_destroy(g);
+    printf("test_vlan_subif_features: OK\n");
+}
+
 /*
  * Main test runner
  */
@@ -291,6 +569,7 @@ int main(void)
     test_blocked_dependency();
     test_diamond_dependency();
     test_simple_cycle();
+    test_cycle_downstream();
     test_explain_disabled();
     test_explain_blocked();
     test_explain_failed();
@@ -298,10 +577,24 @@ int main(void)
     test_signal_blocks();
     test_dependency_before_signal();
     test_disable_node();
+    test_find_many_nodes();
+    test_signal_propagates();
+    test_rebuild_after_flush();
+    test_delete_reindexes();
+    test_vlan_port_resolution();
+    test_vlan_subif_features();
 
     /* action tests */
     test_action_success();
     test_action_failure();
+    test_action_blast_radius();
+    test_action_order();
+    test_action_teardown_order();
+    test_action_flush_waiting();
+    test_action_memoized();
+    test_action_pending();
+    test_plan_optimize();
+    test_plan_fresh_bridge();
 
     printf("All graph tests passed.\n");
     return 0;
@@ -0,0 +1,23 @@
+#ifndef LNMGR_GRAPH_TESTS_H
+#define LNMGR_GRAPH_TESTS_H
+
+#include "../src/graph.h"
+
+/* attach a zeroed feature of size bytes (graph_basic.c) */
+struct node_feature *
+feat_attach(struct graph *g, struct node *n, node_feature_type_t type,
+            size_t size);
+
+/* action tests (graph_actions.c), run from graph_basic.c */
+void test_action_success(void);
+void test_action_failure(void);
+void test_action_blast_radius(void);
+void test_action_order(void);
+void test_action_teardown_order(void);
+void test_action_flush_waiting(void);
+void test_action_memoized(void);
+void test_action_pending(void);
+void test_plan_optimize(void);
+void test_plan_fresh_bridge(void);
+
+#endif /* LNMGR_GRAPH_TESTS_H */